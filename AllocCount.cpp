@@ -0,0 +1,217 @@
+#include "AllocCount.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+// The debug heap reports malloc and realloc as well as new, so count there
+#define PROCON_CRT_HOOK 1
+#include <crtdbg.h>
+#endif
+
+namespace procon {
+	namespace alloc_count {
+		namespace {
+			std::atomic<bool> counting {false};
+			std::atomic<std::uint64_t> count {0};
+			std::atomic<std::uint64_t> total {0};
+			std::atomic<std::size_t> first {0};
+
+			void note(const std::size_t size) {
+				if (!counting.load(std::memory_order_relaxed))
+					return;
+				if (count.fetch_add(1, std::memory_order_relaxed) == 0)
+					first.store(size, std::memory_order_relaxed);
+				total.fetch_add(size, std::memory_order_relaxed);
+			}
+
+			void* allocate(std::size_t size) {
+#ifndef PROCON_CRT_HOOK
+				note(size);
+#endif
+				if (size == 0)
+					size = 1;
+				for (;;) {
+					if (auto* p = std::malloc(size))
+						return p;
+					const auto handler = std::get_new_handler();
+					if (handler == nullptr)
+						throw std::bad_alloc();
+					handler();
+				}
+			}
+
+#ifdef __cpp_aligned_new
+			// Over-aligned types (alignas above the default) come through here
+			void* allocate(std::size_t size, const std::align_val_t alignment) {
+#ifndef PROCON_CRT_HOOK
+				note(size);
+#endif
+				const auto align = static_cast<std::size_t>(alignment);
+				// aligned_alloc wants a whole number of alignments
+				size = size == 0 ? align : (size + align - 1) / align * align;
+				for (;;) {
+#ifdef _MSC_VER
+					if (auto* p = _aligned_malloc(size, align))
+#else
+					if (auto* p = std::aligned_alloc(align, size))
+#endif
+						return p;
+					const auto handler = std::get_new_handler();
+					if (handler == nullptr)
+						throw std::bad_alloc();
+					handler();
+				}
+			}
+
+			void release(void* p, std::align_val_t) noexcept {
+#ifdef _MSC_VER
+				_aligned_free(p);
+#else
+				std::free(p);
+#endif
+			}
+#endif
+
+#ifdef PROCON_CRT_HOOK
+			int hook(const int type, void*, const std::size_t size, int, long, const unsigned char*, int) {
+				if (type == _HOOK_ALLOC || type == _HOOK_REALLOC)
+					note(size);
+				return 1;
+			}
+
+			const auto installed = _CrtSetAllocHook(hook);
+#endif
+		}
+
+		void arm() {
+			count = 0;
+			total = 0;
+			first = 0;
+			counting = true;
+		}
+
+		void disarm() {
+			counting = false;
+		}
+
+		bool armed() {
+			return counting;
+		}
+
+		std::uint64_t allocations() {
+			return count;
+		}
+
+		std::uint64_t bytes() {
+			return total;
+		}
+
+		std::size_t first_size() {
+			return first;
+		}
+	}
+};
+
+void* operator new(const std::size_t size) {
+	return procon::alloc_count::allocate(size);
+}
+
+void* operator new[](const std::size_t size) {
+	return procon::alloc_count::allocate(size);
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return procon::alloc_count::allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return procon::alloc_count::allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(const std::size_t size, const std::align_val_t align) {
+	return procon::alloc_count::allocate(size, align);
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t align) {
+	return procon::alloc_count::allocate(size, align);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t align, const std::nothrow_t&) noexcept {
+	try {
+		return procon::alloc_count::allocate(size, align);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t align, const std::nothrow_t&) noexcept {
+	try {
+		return procon::alloc_count::allocate(size, align);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* p, const std::align_val_t align) noexcept {
+	procon::alloc_count::release(p, align);
+}
+
+void operator delete[](void* p, const std::align_val_t align) noexcept {
+	procon::alloc_count::release(p, align);
+}
+
+void operator delete(void* p, std::size_t, const std::align_val_t align) noexcept {
+	procon::alloc_count::release(p, align);
+}
+
+void operator delete[](void* p, std::size_t, const std::align_val_t align) noexcept {
+	procon::alloc_count::release(p, align);
+}
+
+void operator delete(void* p, const std::align_val_t align, const std::nothrow_t&) noexcept {
+	procon::alloc_count::release(p, align);
+}
+
+void operator delete[](void* p, const std::align_val_t align, const std::nothrow_t&) noexcept {
+	procon::alloc_count::release(p, align);
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace procon {
+	// Counts heap allocations made through the global operator new, aligned
+	// forms included, while armed. AllocCount.cpp replaces operator new and
+	// delete for the whole program, so it's linked into the tools only; the
+	// driver keeps the CRT's. Counters are process-wide: arm it where nothing
+	// but the code under test is running.
+	namespace alloc_count {
+		void arm();
+		void disarm();
+		bool armed();
+
+		// Since the last arm(); allocations that failed count too
+		std::uint64_t allocations();
+		std::uint64_t bytes();
+		// Of the first allocation made while armed, 0 if there was none
+		std::size_t first_size();
+	}
+};
@@ -0,0 +1,168 @@
+#include "Analyze.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "LinkStats.hpp"
+#include "Report.hpp"
+
+namespace procon {
+	namespace {
+		bool is_output(const uchar id) {
+			return id == 0x01 || id == 0x10;
+		}
+
+		// Both output reports carry 8 rumble bytes after the counter: per
+		// side a frequency byte, then an amplitude byte that idles at 0x01
+		bool rumble_driven(const capture_record& r) {
+			return r.size >= 10 && (r.data[3] > 0x01 || r.data[7] > 0x01);
+		}
+
+		bool outside(const std::uint16_t x, const std::uint16_t y, const std::int64_t radius_squared) {
+			const std::int64_t dx = static_cast<int>(x) - 2048;
+			const std::int64_t dy = static_cast<int>(y) - 2048;
+			return dx * dx + dy * dy > radius_squared;
+		}
+	}
+
+	capture_stats analyze_capture(const mapped_capture& c, const analysis_config& cfg) {
+		capture_stats s {};
+		s.stick_min.fill(0xFFFF);
+
+		const auto radius = static_cast<std::int64_t>(cfg.deadzone * 2048);
+		const auto radius_squared = radius * radius;
+
+		link_monitor link;
+		std::array<std::uint64_t, button_count> pressed_at {};
+		button_mask held = 0;
+		std::uint64_t first_us = 0, last_us = 0, last_report_us = 0;
+		std::uint64_t rumble_since = 0;
+		auto rumbling = false;
+
+		capture_cursor cursor(c);
+		capture_record r;
+		input_report report;
+		while (cursor.next(r)) {
+			if (s.records++ == 0)
+				first_us = r.time_us;
+			last_us = r.time_us;
+			if (r.size == 0)
+				continue;
+
+			if (is_output(r.data[0])) {
+				++s.outputs;
+				const auto on = rumble_driven(r);
+				if (on && !rumbling)
+					rumble_since = r.time_us;
+				else if (!on && rumbling)
+					s.rumble_on_us += r.time_us - rumble_since;
+				rumbling = on;
+				continue;
+			}
+
+			if (!decode_report(r.data, r.size, report)) {
+				++s.rejected;
+				continue;
+			}
+
+			if (s.reports++ != 0) {
+				const auto gap = r.time_us - last_report_us;
+				++s.gaps;
+				++s.gap_histogram[std::min<std::uint64_t>(gap / gap_bucket_us, gap_buckets - 1)];
+				s.longest_gap_us = std::max(s.longest_gap_us, static_cast<std::uint32_t>(gap));
+			}
+			last_report_us = r.time_us;
+			// Simple reports carry no timer to track the link with
+			if (report.id != static_cast<uchar>(report_mode::simple))
+				link.report(report.timer, r.time_us);
+
+			// Subcommand replies carry sticks and buttons too
+			const std::uint16_t axes[] = {report.lx, report.ly, report.rx, report.ry};
+			for (std::size_t a = 0; a < 4; ++a) {
+				s.stick_min[a] = std::min(s.stick_min[a], axes[a]);
+				s.stick_max[a] = std::max(s.stick_max[a], axes[a]);
+			}
+			if (outside(report.lx, report.ly, radius_squared))
+				++s.outside_deadzone[0];
+			if (outside(report.rx, report.ry, radius_squared))
+				++s.outside_deadzone[1];
+
+			const auto changed = report.buttons ^ held;
+			for (std::size_t b = 0; changed >> b != 0; ++b) {
+				if ((changed >> b & 1u) == 0)
+					continue;
+				auto& h = s.buttons[b];
+				if (report.buttons >> b & 1u) {
+					++h.presses;
+					pressed_at[b] = r.time_us;
+				} else {
+					const auto held_us = r.time_us - pressed_at[b];
+					h.held_us += held_us;
+					h.longest_us = std::max(h.longest_us, static_cast<std::uint32_t>(held_us));
+				}
+			}
+			held = report.buttons;
+		}
+
+		// Whatever is still held or rumbling lasts to the end of the capture
+		for (std::size_t b = 0; held >> b != 0; ++b)
+			if (held >> b & 1u) {
+				const auto held_us = last_report_us - pressed_at[b];
+				s.buttons[b].held_us += held_us;
+				s.buttons[b].longest_us = std::max(s.buttons[b].longest_us, static_cast<std::uint32_t>(held_us));
+			}
+		if (rumbling)
+			s.rumble_on_us += last_us - rumble_since;
+
+		s.duration_us = last_us - first_us;
+		s.lost = link.stats().lost;
+		s.duplicates = link.stats().duplicates;
+		return s;
+	}
+
+	void merge(capture_stats& into, const capture_stats& from) {
+		// Stick ranges only mean something once there are reports
+		if (into.reports == 0) {
+			into.stick_min = from.stick_min;
+			into.stick_max = from.stick_max;
+		} else if (from.reports != 0) {
+			for (std::size_t a = 0; a < 4; ++a) {
+				into.stick_min[a] = std::min(into.stick_min[a], from.stick_min[a]);
+				into.stick_max[a] = std::max(into.stick_max[a], from.stick_max[a]);
+			}
+		}
+
+		into.records += from.records;
+		into.reports += from.reports;
+		into.rejected += from.rejected;
+		into.outputs += from.outputs;
+		into.duration_us += from.duration_us;
+		into.gaps += from.gaps;
+		into.longest_gap_us = std::max(into.longest_gap_us, from.longest_gap_us);
+		for (std::size_t i = 0; i < gap_buckets; ++i)
+			into.gap_histogram[i] += from.gap_histogram[i];
+		into.lost += from.lost;
+		into.duplicates += from.duplicates;
+		for (std::size_t i = 0; i < 2; ++i)
+			into.outside_deadzone[i] += from.outside_deadzone[i];
+		for (std::size_t b = 0; b < button_count; ++b) {
+			into.buttons[b].presses += from.buttons[b].presses;
+			into.buttons[b].held_us += from.buttons[b].held_us;
+			into.buttons[b].longest_us = std::max(into.buttons[b].longest_us, from.buttons[b].longest_us);
+		}
+		into.rumble_on_us += from.rumble_on_us;
+	}
+
+	std::uint32_t gap_percentile(const capture_stats& s, const double p) {
+		const auto rank = static_cast<std::uint64_t>(std::ceil(s.gaps * p));
+		std::uint64_t seen = 0;
+
+		for (std::size_t i = 0; i < gap_buckets; ++i) {
+			seen += s.gap_histogram[i];
+			if (seen >= rank && seen != 0)
+				return i + 1 == gap_buckets ? s.longest_gap_us
+						: std::min(s.longest_gap_us, static_cast<std::uint32_t>((i + 1) * gap_bucket_us));
+		}
+		return s.longest_gap_us;
+	}
+};
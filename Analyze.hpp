@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Capture.hpp"
+#include "Common.hpp"
+
+namespace procon {
+	constexpr std::size_t gap_buckets = 256;      // the last one open-ended
+	constexpr std::uint32_t gap_bucket_us = 250;
+
+	struct analysis_config {
+		// Distance from centre, as a fraction of full travel, beyond which a
+		// stick counts as out of its deadzone
+		float deadzone {0.1f};
+	};
+
+	struct hold_stats {
+		std::uint64_t presses;
+		std::uint64_t held_us;     // all presses together
+		std::uint32_t longest_us;
+	};
+
+	// What one pass over a capture finds. Plain counters, so the stats of
+	// several captures merge into a session's.
+	struct capture_stats {
+		std::uint64_t records;
+		std::uint64_t reports;   // input reports the driver's decoder took
+		std::uint64_t rejected;  // input reports it refused
+		std::uint64_t outputs;   // output reports, 0x01 and 0x10
+		std::uint64_t duration_us;
+
+		// Time between consecutive decoded reports
+		std::uint64_t gaps;
+		std::uint32_t longest_gap_us;
+		std::uint64_t gap_histogram[gap_buckets];
+
+		// From the timer byte, as link_monitor counts them
+		std::uint64_t lost;
+		std::uint64_t duplicates;
+
+		std::array<std::uint16_t, 4> stick_min; // lx, ly, rx, ry
+		std::array<std::uint16_t, 4> stick_max;
+		std::array<std::uint64_t, 2> outside_deadzone; // reports, left and right stick
+
+		std::array<hold_stats, button_count> buttons; // by button_index
+
+		std::uint64_t rumble_on_us; // time either motor was driven
+	};
+
+	// One pass over a mapped capture: every record through decode_report
+	// and link_monitor, as the driver sees them
+	capture_stats analyze_capture(const mapped_capture& c, const analysis_config& cfg);
+
+	// Adds 'from' to 'into', as though the captures had been one session;
+	// 'into' may start value-initialized
+	void merge(capture_stats& into, const capture_stats& from);
+
+	// Upper edge of the bucket holding the p-th fraction of gaps
+	std::uint32_t gap_percentile(const capture_stats& s, double p);
+
+	inline double report_rate_hz(const capture_stats& s) {
+		return s.duration_us == 0 ? 0 : s.reports * 1e6 / s.duration_us;
+	}
+};
@@ -0,0 +1,166 @@
+#include "Backend.hpp"
+
+#include "XOutput.hpp"
+
+// Windows 10 1803 and later; older systems fail the call with it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+namespace procon {
+	constexpr std::uint32_t scpvbus_backend::unknown;
+	constexpr LONGLONG scpvbus_backend::ask_interval_us;
+
+	namespace {
+		std::uint32_t pack(const pad_feedback& f) {
+			return static_cast<std::uint32_t>(f.vibrate) | f.large_motor << 8
+				 | f.small_motor << 16 | static_cast<std::uint32_t>(f.led) << 24;
+		}
+
+		pad_feedback unpack(const std::uint32_t v) {
+			return {static_cast<BYTE>(v), static_cast<BYTE>(v >> 8),
+					static_cast<BYTE>(v >> 16), static_cast<BYTE>(v >> 24)};
+		}
+	}
+
+	scpvbus_backend::scpvbus_backend() {
+		for (auto& l : latest)
+			l = unknown;
+	}
+
+	scpvbus_backend::~scpvbus_backend() {
+		stop_watching();
+		if (wake != nullptr)
+			CloseHandle(wake);
+		if (pace != nullptr)
+			CloseHandle(pace);
+	}
+
+	bool scpvbus_backend::plug(const unsigned index) {
+		if (index < latest.size())
+			latest[index] = unknown;
+		return XOutput::XOutputPlugIn(index) == XOutput::XOUTPUT_SUCCESS;
+	}
+
+	void scpvbus_backend::unplug(const unsigned index) {
+		XOutput::XOutputUnPlug(index);
+	}
+
+	bool scpvbus_backend::submit(const unsigned index, const XINPUT_GAMEPAD& pad) {
+		// XOutputSetState takes a non-const pointer but only reads it
+		auto copy = pad;
+		if (XOutput::XOutputSetState(index, &copy) != XOutput::XOUTPUT_SUCCESS)
+			return false;
+
+		// One wakeup covers every submit until the listener gets to them
+		const auto bit = 1u << index;
+		if (watching.load(std::memory_order_acquire) && (submitted.fetch_or(bit) & bit) == 0)
+			SetEvent(wake);
+		return true;
+	}
+
+	bool scpvbus_backend::feedback(const unsigned index, pad_feedback& out) {
+		if (!watching.load(std::memory_order_acquire))
+			return XOutput::XOutputGetState(index, &out.vibrate, &out.large_motor,
+											&out.small_motor, &out.led) == XOutput::XOUTPUT_SUCCESS;
+
+		const auto v = index < latest.size() ? latest[index].load() : unknown;
+		if (v == unknown)
+			return false;
+		out = unpack(v);
+		return true;
+	}
+
+	bool scpvbus_backend::watch_feedback(feedback_listener c) {
+		if (watching)
+			return true;
+		if (wake == nullptr)
+			wake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		if (wake == nullptr)
+			return false;
+		// A plain timer only fires on the system timer's tick, 15.6 ms unless
+		// someone raised its resolution
+		if (pace == nullptr)
+			pace = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+										  TIMER_ALL_ACCESS);
+		if (pace == nullptr)
+			pace = CreateWaitableTimer(nullptr, FALSE, nullptr);
+		if (pace == nullptr)
+			return false;
+
+		changed = std::move(c);
+		stopping = false;
+		listener = std::thread([this] { listen(); });
+		watching.store(true, std::memory_order_release);
+		return true;
+	}
+
+	void scpvbus_backend::stop_watching() {
+		if (!watching)
+			return;
+		watching = false;
+		stopping = true;
+		SetEvent(wake);
+		listener.join();
+	}
+
+	void scpvbus_backend::listen() {
+		while (!stopping.load(std::memory_order_relaxed)) {
+			WaitForSingleObject(wake, INFINITE);
+
+			// Submits until the next ask is due coalesce into it
+			LARGE_INTEGER due;
+			due.QuadPart = -ask_interval_us * 10; // relative, in 100 ns units
+			SetWaitableTimer(pace, &due, 0, nullptr, nullptr, FALSE);
+
+			for (auto bits = submitted.exchange(0); bits != 0; bits &= bits - 1) {
+				unsigned index = 0;
+				while (!(bits >> index & 1u))
+					++index;
+
+				pad_feedback f;
+				if (XOutput::XOutputGetState(index, &f.vibrate, &f.large_motor,
+											 &f.small_motor, &f.led) != XOutput::XOUTPUT_SUCCESS)
+					continue;
+				const auto v = pack(f);
+				if (latest[index].exchange(v) != v)
+					changed(index);
+			}
+			WaitForSingleObject(pace, INFINITE);
+		}
+	}
+
+	memory_backend::memory_backend(const unsigned capacity)
+			: size(capacity), slots(new slot[capacity]()) {}
+
+	bool memory_backend::plug(const unsigned index) {
+		if (index >= size || slots[index].plugged)
+			return false;
+		slots[index].plugged = true;
+		return true;
+	}
+
+	void memory_backend::unplug(const unsigned index) {
+		if (index < size)
+			slots[index].plugged = false;
+	}
+
+	bool memory_backend::submit(const unsigned index, const XINPUT_GAMEPAD& pad) {
+		if (index >= size || !slots[index].plugged)
+			return false;
+		slots[index].pad = pad;
+		slots[index].submits.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool memory_backend::feedback(const unsigned index, pad_feedback& out) {
+		if (index >= size || !slots[index].plugged)
+			return false;
+		out = pad_feedback {0, 0, 0, static_cast<BYTE>(index & 3)};
+		return true;
+	}
+
+	std::uint64_t memory_backend::submits(const unsigned index) const {
+		return index < size ? slots[index].submits.load(std::memory_order_relaxed) : 0;
+	}
+};
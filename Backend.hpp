@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+namespace procon {
+	// Rumble and LED the host last asked a virtual pad for
+	struct pad_feedback {
+		BYTE vibrate; // non-zero when the motor values are meaningful
+		BYTE large_motor, small_motor;
+		BYTE led;     // 0..3
+	};
+
+	// Where mapped pads go: the virtual bus in the driver, or memory in
+	// benchmarks. Each index is written by one thread at a time.
+	class backend {
+	public:
+		virtual ~backend() = default;
+
+		virtual unsigned capacity() const = 0;
+		virtual bool plug(unsigned index) = 0;
+		virtual void unplug(unsigned index) = 0;
+		virtual bool submit(unsigned index, const XINPUT_GAMEPAD& pad) = 0;
+		// False if nothing is known for 'index'
+		virtual bool feedback(unsigned index, pad_feedback& out) = 0;
+
+		// Any thread, called on one of the backend's own whenever the host
+		// changes what it wants for an index
+		using feedback_listener = std::function<void(unsigned index)>;
+
+		// Starts telling the listener about feedback changes; feedback()
+		// then returns what was last seen instead of asking the driver.
+		// False if this backend can only be polled.
+		virtual bool watch_feedback(feedback_listener) { return false; }
+	};
+
+	// ScpVBus through XOutput1_1.dll. XOutput::XOutputInitialize() must have
+	// succeeded first.
+	//
+	// The bus only learns what the host wants when a pad is submitted, and
+	// asking is an IOCTL of its own. Watching moves that off the submitting
+	// thread: the first submit since the listener thread last asked wakes
+	// it, and it asks once for every index submitted since and reports what
+	// changed. Asks are at least ask_interval_us apart however fast pads are
+	// submitted, so a 1 kHz pad costs a quarter of an ask per submit and a
+	// change is seen at most that long after the submit carrying it. A pad
+	// submitted less often than that still costs one ask per submit.
+	class scpvbus_backend : public backend {
+		static constexpr std::uint32_t unknown = 0xFFFFFFFF;
+		static constexpr LONGLONG ask_interval_us = 4000;
+
+		std::array<std::atomic<std::uint32_t>, 4> latest; // packed pad_feedback, or unknown
+		std::atomic<std::uint32_t> submitted {0};         // bit per index not yet asked about
+		std::atomic<bool> watching {false};
+		std::atomic<bool> stopping {false};
+		HANDLE wake {nullptr}; // kept until destruction, so a late submit can still signal it
+		HANDLE pace {nullptr}; // waitable timer spacing the asks
+		feedback_listener changed;
+		std::thread listener;
+
+		void listen();
+	public:
+		scpvbus_backend();
+		scpvbus_backend(const scpvbus_backend&) = delete;
+		scpvbus_backend& operator=(const scpvbus_backend&) = delete;
+		~scpvbus_backend() override;
+
+		unsigned capacity() const override { return 4; }
+		bool plug(unsigned index) override;
+		void unplug(unsigned index) override;
+		bool submit(unsigned index, const XINPUT_GAMEPAD& pad) override;
+		bool feedback(unsigned index, pad_feedback& out) override;
+		bool watch_feedback(feedback_listener c) override;
+
+		// Joins the listener; must come before XOutput1_1.dll is unloaded.
+		// Stop every thread that submits first.
+		void stop_watching();
+	};
+
+	// Keeps the last pad per index and counts submits; for benchmarks and
+	// for running without a bus driver
+	class memory_backend : public backend {
+		struct slot {
+			XINPUT_GAMEPAD pad;
+			std::atomic<std::uint64_t> submits;
+			bool plugged;
+		};
+
+		unsigned size;
+		std::unique_ptr<slot[]> slots;
+	public:
+		explicit memory_backend(unsigned capacity);
+
+		unsigned capacity() const override { return size; }
+		bool plug(unsigned index) override;
+		void unplug(unsigned index) override;
+		bool submit(unsigned index, const XINPUT_GAMEPAD& pad) override;
+		bool feedback(unsigned index, pad_feedback& out) override;
+
+		std::uint64_t submits(unsigned index) const;
+		const XINPUT_GAMEPAD& pad(unsigned index) const { return slots[index].pad; }
+	};
+};
@@ -0,0 +1,219 @@
+#include "BatchDecode.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PROCON_X86 1
+#include <intrin.h>
+#endif
+#if defined(PROCON_X86) && (defined(_MSC_VER) || defined(__SSSE3__))
+#define PROCON_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+namespace procon {
+	constexpr std::size_t report_columns::imu_channels;
+
+	// BatchDecodeAvx2.cpp, built with AVX2 code generation. Decodes whole
+	// groups of 16 and returns how many reports that was; 0 where the file
+	// was built without AVX2.
+	std::size_t decode_batch_avx2(const uchar* reports, std::size_t stride, std::size_t count,
+								  report_columns& out, std::size_t first);
+	bool avx2_kernel_built();
+
+	namespace {
+		constexpr std::size_t stick_offset = 6;
+		constexpr std::size_t imu_offset = 13;
+
+		void decode_header(const uchar* d, report_columns& out, const std::size_t row) {
+			out.id[row] = d[0];
+			out.timer[row] = d[1];
+			out.buttons[row] = decode_buttons(d + 3);
+		}
+
+		void decode_scalar(const uchar* reports, const std::size_t stride, const std::size_t count,
+						   report_columns& out, const std::size_t first) {
+			for (std::size_t i = 0; i < count; ++i) {
+				const auto* d = reports + i * stride;
+				const auto row = first + i;
+				const auto* s = d + stick_offset;
+
+				decode_header(d, out, row);
+				out.sticks[0][row] = static_cast<std::uint16_t>(s[0] | (s[1] & 0x0F) << 8);
+				out.sticks[1][row] = static_cast<std::uint16_t>(s[1] >> 4 | s[2] << 4);
+				out.sticks[2][row] = static_cast<std::uint16_t>(s[3] | (s[4] & 0x0F) << 8);
+				out.sticks[3][row] = static_cast<std::uint16_t>(s[4] >> 4 | s[5] << 4);
+
+				for (std::size_t c = 0; c < report_columns::imu_channels; ++c) {
+					const auto* v = d + imu_offset + 2 * c;
+					out.imu[c][row] = static_cast<std::int16_t>(v[0] | v[1] << 8);
+				}
+			}
+		}
+
+#ifdef PROCON_SSSE3
+		// Eight rows of eight 16-bit values to eight columns
+		void transpose(__m128i (&r)[8]) {
+			__m128i a[8], b[8];
+			for (auto i = 0; i < 4; ++i) {
+				a[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+				a[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+			}
+			for (auto h = 0; h < 2; ++h)
+				for (auto i = 0; i < 2; ++i) {
+					b[4 * h + 2 * i] = _mm_unpacklo_epi32(a[4 * h + i], a[4 * h + i + 2]);
+					b[4 * h + 2 * i + 1] = _mm_unpackhi_epi32(a[4 * h + i], a[4 * h + i + 2]);
+				}
+			for (auto i = 0; i < 4; ++i) {
+				r[2 * i] = _mm_unpacklo_epi64(b[i], b[i + 4]);
+				r[2 * i + 1] = _mm_unpackhi_epi64(b[i], b[i + 4]);
+			}
+		}
+
+		// Groups of 8 reports; returns how many were done
+		std::size_t decode_ssse3(const uchar* reports, const std::size_t stride, const std::size_t count,
+								 report_columns& out, const std::size_t first) {
+			// Two reports' 6 stick bytes per register, each pair of bytes
+			// holding one axis in 16 bits: lx and rx in the low 12, ly and
+			// ry in the high 12
+			const auto pairs = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 8, 9, 9, 10, 11, 12, 12, 13);
+			// x * 16 then >> 4 keeps the low 12 bits, x * 1 then >> 4 the
+			// high 12, so one multiply and shift unpack both
+			const auto scale = _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+			const auto groups = count / 8;
+
+			for (std::size_t g = 0; g < groups; ++g) {
+				const auto* d = reports + g * 8 * stride;
+				const auto row = first + g * 8;
+				const auto at = [&](const std::size_t i, const std::size_t offset) {
+					return reinterpret_cast<const __m128i*>(d + i * stride + offset);
+				};
+
+				__m128i s[4];
+				for (std::size_t i = 0; i < 4; ++i) {
+					const auto both = _mm_unpacklo_epi64(_mm_loadl_epi64(at(2 * i, stick_offset)),
+														 _mm_loadl_epi64(at(2 * i + 1, stick_offset)));
+					s[i] = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(both, pairs), scale), 4);
+				}
+				// Rows of lx ly rx ry, two reports each, to one column per axis
+				const auto t0 = _mm_unpacklo_epi16(s[0], s[1]);
+				const auto t1 = _mm_unpackhi_epi16(s[0], s[1]);
+				const auto t2 = _mm_unpacklo_epi16(s[2], s[3]);
+				const auto t3 = _mm_unpackhi_epi16(s[2], s[3]);
+				const auto u0 = _mm_unpacklo_epi16(t0, t1);
+				const auto u1 = _mm_unpackhi_epi16(t0, t1);
+				const auto u2 = _mm_unpacklo_epi16(t2, t3);
+				const auto u3 = _mm_unpackhi_epi16(t2, t3);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out.sticks[0].data() + row), _mm_unpacklo_epi64(u0, u2));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out.sticks[1].data() + row), _mm_unpackhi_epi64(u0, u2));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out.sticks[2].data() + row), _mm_unpacklo_epi64(u1, u3));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out.sticks[3].data() + row), _mm_unpackhi_epi64(u1, u3));
+
+				// IMU channels are little endian 16-bit already; eight at a
+				// time they only need turning into columns
+				for (std::size_t block = 0; block < 2; ++block) {
+					__m128i r[8];
+					for (std::size_t i = 0; i < 8; ++i)
+						r[i] = _mm_loadu_si128(at(i, imu_offset + 16 * block));
+					transpose(r);
+					for (std::size_t c = 0; c < 8; ++c)
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(out.imu[8 * block + c].data() + row), r[c]);
+				}
+				// The header and buttons are byte lookups either way
+				for (std::size_t i = 0; i < 8; ++i) {
+					decode_header(d + i * stride, out, row + i);
+					for (std::size_t c = 16; c < report_columns::imu_channels; ++c) {
+						const auto* v = d + i * stride + imu_offset + 2 * c;
+						out.imu[c][row + i] = static_cast<std::int16_t>(v[0] | v[1] << 8);
+					}
+				}
+			}
+			return groups * 8;
+		}
+#endif
+
+		struct cpu_features {
+			bool ssse3 {false};
+			bool avx2 {false};
+		};
+
+		cpu_features detect() {
+			cpu_features f;
+#ifdef PROCON_X86
+			int regs[4];
+			__cpuid(regs, 0);
+			const auto highest = regs[0];
+
+			__cpuid(regs, 1);
+			f.ssse3 = (regs[2] >> 9 & 1) != 0;
+			// AVX2 also needs AVX itself and the OS saving the YMM registers;
+			// XGETBV is only there when OSXSAVE says so
+			const auto avx = (regs[2] >> 28 & 1) != 0;
+			const auto os_ymm = (regs[2] >> 27 & 1) != 0 && (_xgetbv(0) & 6) == 6;
+			if (highest >= 7 && avx && os_ymm) {
+				__cpuidex(regs, 7, 0);
+				f.avx2 = (regs[1] >> 5 & 1) != 0;
+			}
+#endif
+			return f;
+		}
+
+		const cpu_features cpu = detect();
+	}
+
+	void report_columns::resize(const std::size_t rows) {
+		id.resize(rows);
+		timer.resize(rows);
+		buttons.resize(rows);
+		for (auto& c : sticks)
+			c.resize(rows);
+		for (auto& c : imu)
+			c.resize(rows);
+	}
+
+	const char* kernel_name(const batch_kernel k) {
+		switch (k) {
+		case batch_kernel::ssse3:
+			return "ssse3";
+		case batch_kernel::avx2:
+			return "avx2";
+		default:
+			return "scalar";
+		}
+	}
+
+	bool kernel_supported(const batch_kernel k) {
+		switch (k) {
+		case batch_kernel::ssse3:
+#ifdef PROCON_SSSE3
+			return cpu.ssse3;
+#else
+			return false;
+#endif
+		case batch_kernel::avx2:
+			return cpu.avx2 && avx2_kernel_built();
+		default:
+			return true;
+		}
+	}
+
+	batch_kernel best_batch_kernel() {
+		if (kernel_supported(batch_kernel::avx2))
+			return batch_kernel::avx2;
+		if (kernel_supported(batch_kernel::ssse3))
+			return batch_kernel::ssse3;
+		return batch_kernel::scalar;
+	}
+
+	void decode_batch(const uchar* reports, const std::size_t stride, const std::size_t count,
+					  report_columns& out, const std::size_t first, const batch_kernel k) {
+		// Each kernel takes the whole groups it can, the next one down the
+		// remainder
+		std::size_t done = 0;
+		if (k == batch_kernel::avx2 && kernel_supported(k))
+			done = decode_batch_avx2(reports, stride, count, out, first);
+#ifdef PROCON_SSSE3
+		if (k != batch_kernel::scalar && kernel_supported(batch_kernel::ssse3))
+			done += decode_ssse3(reports + done * stride, stride, count - done, out, first + done);
+#endif
+		decode_scalar(reports + done * stride, stride, count - done, out, first + done);
+	}
+};
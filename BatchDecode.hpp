@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Common.hpp"
+#include "Report.hpp"
+
+namespace procon {
+	// Full input reports decoded a batch at a time into one array per field,
+	// for offline work over whole captures. Row r of every column is the
+	// r-th report.
+	struct report_columns {
+		static constexpr std::size_t imu_channels = 18;
+
+		std::vector<uchar> id;
+		std::vector<uchar> timer;
+		std::vector<button_mask> buttons;
+		std::array<std::vector<std::uint16_t>, 4> sticks; // lx, ly, rx, ry
+		// Sample-major as in the report: sample 0 accel xyz, gyro xyz, then
+		// samples 1 and 2, each 5 ms after the one before
+		std::array<std::vector<std::int16_t>, imu_channels> imu;
+
+		std::size_t size() const { return id.size(); }
+		void resize(std::size_t rows);
+	};
+
+	// How decode_batch unpacks the sticks and IMU. All produce the same
+	// columns; the vector kernels do 8 or 16 reports per step.
+	enum class batch_kernel {
+		scalar,
+		ssse3,
+		avx2,
+	};
+
+	const char* kernel_name(batch_kernel k);
+
+	// The fastest kernel this CPU and OS can run
+	batch_kernel best_batch_kernel();
+	bool kernel_supported(batch_kernel k);
+
+	// Decodes 'count' full reports (0x30/0x31, input_report_size bytes or
+	// more) laid out 'stride' bytes apart into rows first .. first + count
+	// of 'out', which must already have that many rows. Battery, ack and
+	// subcommand fields aren't kept.
+	void decode_batch(const uchar* reports, std::size_t stride, std::size_t count,
+					  report_columns& out, std::size_t first, batch_kernel k);
+
+	inline void decode_batch(const uchar* reports, const std::size_t stride, const std::size_t count,
+							 report_columns& out, const std::size_t first) {
+		decode_batch(reports, stride, count, out, first, best_batch_kernel());
+	}
+};
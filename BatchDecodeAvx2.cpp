@@ -0,0 +1,124 @@
+// The AVX2 kernel of decode_batch. This file alone is built with
+// /arch:AVX2; BatchDecode.cpp only calls into it after checking the CPU.
+
+#include "BatchDecode.hpp"
+
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__AVX2__)
+#define PROCON_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace procon {
+#ifdef PROCON_AVX2
+	namespace {
+		constexpr std::size_t stick_offset = 6;
+		constexpr std::size_t imu_offset = 13;
+
+		// Report i of a group in the low half, report i + 8 in the high
+		// half, so every in-lane step below works on two groups of 8 and
+		// the columns come out in order
+		__m256i load_pair(const uchar* d, const std::size_t stride, const std::size_t i, const std::size_t offset) {
+			const auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i * stride + offset));
+			const auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + (i + 8) * stride + offset));
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		}
+
+		__m256i load_sticks(const uchar* d, const std::size_t stride, const std::size_t i) {
+			const auto at = [&](const std::size_t r) {
+				return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(d + r * stride + stick_offset));
+			};
+			const auto lo = _mm_unpacklo_epi64(at(i), at(i + 1));
+			const auto hi = _mm_unpacklo_epi64(at(i + 8), at(i + 9));
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		}
+
+		void transpose(__m256i (&r)[8]) {
+			__m256i a[8], b[8];
+			for (auto i = 0; i < 4; ++i) {
+				a[2 * i] = _mm256_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+				a[2 * i + 1] = _mm256_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+			}
+			for (auto h = 0; h < 2; ++h)
+				for (auto i = 0; i < 2; ++i) {
+					b[4 * h + 2 * i] = _mm256_unpacklo_epi32(a[4 * h + i], a[4 * h + i + 2]);
+					b[4 * h + 2 * i + 1] = _mm256_unpackhi_epi32(a[4 * h + i], a[4 * h + i + 2]);
+				}
+			for (auto i = 0; i < 4; ++i) {
+				r[2 * i] = _mm256_unpacklo_epi64(b[i], b[i + 4]);
+				r[2 * i + 1] = _mm256_unpackhi_epi64(b[i], b[i + 4]);
+			}
+		}
+
+		void store(std::int16_t* to, const __m256i v) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(to), v);
+		}
+
+		void store(std::uint16_t* to, const __m256i v) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(to), v);
+		}
+	}
+
+	bool avx2_kernel_built() {
+		return true;
+	}
+
+	// The SSSE3 kernel's steps, 16 reports at a time
+	std::size_t decode_batch_avx2(const uchar* reports, const std::size_t stride, const std::size_t count,
+								  report_columns& out, const std::size_t first) {
+		const auto pairs = _mm256_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 8, 9, 9, 10, 11, 12, 12, 13,
+											0, 1, 1, 2, 3, 4, 4, 5, 8, 9, 9, 10, 11, 12, 12, 13);
+		const auto scale = _mm256_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1);
+		const auto groups = count / 16;
+
+		for (std::size_t g = 0; g < groups; ++g) {
+			const auto* d = reports + g * 16 * stride;
+			const auto row = first + g * 16;
+
+			__m256i s[4];
+			for (std::size_t i = 0; i < 4; ++i)
+				s[i] = _mm256_srli_epi16(_mm256_mullo_epi16(
+						_mm256_shuffle_epi8(load_sticks(d, stride, 2 * i), pairs), scale), 4);
+			const auto t0 = _mm256_unpacklo_epi16(s[0], s[1]);
+			const auto t1 = _mm256_unpackhi_epi16(s[0], s[1]);
+			const auto t2 = _mm256_unpacklo_epi16(s[2], s[3]);
+			const auto t3 = _mm256_unpackhi_epi16(s[2], s[3]);
+			const auto u0 = _mm256_unpacklo_epi16(t0, t1);
+			const auto u1 = _mm256_unpackhi_epi16(t0, t1);
+			const auto u2 = _mm256_unpacklo_epi16(t2, t3);
+			const auto u3 = _mm256_unpackhi_epi16(t2, t3);
+			store(out.sticks[0].data() + row, _mm256_unpacklo_epi64(u0, u2));
+			store(out.sticks[1].data() + row, _mm256_unpackhi_epi64(u0, u2));
+			store(out.sticks[2].data() + row, _mm256_unpacklo_epi64(u1, u3));
+			store(out.sticks[3].data() + row, _mm256_unpackhi_epi64(u1, u3));
+
+			for (std::size_t block = 0; block < 2; ++block) {
+				__m256i r[8];
+				for (std::size_t i = 0; i < 8; ++i)
+					r[i] = load_pair(d, stride, i, imu_offset + 16 * block);
+				transpose(r);
+				for (std::size_t c = 0; c < 8; ++c)
+					store(out.imu[8 * block + c].data() + row, r[c]);
+			}
+			for (std::size_t i = 0; i < 16; ++i) {
+				const auto* r = d + i * stride;
+				out.id[row + i] = r[0];
+				out.timer[row + i] = r[1];
+				out.buttons[row + i] = decode_buttons(r + 3);
+				for (std::size_t c = 16; c < report_columns::imu_channels; ++c) {
+					const auto* v = r + imu_offset + 2 * c;
+					out.imu[c][row + i] = static_cast<std::int16_t>(v[0] | v[1] << 8);
+				}
+			}
+		}
+		return groups * 16;
+	}
+#else
+	bool avx2_kernel_built() {
+		return false;
+	}
+
+	std::size_t decode_batch_avx2(const uchar*, std::size_t, std::size_t, report_columns&, std::size_t) {
+		return 0;
+	}
+#endif
+};
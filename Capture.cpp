@@ -0,0 +1,535 @@
+#include "Capture.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PROCON_X86 1
+#include <intrin.h>
+#endif
+// MSVC takes SSSE3 intrinsics without /arch, so the delta decoder is
+// built in and chosen at runtime, as BatchDecode's kernels are
+#if defined(PROCON_X86) && (defined(_MSC_VER) || defined(__SSSE3__))
+#define PROCON_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+namespace procon {
+	constexpr std::size_t mapped_capture::first_record;
+
+	namespace {
+		constexpr std::size_t block_header = 20;   // magic, length, time, count
+		constexpr std::size_t index_header = 20;   // magic, length, previous, count
+		constexpr std::size_t index_entry_size = 16;
+		constexpr std::size_t footer_size = 16;
+		constexpr std::size_t v1_record_header = 10; // time, length
+
+		constexpr uchar flag_delta = 1;
+		constexpr uchar flag_output = 2;
+
+		bool is_output(const uchar* data, const std::size_t size) {
+			return size != 0 && (data[0] == 0x01 || data[0] == 0x10);
+		}
+
+		template<class T>
+		void put(uchar* to, const T v) {
+			std::memcpy(to, &v, sizeof v);
+		}
+
+		template<class T>
+		T get(const uchar* from) {
+			T v;
+			std::memcpy(&v, from, sizeof v);
+			return v;
+		}
+
+#ifdef PROCON_SSSE3
+		bool detect_ssse3() {
+			int regs[4];
+			__cpuid(regs, 1);
+			return (regs[2] >> 9 & 1) != 0;
+		}
+
+		const bool has_ssse3 = detect_ssse3();
+#endif
+
+		std::size_t put_varint(uchar* to, std::uint64_t v) {
+			std::size_t n = 0;
+			for (; v >= 0x80; v >>= 7)
+				to[n++] = static_cast<uchar>(v | 0x80);
+			to[n++] = static_cast<uchar>(v);
+			return n;
+		}
+
+		// Per mask of changed bytes in an 8-byte group: where each changed
+		// byte comes from in the packed run (0x80 for unchanged bytes, which
+		// pshufb turns into zeroes) and how long the run is
+		struct expand_table {
+			std::array<std::array<uchar, 8>, 256> source;
+			std::array<uchar, 256> count;
+		};
+
+		expand_table make_expand_table() {
+			expand_table t {};
+			for (unsigned mask = 0; mask < 256; ++mask) {
+				uchar n = 0;
+				for (unsigned bit = 0; bit < 8; ++bit)
+					t.source[mask][bit] = mask >> bit & 1u ? n++ : 0x80;
+				t.count[mask] = n;
+			}
+			return t;
+		}
+
+		const expand_table expand = make_expand_table();
+
+		[[noreturn]] void corrupt(const std::string& path) {
+			throw std::runtime_error(path + " is corrupt");
+		}
+	}
+
+	bool capture_writer::open(const std::string& path) {
+		close();
+		file.reset(std::fopen(path.c_str(), "wb"));
+		if (!file)
+			return false;
+		// Only whole blocks are written, so stdio's buffer would be a copy
+		std::setvbuf(file.get(), nullptr, _IONBF, 0);
+
+		const std::uint32_t header[2] = {capture_magic, capture_version};
+		if (std::fwrite(header, sizeof header, 1, file.get()) != 1) {
+			file.reset();
+			return false;
+		}
+
+		if (!buffers)
+			buffers.reset(new uchar[(capture_queued_blocks + 1) * capture_block_bytes]);
+		if (!index_block)
+			index_block.reset(new uchar[index_header + capture_index_span * index_entry_size]);
+		if (!index)
+			index.reset(new std::array<index_entry, capture_index_span>);
+		block = buffers.get();
+		for (std::size_t i = 0; i < capture_queued_blocks; ++i)
+			spare[i] = buffers.get() + (i + 1) * capture_block_bytes;
+		spare_count = capture_queued_blocks;
+		queue_head = queue_count = 0;
+		closing = false;
+		used = block_header;
+		records = 0;
+		indexed = 0;
+		offset = sizeof header;
+		last_index = 0;
+		blocks = 0;
+		dropped_reports = 0;
+		started = false;
+		writer = std::thread([this] { drain(); });
+		return true;
+	}
+
+	void capture_writer::write(const std::uint64_t now_us, const uchar* data,
+							   const std::size_t size) {
+		if (!file)
+			return;
+		if (size > capture_max_report) {
+			++dropped_reports;
+			return;
+		}
+		if (!started) {
+			origin_us = now_us;
+			last_us = 0;
+			started = true;
+		}
+		const auto t = std::max(last_us, now_us > origin_us ? now_us - origin_us : 0);
+
+		// Flags, two varints and a delta's masks at most
+		const auto worst = 1 + 10 + 3 + size + (size + 7) / 8;
+		if (records == capture_block_records || used + worst > capture_block_bytes)
+			flush_block();
+		if (records == 0) {
+			block_us = t;
+			last_us = t;
+			reference_size = {};
+		}
+
+		const auto stream = is_output(data, size) ? 1 : 0;
+		auto& ref = reference[stream];
+		auto* p = block + used;
+		const auto delta = size != 0 && reference_size[stream] == size;
+
+		*p++ = static_cast<uchar>((delta ? flag_delta : 0) | (stream ? flag_output : 0));
+		p += put_varint(p, t - last_us);
+		p += put_varint(p, size);
+		if (delta) {
+			for (std::size_t group = 0; group < size; group += 8) {
+				auto& mask = *p++;
+				mask = 0;
+				for (auto i = group; i < std::min(size, group + 8); ++i) {
+					const auto x = static_cast<uchar>(data[i] ^ ref[i]);
+					if (x != 0) {
+						mask |= static_cast<uchar>(1u << (i - group));
+						*p++ = x;
+					}
+				}
+			}
+		} else {
+			std::memcpy(p, data, size);
+			p += size;
+		}
+		std::memcpy(ref.data(), data, size);
+		reference_size[stream] = size;
+
+		used = static_cast<std::size_t>(p - block);
+		last_us = t;
+		++records;
+	}
+
+	void capture_writer::flush_block() {
+		if (records == 0)
+			return;
+
+		put(block, capture_block_magic);
+		put(block + 4, static_cast<std::uint32_t>(used - block_header));
+		put(block + 8, block_us);
+		put(block + 16, static_cast<std::uint32_t>(records));
+		{
+			std::lock_guard<std::mutex> lk(queue_mutex);
+			if (spare_count == 0) {
+				// The disk is behind; losing this block beats stalling the caller
+				dropped_reports += records;
+			} else {
+				queue[(queue_head + queue_count++) % queue.size()] = {block, used, block_us, records};
+				block = spare[--spare_count];
+			}
+		}
+		queue_ready.notify_one();
+		records = 0;
+		used = block_header;
+	}
+
+	void capture_writer::drain() {
+		std::unique_lock<std::mutex> lk(queue_mutex);
+		for (;;) {
+			queue_ready.wait(lk, [this] { return queue_count != 0 || closing; });
+			if (queue_count == 0)
+				return;
+			const auto f = queue[queue_head];
+			queue_head = (queue_head + 1) % queue.size();
+			--queue_count;
+
+			lk.unlock();
+			write_block(f);
+			lk.lock();
+			spare[spare_count++] = f.data;
+		}
+	}
+
+	void capture_writer::write_block(const filled& f) {
+		// A short write leaves part of a block behind; the offsets after it
+		// stay true to the file, but the index must never point at it
+		const auto written = std::fwrite(f.data, 1, f.length, file.get());
+		if (written == f.length) {
+			(*index)[indexed++] = {f.time_us, offset};
+			++blocks;
+		} else {
+			dropped_reports += f.records;
+		}
+		offset += written;
+		if (indexed == capture_index_span)
+			write_index();
+	}
+
+	void capture_writer::write_index() {
+		if (indexed == 0)
+			return;
+
+		auto* b = index_block.get();
+		const auto length = index_header + indexed * index_entry_size;
+		put(b, capture_index_magic);
+		put(b + 4, static_cast<std::uint32_t>(length - 8));
+		put(b + 8, last_index);
+		put(b + 16, static_cast<std::uint32_t>(indexed));
+		for (std::size_t i = 0; i < indexed; ++i) {
+			put(b + index_header + i * index_entry_size, (*index)[i].time_us);
+			put(b + index_header + i * index_entry_size + 8, (*index)[i].offset);
+		}
+		const auto written = std::fwrite(b, 1, length, file.get());
+		if (written == length)
+			last_index = offset;
+		else
+			blocks -= static_cast<std::uint32_t>(indexed); // the footer only counts what it can reach
+		offset += written;
+		indexed = 0;
+	}
+
+	void capture_writer::close() {
+		if (!file)
+			return;
+
+		flush_block();
+		{
+			std::lock_guard<std::mutex> lk(queue_mutex);
+			closing = true;
+		}
+		queue_ready.notify_one();
+		writer.join();
+
+		write_index();
+		uchar footer[footer_size];
+		put(footer, last_index);
+		put(footer + 8, blocks);
+		put(footer + 12, capture_footer_magic);
+		std::fwrite(footer, 1, sizeof footer, file.get());
+		file.reset();
+	}
+
+	std::vector<captured_report> read_capture(const std::string& path) {
+		const mapped_capture capture(path);
+		capture_cursor cursor(capture);
+		std::vector<captured_report> reports;
+
+		capture_record r;
+		while (cursor.next(r))
+			reports.push_back({r.time_us, std::vector<uchar>(r.data, r.data + r.size)});
+		return reports;
+	}
+
+	mapped_capture::mapped_capture(const std::string& path) : name(path) {
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+						   FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("can't open " + path);
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(first_record)) {
+			close();
+			throw std::runtime_error(path + " is not a capture");
+		}
+		length = static_cast<std::size_t>(size.QuadPart);
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+			view = static_cast<const uchar*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (view == nullptr) {
+			close();
+			throw std::runtime_error("can't map " + path);
+		}
+
+		format = get<std::uint32_t>(view + 4);
+		if (get<std::uint32_t>(view) != capture_magic) {
+			close();
+			throw std::runtime_error(path + " is not a capture");
+		}
+		if (format != 1 && format != 2) {
+			close();
+			throw std::runtime_error(path + " has an unsupported capture version");
+		}
+		if (format == 2)
+			load_index();
+	}
+
+	void mapped_capture::load_index() {
+		// From the footer's chain of indexes, newest first
+		const auto from_footer = [this] {
+			if (length < first_record + footer_size)
+				return false;
+			const auto* footer = view + length - footer_size;
+			if (get<std::uint32_t>(footer + 12) != capture_footer_magic)
+				return false;
+
+			std::vector<std::vector<block_entry>> chunks;
+			auto at = get<std::uint64_t>(footer);
+			std::size_t total = 0;
+			while (at != 0) {
+				if (at < first_record || at > length - footer_size - index_header
+						|| get<std::uint32_t>(view + at) != capture_index_magic)
+					return false;
+				const auto count = get<std::uint32_t>(view + at + 16);
+				if (count > (length - at - index_header) / index_entry_size)
+					return false;
+
+				chunks.emplace_back(count);
+				for (std::size_t i = 0; i < count; ++i) {
+					const auto* e = view + at + index_header + i * index_entry_size;
+					chunks.back()[i] = {get<std::uint64_t>(e), get<std::uint64_t>(e + 8)};
+				}
+				total += count;
+				at = get<std::uint64_t>(view + at + 8);
+			}
+			if (total != get<std::uint32_t>(footer + 8))
+				return false;
+
+			index.reserve(total);
+			for (auto c = chunks.rbegin(); c != chunks.rend(); ++c)
+				index.insert(index.end(), c->begin(), c->end());
+			return true;
+		};
+		if (from_footer())
+			return;
+
+		// A capture that was never closed: every whole block, in order
+		index.clear();
+		auto at = first_record;
+		while (length - at >= block_header) {
+			const auto magic = get<std::uint32_t>(view + at);
+			const auto payload = get<std::uint32_t>(view + at + 4);
+			if (magic == capture_block_magic) {
+				if (payload > length - at - block_header)
+					break;
+				index.push_back({get<std::uint64_t>(view + at + 8), at});
+				at += block_header + payload;
+			} else if (magic == capture_index_magic && payload <= length - at - 8) {
+				at += 8 + payload;
+			} else {
+				break;
+			}
+		}
+	}
+
+	void mapped_capture::close() {
+		if (view != nullptr)
+			UnmapViewOfFile(view);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		view = nullptr;
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+	}
+
+	capture_cursor::capture_cursor(const mapped_capture& c)
+			: capture(c), offset(c.version() == 1 ? mapped_capture::first_record : 0) {}
+
+	bool capture_cursor::next_block() {
+		const auto& blocks = capture.blocks();
+		if (block == blocks.size())
+			return false;
+
+		const auto at = static_cast<std::size_t>(blocks[block++].offset);
+		const auto* view = capture.data();
+		if (at > capture.size() - block_header || get<std::uint32_t>(view + at) != capture_block_magic)
+			corrupt(capture.path());
+		const auto payload = get<std::uint32_t>(view + at + 4);
+		if (payload > capture.size() - at - block_header)
+			corrupt(capture.path());
+
+		time_us = get<std::uint64_t>(view + at + 8);
+		offset = at + block_header;
+		block_end = offset + payload;
+		reference_size = {};
+		return true;
+	}
+
+	bool capture_cursor::next(capture_record& out) {
+		const auto* view = capture.data();
+
+		if (capture.version() == 1) {
+			if (offset >= capture.size())
+				return false;
+			if (capture.size() - offset < v1_record_header)
+				throw std::runtime_error(capture.path() + " is truncated");
+			out.time_us = get<std::uint64_t>(view + offset);
+			out.size = get<std::uint16_t>(view + offset + 8);
+			if (capture.size() - offset - v1_record_header < out.size)
+				throw std::runtime_error(capture.path() + " is truncated");
+			out.data = view + offset + v1_record_header;
+			offset += v1_record_header + out.size;
+			return true;
+		}
+
+		while (offset == block_end)
+			if (!next_block())
+				return false;
+
+		const auto varint = [&] {
+			std::uint64_t v = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				if (offset == block_end)
+					corrupt(capture.path());
+				const auto b = view[offset++];
+				v |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+				if (b < 0x80)
+					return v;
+			}
+			corrupt(capture.path());
+		};
+
+		const auto flags = view[offset++];
+		time_us += varint();
+		const auto size = varint();
+		const auto stream = flags & flag_output ? 1 : 0;
+		auto& ref = reference[stream];
+		if (size > capture_max_report)
+			corrupt(capture.path());
+
+		if (flags & flag_delta) {
+			if (reference_size[stream] != size)
+				corrupt(capture.path());
+			const auto* src = view + offset;
+			const auto available = block_end - offset;
+			std::size_t n = 0;
+
+			for (std::size_t group = 0; group < size; group += 8) {
+				if (n == available)
+					corrupt(capture.path());
+				const auto mask = src[n++];
+				if (mask == 0)
+					continue;
+				const auto count = expand.count[mask];
+				if (count > available - n)
+					corrupt(capture.path());
+				auto* to = ref.data() + group;
+#ifdef PROCON_SSSE3
+				// Eight bytes can be loaded unless the block ends within
+				// them; the shuffle drops what isn't this group's
+				if (has_ssse3 && available - n >= 8) {
+					const auto packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + n));
+					const auto spread = _mm_shuffle_epi8(packed,
+						_mm_loadl_epi64(reinterpret_cast<const __m128i*>(expand.source[mask].data())));
+					const auto previous = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(to));
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(to), _mm_xor_si128(previous, spread));
+					n += count;
+					continue;
+				}
+#endif
+				if (mask == 0xFF) {
+					const auto x = get<std::uint64_t>(to) ^ get<std::uint64_t>(src + n);
+					put(to, x);
+					n += 8;
+					continue;
+				}
+				const auto& source = expand.source[mask];
+				for (std::size_t i = 0; i < 8; ++i)
+					if (source[i] != 0x80)
+						to[i] ^= src[n + source[i]];
+				n += count;
+			}
+			offset += n;
+		} else {
+			if (size > block_end - offset)
+				corrupt(capture.path());
+			std::memcpy(ref.data(), view + offset, static_cast<std::size_t>(size));
+			offset += static_cast<std::size_t>(size);
+		}
+		reference_size[stream] = static_cast<std::size_t>(size);
+
+		out.time_us = time_us;
+		out.data = ref.data();
+		out.size = static_cast<std::size_t>(size);
+		return true;
+	}
+
+	void capture_cursor::seek(const std::uint64_t at_us) {
+		if (capture.version() == 1) {
+			offset = mapped_capture::first_record;
+			return;
+		}
+
+		// The last block starting at or before 'at_us'
+		const auto& blocks = capture.blocks();
+		const auto it = std::upper_bound(blocks.begin(), blocks.end(), at_us,
+			[](const std::uint64_t t, const mapped_capture::block_entry& b) { return t < b.time_us; });
+		block = it == blocks.begin() ? 0 : static_cast<std::size_t>(it - blocks.begin() - 1);
+		offset = block_end = 0;
+	}
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include "Common.hpp"
+
+namespace procon {
+	// Raw reports as read from and written to the device, with the time of
+	// each as a microsecond offset from the first one. Output reports (0x01,
+	// 0x10) share no IDs with input reports, so they sit in the same stream.
+	//
+	// Version 1: magic, version, then per report its time (u64), length
+	// (u16) and bytes (report ID first).
+	//
+	// Version 2 stores each report as the bytes that changed since the
+	// previous one in its direction (input or output), in blocks:
+	//   header     magic, version
+	//   block      "PCRB", payload length (u32), time of its first record
+	//              (u64), record count (u32), records
+	//   record     flags (u8), time since the previous record (varint),
+	//              length (varint), then the bytes as they are or, for a
+	//              delta, per 8-byte group a mask of changed bytes and
+	//              those bytes XORed with the previous report's
+	//   index      "PCRI", payload length (u32), offset of the previous
+	//              index (u64, 0 for none), entry count (u32), then per
+	//              block its first record's time (u64) and offset (u64)
+	//   footer     offset of the last index (u64), block count (u32), "PCRF"
+	// Every block starts its references over, so each is a keyframe a
+	// reader can start from. An index follows every capture_index_span
+	// blocks and the footer ends the file; a capture cut short without
+	// them is still read block by block.
+	constexpr std::uint32_t capture_magic = 0x43524350;  // "PCRC"
+	constexpr std::uint32_t capture_version = 2;
+	constexpr std::uint32_t capture_block_magic = 0x42524350;  // "PCRB"
+	constexpr std::uint32_t capture_index_magic = 0x49524350;  // "PCRI"
+	constexpr std::uint32_t capture_footer_magic = 0x46524350; // "PCRF"
+	constexpr std::size_t capture_max_report = 1024; // longer reports aren't recorded
+	constexpr std::size_t capture_block_records = 256;
+	constexpr std::size_t capture_block_bytes = 16384;
+	constexpr std::size_t capture_index_span = 256;
+	constexpr std::size_t capture_queued_blocks = 4; // finished, awaiting the disk
+
+	struct captured_report {
+		std::uint64_t time_us;
+		std::vector<uchar> data;
+	};
+
+	// Writes version 2 captures. All memory is taken by open(). write()
+	// only encodes into a block buffer; whole blocks go to a thread of the
+	// writer's own, which does the file I/O, so a slow disk never holds up
+	// the caller. If that thread falls capture_queued_blocks behind, blocks
+	// are dropped (and counted) rather than waited for. write() and close()
+	// are for one thread, such as the I/O thread.
+	class capture_writer {
+		struct closer {
+			void operator()(std::FILE* f) const { std::fclose(f); }
+		};
+
+		struct index_entry {
+			std::uint64_t time_us;
+			std::uint64_t offset;
+		};
+
+		// A finished block waiting for the writer thread
+		struct filled {
+			uchar* data;
+			std::size_t length;
+			std::uint64_t time_us;
+			std::size_t records;
+		};
+
+		std::unique_ptr<std::FILE, closer> file;
+		std::unique_ptr<uchar[]> buffers; // capture_queued_blocks + 1 blocks
+		std::unique_ptr<uchar[]> index_block;
+		std::unique_ptr<std::array<index_entry, capture_index_span>> index;
+
+		// Caller's side
+		uchar* block {nullptr}; // being filled
+		std::array<std::array<uchar, capture_max_report>, 2> reference; // input, output
+		std::array<std::size_t, 2> reference_size {};
+		std::size_t used {0};     // bytes of block filled, header included
+		std::size_t records {0};  // in the block
+		std::uint64_t origin_us {0};
+		std::uint64_t block_us {0};
+		std::uint64_t last_us {0};
+		bool started {false};
+
+		// Handed between the two under queue_mutex
+		std::mutex queue_mutex;
+		std::condition_variable queue_ready;
+		std::array<filled, capture_queued_blocks> queue;
+		std::size_t queue_head {0};
+		std::size_t queue_count {0};
+		std::array<uchar*, capture_queued_blocks> spare;
+		std::size_t spare_count {0};
+		bool closing {false};
+		std::thread writer;
+
+		// Writer thread's side, and close()'s once it has joined
+		std::size_t indexed {0};  // entries in 'index'
+		std::uint64_t offset {0}; // of the next block in the file
+		std::uint64_t last_index {0};
+		std::uint32_t blocks {0};
+
+		std::atomic<std::uint64_t> dropped_reports {0};
+
+		void flush_block();
+		void drain();
+		void write_block(const filled& f);
+		void write_index();
+	public:
+		capture_writer() = default;
+		capture_writer(const capture_writer&) = delete;
+		capture_writer& operator=(const capture_writer&) = delete;
+		~capture_writer() { close(); }
+
+		// False if the file can't be created
+		bool open(const std::string& path);
+		bool is_open() const { return file != nullptr; }
+
+		void write(std::uint64_t now_us, const uchar* data, std::size_t size);
+
+		// Waits for the queued blocks, then writes the index and the footer
+		void close();
+
+		// Reports over capture_max_report bytes, lost to write errors, or
+		// in blocks dropped while the writer thread was behind
+		std::uint64_t dropped() const { return dropped_reports; }
+	};
+
+	// Throws std::runtime_error on a missing or malformed file
+	std::vector<captured_report> read_capture(const std::string& path);
+
+	// One record of a mapped capture. 'data' stays valid until the cursor
+	// that returned it moves on.
+	struct capture_record {
+		std::uint64_t time_us;
+		const uchar* data;
+		std::size_t size;
+	};
+
+	// A capture file of either version mapped read-only, so a pass over it
+	// costs no reads or copies however long the session was. Throws
+	// std::runtime_error like read_capture.
+	class mapped_capture {
+	public:
+		struct block_entry {
+			std::uint64_t time_us;
+			std::uint64_t offset;
+		};
+
+	private:
+		HANDLE file {INVALID_HANDLE_VALUE};
+		HANDLE mapping {nullptr};
+		const uchar* view {nullptr};
+		std::size_t length {0};
+		std::uint32_t format {0};
+		std::vector<block_entry> index; // version 2
+		std::string name;
+
+		void close();
+		void load_index();
+	public:
+		explicit mapped_capture(const std::string& path);
+		~mapped_capture() { close(); }
+		mapped_capture(const mapped_capture&) = delete;
+		mapped_capture& operator=(const mapped_capture&) = delete;
+
+		static constexpr std::size_t first_record = 8; // past magic and version
+
+		const uchar* data() const { return view; }
+		std::size_t size() const { return length; }
+		std::uint32_t version() const { return format; }
+		const std::vector<block_entry>& blocks() const { return index; }
+		const std::string& path() const { return name; }
+	};
+
+	// Reads a mapped capture's records in order. Version 1 records point
+	// into the mapping; version 2 records are rebuilt into the cursor.
+	class capture_cursor {
+		const mapped_capture& capture;
+		std::size_t offset;
+		std::size_t block_end {0}; // version 2: end of the current block
+		std::size_t block {0};     // version 2: index of the next block
+		std::uint64_t time_us {0};
+		// Padded so whole 8-byte groups can be written past a report's end
+		std::array<std::array<uchar, capture_max_report + 16>, 2> reference;
+		std::array<std::size_t, 2> reference_size {};
+
+		bool next_block();
+	public:
+		explicit capture_cursor(const mapped_capture& c);
+
+		// False at the end; throws if the file is truncated or corrupt
+		bool next(capture_record& out);
+
+		// Moves back or ahead to the keyframe at or before 'at_us': the
+		// start of the block holding it, or of a version 1 file. Records
+		// before 'at_us' are still returned.
+		void seek(std::uint64_t at_us);
+	};
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace procon {
+	// Monotonic timestamps used to stamp reports as they arrive. Millisecond
+	// values wrap after ~49 days; always compare them by subtraction.
+	inline std::uint64_t clock_us() {
+		using namespace std::chrono;
+		return static_cast<std::uint64_t>(duration_cast<microseconds>(
+				steady_clock::now().time_since_epoch()).count());
+	}
+
+	inline std::uint32_t clock_ms() {
+		return static_cast<std::uint32_t>(clock_us() / 1000);
+	}
+};
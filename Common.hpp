@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <array>
 #include <string>
+#include <cstdint>
 
 namespace procon {
 	using uchar = unsigned char;
@@ -47,6 +48,23 @@ namespace procon {
 		capture,
 	};
 
+	// Set of pressed buttons, one bit per button (button::none has no bit)
+	using button_mask = std::uint32_t;
+
+	constexpr std::size_t button_count = static_cast<std::size_t>(button::capture);
+
+	constexpr button_mask mask_of(button b) {
+		return b == button::none ? 0 : 1u << (static_cast<unsigned>(b) - 1);
+	}
+
+	constexpr std::size_t button_index(button b) {
+		return static_cast<std::size_t>(b) - 1;
+	}
+
+	constexpr button bit_to_button(unsigned bit) {
+		return static_cast<button>(bit + 1);
+	}
+
 	const std::array<button, 8> joycon_l_bitmap =
 	{
 		button::d_pad_down,
@@ -0,0 +1,286 @@
+#include "Controller.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include "Capture.hpp"
+#include "Clock.hpp"
+#include "Profile.hpp"
+#include "Trace.hpp"
+
+namespace procon {
+	namespace {
+		using xinput_table = std::array<WORD, button_count>;
+
+		xinput_table make_table(const bool positional) {
+			xinput_table t {};
+
+			t[button_index(button::d_pad_up)] = XINPUT_GAMEPAD_DPAD_UP;
+			t[button_index(button::d_pad_down)] = XINPUT_GAMEPAD_DPAD_DOWN;
+			t[button_index(button::d_pad_left)] = XINPUT_GAMEPAD_DPAD_LEFT;
+			t[button_index(button::d_pad_right)] = XINPUT_GAMEPAD_DPAD_RIGHT;
+			t[button_index(button::plus)] = XINPUT_GAMEPAD_START;
+			t[button_index(button::minus)] = XINPUT_GAMEPAD_BACK;
+			t[button_index(button::left_stick)] = XINPUT_GAMEPAD_LEFT_THUMB;
+			t[button_index(button::right_stick)] = XINPUT_GAMEPAD_RIGHT_THUMB;
+			t[button_index(button::l)] = XINPUT_GAMEPAD_LEFT_SHOULDER;
+			t[button_index(button::r)] = XINPUT_GAMEPAD_RIGHT_SHOULDER;
+			t[button_index(button::home)] = 0x0400; // guide
+
+			if (positional) {
+				t[button_index(button::b)] = XINPUT_GAMEPAD_A;
+				t[button_index(button::a)] = XINPUT_GAMEPAD_B;
+				t[button_index(button::y)] = XINPUT_GAMEPAD_X;
+				t[button_index(button::x)] = XINPUT_GAMEPAD_Y;
+			} else {
+				t[button_index(button::a)] = XINPUT_GAMEPAD_A;
+				t[button_index(button::b)] = XINPUT_GAMEPAD_B;
+				t[button_index(button::x)] = XINPUT_GAMEPAD_X;
+				t[button_index(button::y)] = XINPUT_GAMEPAD_Y;
+			}
+			return t;
+		}
+
+		// The same, a byte of the button mask at a time, so mapping is three
+		// loads instead of a branch per button
+		using byte_tables = std::array<std::array<WORD, 256>, (button_count + 7) / 8>;
+
+		byte_tables make_byte_tables(const xinput_table& t) {
+			byte_tables out {};
+			for (std::size_t byte = 0; byte < out.size(); ++byte)
+				for (unsigned v = 0; v < 256; ++v)
+					for (std::size_t bit = 0; bit < 8 && byte * 8 + bit < button_count; ++bit)
+						if (v >> bit & 1u)
+							out[byte][v] |= t[byte * 8 + bit];
+			return out;
+		}
+
+		const byte_tables label_buttons = make_byte_tables(make_table(false));
+		const byte_tables positional_buttons = make_byte_tables(make_table(true));
+
+		// 12-bit travel centred on 2048 to the full signed range
+		SHORT stick(const std::uint16_t v) {
+			const auto scaled = (static_cast<int>(v) - 2048) * 16;
+			return static_cast<SHORT>(std::max(-32767, std::min(32767, scaled)));
+		}
+	}
+
+	WORD map_buttons(const button_mask buttons, const bool positional) {
+		const auto& table = positional ? positional_buttons : label_buttons;
+		WORD out = 0;
+
+		for (std::size_t byte = 0; byte < table.size(); ++byte)
+			out |= table[byte][buttons >> byte * 8 & 0xFF];
+		return out;
+	}
+
+	void map_report(const input_report& r, const bool positional, XINPUT_GAMEPAD& pad) {
+		pad.wButtons = map_buttons(r.buttons, positional);
+		pad.sThumbLX = stick(r.lx);
+		pad.sThumbLY = stick(r.ly);
+		pad.sThumbRX = stick(r.rx);
+		pad.sThumbRY = stick(r.ry);
+	}
+
+	controller::controller(std::unique_ptr<transport> d, backend& b, const unsigned backend_index)
+			: device(std::move(d)), output(b), index(backend_index) {}
+
+	void controller::set_rumble_limit(const BYTE limit) {
+		rumble_limit = limit;
+		if (table != nullptr)
+			table->set_rumble_limit(seat, limit);
+	}
+
+	void controller::attach(pad_table& t) {
+		table = &t;
+		seat = t.add(curves, rumble_limit);
+	}
+
+	void controller::load(const profile& p) {
+		positional = p.positional;
+		curves.bake(p);
+	}
+
+	void controller::feed(const uchar* data, const std::size_t size, const std::uint64_t now_us) {
+		input_report decoded;
+
+		if (recorder != nullptr)
+			recorder->write(now_us, data, size);
+		if (!decode(data, size, decoded))
+			return;
+		trace::emit(trace::event::report_decoded, decoded.id << 8 | decoded.timer);
+		// Simple reports carry no timer to track the link with
+		if (decoded.id != static_cast<uchar>(report_mode::simple))
+			link.report(decoded.timer, now_us);
+		if (motion.enabled())
+			motion.add(decoded, now_us);
+		report = decoded;
+		report_us = now_us;
+		fresh = true;
+	}
+
+	void controller::submit(const input_report& r, const std::uint64_t at_us) {
+		const auto now_ms = static_cast<std::uint32_t>(at_us / 1000);
+		if (table != nullptr) {
+			table->stage(seat, r,
+						 curves.ramp_trigger(0, (r.buttons & mask_of(button::zl)) != 0, now_ms),
+						 curves.ramp_trigger(1, (r.buttons & mask_of(button::zr)) != 0, now_ms));
+			staged_us = at_us;
+			return;
+		}
+
+		map_report(r, positional, pad);
+		curves.apply_sticks(pad);
+		pad.bLeftTrigger = curves.digital_trigger(0, (r.buttons & mask_of(button::zl)) != 0, now_ms);
+		pad.bRightTrigger = curves.digital_trigger(1, (r.buttons & mask_of(button::zr)) != 0, now_ms);
+		if (hook)
+			hook(*this, pad, now_ms);
+
+		output.submit(index, pad);
+		trace::emit(trace::event::submitted, pad.wButtons);
+	}
+
+	void controller::submit() {
+		if (!fresh)
+			return;
+		fresh = false;
+		submit(report, report_us);
+	}
+
+	void controller::finish() {
+		if (table == nullptr || !table->is_staged(seat))
+			return;
+		table->clear(seat);
+
+		const auto now_ms = static_cast<std::uint32_t>(staged_us / 1000);
+		pad.wButtons = map_buttons(table->pressed(seat), positional);
+		pad.sThumbLX = table->axis(seat, 0);
+		pad.sThumbLY = table->axis(seat, 1);
+		pad.sThumbRX = table->axis(seat, 2);
+		pad.sThumbRY = table->axis(seat, 3);
+		pad.bLeftTrigger = table->trigger(seat, 0);
+		pad.bRightTrigger = table->trigger(seat, 1);
+		if (hook)
+			hook(*this, pad, now_ms);
+
+		output.submit(index, pad);
+		trace::emit(trace::event::submitted, pad.wButtons);
+	}
+
+	void controller::pace(const std::uint64_t now_us) {
+		if (!motion.enabled() || failed || now_us < next_output_us)
+			return;
+
+		// Slots stay on one grid unless a whole period was missed
+		const auto period = motion.period_us();
+		next_output_us = now_us - next_output_us < period ? next_output_us + period : now_us + period;
+
+		input_report r;
+		if (motion.sample(now_us, r))
+			submit(r, now_us);
+	}
+
+	int controller::service() {
+		constexpr std::size_t batch = 16;
+		uchar buf[batch][64];
+		std::size_t sizes[batch];
+		auto read = 0;
+		int n;
+
+		// Every queued report is decoded, so link stats see each one; only
+		// the newest is mapped and submitted
+		do {
+			n = device->read_many(buf[0], sizeof buf[0], sizes, batch);
+			if (n < 0) {
+				on_error(static_cast<DWORD>(n));
+				return -1;
+			}
+
+			const auto now = clock_us();
+			for (auto i = 0; i < n; ++i) {
+				trace::emit(trace::event::report_received, static_cast<std::uint32_t>(sizes[i]));
+				feed(buf[i], sizes[i], now);
+			}
+			read += n;
+		} while (n == static_cast<int>(batch));
+
+		if (motion.enabled())
+			pace(clock_us());
+		else
+			submit();
+		return read;
+	}
+
+	void controller::send(const uchar* data, const std::size_t size) {
+		device->write(data, size);
+		if (recorder != nullptr)
+			recorder->write(clock_us(), data, size);
+	}
+
+	void controller::stage_feedback(const pad_feedback& f) {
+		if (table != nullptr)
+			table->set_motors(seat, f.large_motor, f.small_motor);
+	}
+
+	void controller::apply_feedback(const pad_feedback& f) {
+		if (failed)
+			return;
+
+		if (f.led != led) {
+			// Player LED subcommand, carrying the rumble already playing
+			led = f.led;
+			std::array<uchar, 12> buf {{0x01, static_cast<uchar>(counter++ & 0x0F)}};
+			std::copy(rumble.begin(), rumble.end(), buf.begin() + 2);
+			buf[10] = 0x30;
+			buf[11] = static_cast<uchar>(1 << (led & 3));
+			send(buf.data(), buf.size());
+		}
+
+		if (!f.vibrate)
+			return;
+
+		const auto large = table != nullptr ? table->motor(seat, 0)
+				: static_cast<uchar>(f.large_motor * rumble_limit / 255);
+		const auto small = table != nullptr ? table->motor(seat, 1)
+				: static_cast<uchar>(f.small_motor * rumble_limit / 255);
+		std::array<uchar, 10> buf {{0x10, static_cast<uchar>(counter++ & 0x0F),
+									0x08, large, 0x40, 0x40, 0x08, large, 0x40, 0x40}};
+		send(buf.data(), buf.size());
+
+		buf[1] = static_cast<uchar>(counter++ & 0x0F);
+		buf[2] = 0x10;
+		buf[3] = small;
+		buf[6] = 0x10;
+		buf[7] = small;
+		send(buf.data(), buf.size());
+		std::copy(buf.begin() + 2, buf.end(), rumble.begin());
+		trace::emit(trace::event::rumble_sent, 0x10u << 8 | buf[1]);
+	}
+
+	void controller::on_report(const uchar* data, const std::size_t size, const std::uint64_t now_us) {
+		feed(data, size, now_us);
+	}
+
+	void controller::on_batch_end(std::uint64_t) {
+		if (!motion.enabled())
+			submit();
+	}
+
+	void controller::on_error(DWORD) {
+		failed = true;
+		trace::emit(trace::event::error, index);
+	}
+
+	const std::string& button_to_string(const button b) {
+		static const std::array<std::string, button_count + 1> names = {
+			"none", "d_pad_up", "d_pad_down", "d_pad_right", "d_pad_left",
+			"a", "b", "x", "y", "plus", "minus", "l", "zl", "r", "zr",
+			"left_stick", "right_stick", "home", "capture",
+		};
+		return names[static_cast<std::size_t>(b)];
+	}
+
+	unsigned char operator ""_uc(const unsigned long long t) {
+		return static_cast<unsigned char>(t);
+	}
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+#include "Backend.hpp"
+#include "Curve.hpp"
+#include "LinkStats.hpp"
+#include "PadTable.hpp"
+#include "Reactor.hpp"
+#include "Report.hpp"
+#include "Resample.hpp"
+#include "Transport.hpp"
+
+namespace procon {
+	class capture_writer;
+	struct profile;
+
+	// Buttons and sticks of a decoded report as an XInput pad. 'positional'
+	// maps the face buttons by where they sit rather than by their labels.
+	// Triggers are left alone: ZL and ZR are digital and need a ramp.
+	void map_report(const input_report& r, bool positional, XINPUT_GAMEPAD& pad);
+	WORD map_buttons(button_mask buttons, bool positional);
+
+	// One physical controller and the virtual pad it drives: takes reports
+	// from its transport (or a reactor), maps the newest and submits it to
+	// the backend
+	class controller : public report_handler {
+	public:
+		// Runs on every mapped pad right before it's submitted
+		using map_hook = std::function<void(controller&, XINPUT_GAMEPAD&, std::uint32_t now_ms)>;
+
+	private:
+		std::unique_ptr<transport> device;
+		backend& output;
+		unsigned index;
+		map_hook hook;
+		capture_writer* recorder {nullptr};
+
+		report_decoder decode {decode_report};
+		link_monitor link;
+		response_curves curves;
+		resampler motion;
+		bool positional {false};
+		pad_table* table {nullptr};
+		pad_table::slot_id seat {0};
+
+		input_report report {};
+		std::uint64_t report_us {0};
+		std::uint64_t next_output_us {0};
+		std::uint64_t staged_us {0};
+		bool fresh {false};
+		bool failed {false};
+		XINPUT_GAMEPAD pad {};
+
+		// Output report state
+		std::uint8_t counter {0};
+		std::array<uchar, 8> rumble {{0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40}};
+		BYTE led {0xFF};
+		BYTE rumble_limit {255};
+
+		void submit(const input_report& r, std::uint64_t at_us);
+		void send(const uchar* data, std::size_t size);
+	public:
+		controller(std::unique_ptr<transport> d, backend& b, unsigned backend_index);
+		controller(const controller&) = delete;
+		controller& operator=(const controller&) = delete;
+
+		void load(const profile& p);
+		void set_hook(map_hook h) { hook = std::move(h); }
+		// Records every report read and written, on the thread that reads
+		// them; 'w' must outlive the controller
+		void set_recorder(capture_writer* w) { recorder = w; }
+		// Once the connection's report mode is known; until then any
+		// report type is taken
+		void set_decoder(const report_decoder d) { decode = d; }
+		// Scales rumble sent to the controller, 255 = full strength
+		void set_rumble_limit(BYTE limit);
+		// With resampling on, reports no longer submit the pad; pace() does,
+		// on the configured cadence
+		void set_resampling(const resample_config& c) { motion = resampler(c); }
+
+		// Decodes one report and keeps it if it's the newest
+		void feed(const uchar* data, std::size_t size, std::uint64_t now_us);
+
+		// From now on submit() only stages reports in 't'; finish() maps and
+		// submits them once the table has been processed. Lets a rig run the
+		// per-frame arithmetic for every controller at once.
+		void attach(pad_table& t);
+
+		// Maps and submits the newest report, if one arrived since last time
+		void submit();
+
+		// Attached: submits what the processed table holds for this
+		// controller, if a report was staged since last time
+		void finish();
+
+		// With resampling on: submits the pad resampled to 'now_us' if an
+		// output slot has come up. Call at least once per output period.
+		void pace(std::uint64_t now_us);
+
+		// Reads everything queued and submits the newest (or paces, with
+		// resampling on; or stages it, attached). Returns the number of
+		// reports read, -1 if the device failed.
+		int service();
+
+		// Attached: puts the motor levels in the table, for its
+		// scale_motors() to limit before apply_feedback()
+		void stage_feedback(const pad_feedback& f);
+
+		// Forwards what the host wants (player LED, rumble) to the controller
+		void apply_feedback(const pad_feedback& f);
+
+		void on_report(const uchar* data, std::size_t size, std::uint64_t now_us) override;
+		void on_batch_end(std::uint64_t now_us) override;
+		void on_error(DWORD error) override;
+
+		transport& io() { return *device; }
+		bool connected() const { return !failed; }
+		unsigned slot() const { return index; }
+		const input_report& last_report() const { return report; }
+		std::uint64_t last_report_us() const { return report_us; }
+		const XINPUT_GAMEPAD& last_pad() const { return pad; }
+		const link_stats& stats() const { return link.stats(); }
+	};
+};
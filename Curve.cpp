@@ -0,0 +1,95 @@
+#include "Curve.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Profile.hpp"
+
+namespace procon {
+	double shape(const curve& c, const double travel) {
+		if (c.deadzone < 0 || c.outer > 1 || c.deadzone >= c.outer)
+			throw std::invalid_argument("curve needs 0 <= deadzone < outer <= 1");
+		if (c.anti_deadzone < 0 || c.anti_deadzone >= 1)
+			throw std::invalid_argument("curve needs 0 <= anti_deadzone < 1");
+		if (c.exponent <= 0)
+			throw std::invalid_argument("curve exponent must be positive");
+
+		if (travel <= c.deadzone)
+			return 0;
+
+		const auto t = std::min(1.0, (travel - c.deadzone) / (c.outer - c.deadzone));
+		double shaped;
+
+		if (c.points.empty()) {
+			shaped = std::pow(t, c.exponent);
+		} else {
+			auto prev = std::make_pair(0.0, 0.0);
+
+			shaped = 1;
+			for (std::size_t i = 0; i <= c.points.size(); ++i) {
+				const auto next = i < c.points.size() ? c.points[i]
+													  : std::make_pair(1.0, 1.0);
+
+				if (next.first < prev.first || next.first > 1
+				 || (next.first == prev.first && i > 0))
+					throw std::invalid_argument("curve points must increase within [0, 1]");
+				if (t <= next.first) {
+					const auto span = next.first - prev.first;
+					shaped = span > 0
+						? prev.second + (next.second - prev.second) * (t - prev.first) / span
+						: next.second;
+					break;
+				}
+				prev = next;
+			}
+			shaped = std::min(1.0, std::max(0.0, shaped));
+		}
+
+		return c.anti_deadzone + (1 - c.anti_deadzone) * shaped;
+	}
+
+	void axis_table::bake(const curve& c) {
+		for (std::size_t i = 0; i < lut.size(); ++i) {
+			const auto travel = std::min(1.0, i / 4095.0);
+			lut[i] = static_cast<std::int16_t>(std::lround(shape(c, travel) * 32767));
+		}
+	}
+
+	void trigger_table::bake(const curve& c) {
+		for (std::size_t i = 0; i < lut.size(); ++i)
+			lut[i] = static_cast<BYTE>(std::lround(shape(c, i / 255.0) * 255));
+	}
+
+	void trigger_ramper::bake(const trigger_ramp& r) {
+		const auto per_ms = [](const std::uint16_t ms) -> std::uint32_t {
+			return ms == 0 ? 0 : std::max<std::uint32_t>(1, (255u << 8) / ms);
+		};
+
+		rise = per_ms(r.press_ms);
+		fall = per_ms(r.release_ms);
+	}
+
+	BYTE trigger_ramper::update(const bool down, const std::uint32_t now_ms) {
+		// Cap the step so a long gap between reports can't overflow
+		const auto elapsed = std::min<std::uint32_t>(now_ms - last_ms, 1000);
+
+		last_ms = now_ms;
+		if (down)
+			level = rise == 0 ? 255u << 8
+				: std::min<std::uint32_t>(255u << 8, level + elapsed * rise);
+		else
+			level = fall == 0 || level <= elapsed * fall ? 0 : level - elapsed * fall;
+
+		return static_cast<BYTE>(level >> 8);
+	}
+
+	void response_curves::bake(const profile& p) {
+		for (std::size_t i = 0; i < sticks.size(); ++i)
+			sticks[i].bake(p.sticks[i]);
+		for (std::size_t i = 0; i < triggers.size(); ++i) {
+			triggers[i].bake(p.triggers[i]);
+			ramps[i].bake(p.trigger_ramps[i]);
+		}
+	}
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+namespace procon {
+	struct profile;
+
+	// Shape of one axis or trigger, on travel normalized to [0, 1]. Sticks
+	// are shaped by magnitude, so both directions share the curve.
+	struct curve {
+		double deadzone {0};      // travel ignored around rest
+		double outer {1};         // travel at which output saturates
+		double anti_deadzone {0}; // output the instant travel leaves the deadzone
+		double exponent {1};      // 1 = linear, >1 = finer control near rest
+		// Custom (travel, output) points, strictly increasing in travel, used
+		// instead of 'exponent' when present. Missing ends pin to (0,0), (1,1).
+		std::vector<std::pair<double, double>> points;
+	};
+
+	// How long a digital trigger takes to travel fully in each direction,
+	// 0 = instant
+	struct trigger_ramp {
+		std::uint16_t press_ms {0};
+		std::uint16_t release_ms {0};
+	};
+
+	// Evaluates a curve at 'travel'; throws std::invalid_argument on a curve
+	// that can't be evaluated
+	double shape(const curve& c, double travel);
+
+	// A stick curve baked over the controller's 12-bit travel, which is all
+	// the resolution the sticks have
+	class axis_table {
+		std::array<std::int16_t, 4097> lut;
+	public:
+		void bake(const curve& c);
+
+		SHORT operator()(const SHORT v) const {
+			const auto out = lut[(v < 0 ? -static_cast<int>(v) : v) >> 3];
+			return v < 0 ? static_cast<SHORT>(-out) : out;
+		}
+
+		// Output for magnitude 'index' (|v| >> 3), before the sign goes back on
+		std::int16_t magnitude(const std::size_t index) const {
+			return lut[index];
+		}
+	};
+
+	class trigger_table {
+		std::array<BYTE, 256> lut;
+	public:
+		void bake(const curve& c);
+
+		BYTE operator()(const BYTE v) const {
+			return lut[v];
+		}
+	};
+
+	// Emulates an analog pull on a digital trigger by moving its level
+	// toward fully pressed or released at a fixed rate (8.8 fixed point).
+	class trigger_ramper {
+		std::uint32_t rise {0}, fall {0}; // level per ms, 0 = instant
+		std::uint32_t level {0};          // 0..255 << 8
+		std::uint32_t last_ms {0};
+	public:
+		void bake(const trigger_ramp& r);
+
+		BYTE update(bool down, std::uint32_t now_ms);
+	};
+
+	// Every table a profile needs on the per-report path. Baked once when the
+	// profile loads; applying it costs a couple of loads per axis.
+	class response_curves {
+		std::array<axis_table, 4> sticks;
+		std::array<trigger_table, 2> triggers;
+		std::array<trigger_ramper, 2> ramps;
+	public:
+		void bake(const profile& p);
+
+		void apply_sticks(XINPUT_GAMEPAD& pad) const {
+			pad.sThumbLX = sticks[0](pad.sThumbLX);
+			pad.sThumbLY = sticks[1](pad.sThumbLY);
+			pad.sThumbRX = sticks[2](pad.sThumbRX);
+			pad.sThumbRY = sticks[3](pad.sThumbRY);
+		}
+
+		// Level of trigger 'i' (0 = left) for a digital input
+		BYTE digital_trigger(const int i, const bool down, const std::uint32_t now_ms) {
+			return triggers[i](ramps[i].update(down, now_ms));
+		}
+
+		// digital_trigger() in two steps: the ramp, then analog_trigger()
+		BYTE ramp_trigger(const int i, const bool down, const std::uint32_t now_ms) {
+			return ramps[i].update(down, now_ms);
+		}
+
+		const axis_table& stick(const int i) const {
+			return sticks[i];
+		}
+
+		BYTE analog_trigger(const int i, const BYTE v) const {
+			return triggers[i](v);
+		}
+	};
+};
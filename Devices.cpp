@@ -0,0 +1,149 @@
+#include "Devices.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <ostream>
+
+#include <SetupAPI.h>
+#include <hidsdi.h>
+
+#include "Common.hpp"
+
+namespace procon {
+	HANDLE open_overlapped(const std::string& path) {
+		return CreateFile(path.c_str(), GENERIC_WRITE | GENERIC_READ,
+						  FILE_SHARE_WRITE | FILE_SHARE_READ,
+						  nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+	}
+
+	link_type link_of(const std::string& path) {
+		auto lower = path;
+		std::transform(lower.begin(), lower.end(), lower.begin(), [](const unsigned char c) {
+			return static_cast<char>(std::tolower(c));
+		});
+		// The Bluetooth HID service class
+		return lower.find("{00001124-0000-1000-8000-00805f9b34fb}") != std::string::npos
+				? link_type::bluetooth : link_type::usb;
+	}
+
+	namespace {
+		// Interface paths carry the vendor and product IDs, over USB as
+		// "vid_057e&pid_2009" and over Bluetooth as "vid&0002057e_pid&2009",
+		// so most devices are ruled out without being opened
+		bool may_be_pro_controller(const std::string& path) {
+			auto lower = path;
+			std::transform(lower.begin(), lower.end(), lower.begin(), [](const unsigned char c) {
+				return static_cast<char>(std::tolower(c));
+			});
+			return lower.find("057e") != std::string::npos && lower.find("2009") != std::string::npos;
+		}
+	}
+
+	std::vector<found_controller> find_pro_controllers(std::ostream& log) {
+		using std::unique_ptr;
+
+		std::vector<found_controller> found;
+		GUID hid_guid;
+		HidD_GetHidGuid(&hid_guid);
+
+		const auto devices = SetupDiGetClassDevs(&hid_guid, nullptr,
+				nullptr, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+	
+		if (devices == INVALID_HANDLE_VALUE)
+			return found;
+
+		const auto destroy_list = make_scoped([devices] {
+			SetupDiDestroyDeviceInfoList(devices);
+		});
+		DWORD i = 0;
+		SP_DEVICE_INTERFACE_DATA data;
+		data.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+
+		while (SetupDiEnumDeviceInterfaces(devices,
+				nullptr, &hid_guid, i++, &data)) {
+			DWORD required_buffer_size;
+			const auto result = SetupDiGetDeviceInterfaceDetail(devices, &data,
+					nullptr, 0, &required_buffer_size, nullptr);
+
+			if (result != 0 || GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+				continue;
+
+			unique_ptr<SP_DEVICE_INTERFACE_DETAIL_DATA>
+					interface_detail(static_cast<
+							PSP_DEVICE_INTERFACE_DETAIL_DATA>(
+									operator new(required_buffer_size)));
+			interface_detail->cbSize
+					= sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+		
+			if (!SetupDiGetDeviceInterfaceDetail(devices, &data,
+												 interface_detail.get(),
+					required_buffer_size, nullptr, nullptr))
+				continue;
+
+			const std::string path = interface_detail->DevicePath;
+			if (!may_be_pro_controller(path))
+				continue;
+			const auto handle = open_overlapped(path);
+		
+			if (handle == INVALID_HANDLE_VALUE) {
+				const auto err = GetLastError();
+
+				if (err != ERROR_ACCESS_DENIED) {
+					log << "error opening " << path;
+					log << " (" << err << ")" << std::endl;
+				}
+				continue;
+			}
+
+			// Only used to identify the device; whoever uses it opens it again
+			const auto close_probe = make_scoped([handle] {
+				CloseHandle(handle);
+			});
+		
+			HIDD_ATTRIBUTES attributes;
+		
+			attributes.Size = sizeof attributes;
+			auto ok = HidD_GetAttributes(
+					handle, &attributes);
+		
+			if (!ok) {
+				log << "Error calling HidD_GetAttributes ("
+						  << GetLastError() << ")" << std::endl;
+				continue;
+			}
+
+			if (attributes.ProductID != pro_controller_product
+			 || attributes.VendorID != pro_controller_vendor) {
+				// not a pro controller, fail silently
+				continue;
+			}
+
+			PHIDP_PREPARSED_DATA preparsed_data;
+		
+			ok = HidD_GetPreparsedData(handle,
+									   &preparsed_data);
+		
+			if (!ok) {
+				log << "Error calling HidD_GetPreparsedData ("
+						  << GetLastError() << ")" << std::endl;
+				continue;
+			}
+
+			HIDP_CAPS caps;
+			const auto status = HidP_GetCaps(preparsed_data, &caps);
+		
+			HidD_FreePreparsedData(preparsed_data);
+
+			if (status != HIDP_STATUS_SUCCESS) {
+				log << "Error calling HidP_GetCaps ("
+						  << status << ")" << std::endl;
+				continue;
+			}
+
+			found.push_back({path, caps.InputReportByteLength,
+							 caps.OutputReportByteLength, link_of(path)});
+		}
+		return found;
+	}
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+namespace procon {
+	constexpr unsigned short pro_controller_vendor = 0x057E;
+	constexpr unsigned short pro_controller_product = 0x2009;
+
+	enum class link_type {
+		bluetooth,
+		usb,
+	};
+
+	// A Pro Controller's HID interface, the report lengths it declares and
+	// how it's connected
+	struct found_controller {
+		std::string path;
+		USHORT input_length, output_length;
+		link_type link;
+	};
+
+	// Paired controllers enumerate under the Bluetooth HID service, wired
+	// ones under their USB IDs
+	link_type link_of(const std::string& path);
+
+	// Every Pro Controller currently plugged in (or paired), in interface
+	// order. An interface that can't be queried is reported to 'log' and
+	// skipped.
+	std::vector<found_controller> find_pro_controllers(std::ostream& log);
+
+	// For the reactor; INVALID_HANDLE_VALUE on failure
+	HANDLE open_overlapped(const std::string& path);
+};
@@ -0,0 +1,165 @@
+#include "Fusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace procon {
+	namespace {
+		bool is_trigger(const pad_target t) {
+			return t == pad_target::left_trigger || t == pad_target::right_trigger;
+		}
+
+		std::int32_t to_q14(const double w) {
+			if (w < -8.0 || w > 8.0)
+				throw std::invalid_argument("fusion weight out of range");
+			return static_cast<std::int32_t>(std::lround(w * (1 << 14)));
+		}
+
+		std::int32_t combined(const combine mode, const std::int32_t pad,
+							  const std::int32_t rule) {
+			switch (mode) {
+			case combine::max_abs:
+				return std::abs(rule) > std::abs(pad) ? rule : pad;
+			case combine::add:
+				return pad + rule;
+			default:
+				return rule;
+			}
+		}
+
+		void store(XINPUT_GAMEPAD& pad, const pad_target t, const combine mode,
+				   const std::int32_t v) {
+			SHORT* stick = nullptr;
+
+			switch (t) {
+			case pad_target::thumb_lx: stick = &pad.sThumbLX; break;
+			case pad_target::thumb_ly: stick = &pad.sThumbLY; break;
+			case pad_target::thumb_rx: stick = &pad.sThumbRX; break;
+			case pad_target::thumb_ry: stick = &pad.sThumbRY; break;
+			case pad_target::left_trigger:
+				pad.bLeftTrigger = static_cast<BYTE>(std::min(255,
+						std::max(0, combined(mode, pad.bLeftTrigger, v))));
+				return;
+			case pad_target::right_trigger:
+				pad.bRightTrigger = static_cast<BYTE>(std::min(255,
+						std::max(0, combined(mode, pad.bRightTrigger, v))));
+				return;
+			}
+			*stick = static_cast<SHORT>(std::min(32767,
+					std::max(-32768, combined(mode, *stick, v))));
+		}
+	}
+
+	fusion::source_id fusion::add_source(const std::string& name,
+										 const std::uint32_t stale_ms) {
+		if (sources.size() == max_sources)
+			throw std::length_error("too many fusion sources");
+
+		source s;
+		s.name = name;
+		s.stale_ms = stale_ms;
+		sources.push_back(s);
+		return static_cast<source_id>(sources.size() - 1);
+	}
+
+	fusion::input_id fusion::add_input(const source_id s, const std::string& name) {
+		const auto full = sources.at(s).name + '.' + name;
+		const auto it = std::find(input_names.begin(), input_names.end(), full);
+
+		if (it != input_names.end())
+			return static_cast<input_id>(it - input_names.begin());
+		input_names.push_back(full);
+		input_sources.push_back(s);
+		values.push_back(0);
+		return static_cast<input_id>(input_names.size() - 1);
+	}
+
+	fusion::input_id fusion::find(const std::string& name) const {
+		const auto it = std::find(input_names.begin(), input_names.end(), name);
+
+		if (it == input_names.end())
+			throw std::invalid_argument("unknown fusion input: " + name);
+		return static_cast<input_id>(it - input_names.begin());
+	}
+
+	void fusion::add_rule(const axis_rule& r) {
+		baked_axis b;
+		const auto trigger = is_trigger(r.target);
+
+		b.in0 = find(r.input);
+		b.w0 = to_q14(r.weight);
+		if (r.second.empty()) {
+			b.in1 = b.in0;
+			b.w1 = 0;
+		} else {
+			b.in1 = find(r.second);
+			b.w1 = to_q14(r.second_weight);
+		}
+		b.sources = 1u << input_sources[b.in0] | 1u << input_sources[b.in1];
+		b.target = r.target;
+		b.mode = r.mode;
+
+		for (std::size_t i = 0; i < b.lut.size(); ++i) {
+			const auto mixed = std::min<std::int32_t>(32767,
+					static_cast<std::int32_t>(i << lut_shift) - 32768);
+			const auto v = std::max(-1.0, mixed / 32767.0);
+			double out;
+
+			if (r.transform)
+				out = r.transform(v);
+			else
+				out = trigger ? std::max(0.0, v) * 255.0 : v * 32767.0;
+
+			out = trigger ? std::min(255.0, std::max(0.0, out))
+						  : std::min(32767.0, std::max(-32768.0, out));
+			b.lut[i] = static_cast<std::int16_t>(std::lround(out));
+		}
+
+		axes.push_back(b);
+	}
+
+	void fusion::add_rule(const button_rule& r) {
+		baked_button b;
+
+		b.in = find(r.input);
+		b.threshold = r.threshold;
+		b.sources = 1u << input_sources[b.in];
+		b.buttons = r.buttons;
+		buttons.push_back(b);
+	}
+
+	void fusion::clear_rules() {
+		axes.clear();
+		buttons.clear();
+	}
+
+	bool fusion::fresh(const source_id s, const std::uint32_t now_ms) const {
+		const auto& src = sources[s];
+		return src.seen && now_ms - src.last_ms <= src.stale_ms;
+	}
+
+	void fusion::apply(XINPUT_GAMEPAD& pad, const std::uint32_t now_ms) const {
+		std::uint32_t live = 0;
+
+		for (std::size_t s = 0; s < sources.size(); ++s)
+			if (fresh(static_cast<source_id>(s), now_ms))
+				live |= 1u << s;
+
+		for (const auto& a : axes) {
+			if (a.sources & ~live)
+				continue;
+
+			const auto mix = (static_cast<std::int64_t>(values[a.in0]) * a.w0
+							+ static_cast<std::int64_t>(values[a.in1]) * a.w1) >> 14;
+			const auto clamped = static_cast<std::int32_t>(
+					std::min<std::int64_t>(32767, std::max<std::int64_t>(-32768, mix)));
+
+			store(pad, a.target, a.mode, a.lut[(clamped + 32768) >> lut_shift]);
+		}
+
+		for (const auto& b : buttons)
+			if (!(b.sources & ~live) && values[b.in] >= b.threshold)
+				pad.wButtons |= b.buttons;
+	}
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+namespace procon {
+	enum class pad_target : std::uint8_t {
+		thumb_lx,
+		thumb_ly,
+		thumb_rx,
+		thumb_ry,
+		left_trigger,
+		right_trigger,
+	};
+
+	enum class combine : std::uint8_t {
+		replace, // the rule's value wins
+		max_abs, // whichever of pad and rule is further from rest wins
+		add,     // saturating sum
+	};
+
+	// Drives one pad axis from one input, or a weighted mix of two. Inputs
+	// are normalized to [-32768, 32767]; the mix is clamped to that range and
+	// passed to 'transform' as [-1, 1], which returns the value in the
+	// target's own units (stick: -32768..32767, trigger: 0..255). The
+	// transform only runs while the rule is baked, never per report.
+	struct axis_rule {
+		std::string input;
+		std::string second; // empty = single input
+		double weight {1};
+		double second_weight {0};
+		pad_target target;
+		combine mode {combine::replace};
+		std::function<double(double)> transform; // empty = linear
+	};
+
+	// Sets 'buttons' in wButtons while 'input' is at or above 'threshold'
+	struct button_rule {
+		std::string input;
+		WORD buttons;
+		std::int32_t threshold {16384};
+	};
+
+	// Merges any number of source devices into one virtual gamepad through
+	// declared rules. Each source owns named inputs ("pedals.x"), and a source
+	// that has not been updated within its staleness limit simply drops out
+	// of the mix, so a slow or unplugged device never holds the output back.
+	class fusion {
+	public:
+		using source_id = std::uint8_t;
+		using input_id = std::uint16_t;
+
+		static constexpr std::size_t max_sources = 32;
+
+	private:
+		static constexpr unsigned lut_bits = 12;
+		static constexpr unsigned lut_shift = 16 - lut_bits;
+
+		struct source {
+			std::string name;
+			std::uint32_t stale_ms;
+			std::uint32_t last_ms {0};
+			bool seen {false};
+		};
+
+		struct baked_axis {
+			input_id in0, in1;
+			std::int32_t w0, w1; // Q14
+			std::uint32_t sources;
+			pad_target target;
+			combine mode;
+			std::array<std::int16_t, 1 << lut_bits> lut;
+		};
+
+		struct baked_button {
+			input_id in;
+			std::int32_t threshold;
+			std::uint32_t sources;
+			WORD buttons;
+		};
+
+		std::vector<source> sources;
+		std::vector<std::string> input_names;
+		std::vector<source_id> input_sources;
+		std::vector<std::int32_t> values;
+		std::vector<baked_axis> axes;
+		std::vector<baked_button> buttons;
+
+	public:
+		// Throws std::length_error past max_sources
+		source_id add_source(const std::string& name, std::uint32_t stale_ms);
+		// Registers "<source name>.<name>"; returns the existing id if known
+		input_id add_input(source_id s, const std::string& name);
+		// Throws std::invalid_argument for an unknown input
+		input_id find(const std::string& name) const;
+
+		void add_rule(const axis_rule& r);
+		void add_rule(const button_rule& r);
+		void clear_rules();
+
+		void set(const input_id in, const std::int32_t value) {
+			values[in] = value;
+		}
+		void updated(const source_id s, const std::uint32_t now_ms) {
+			sources[s].last_ms = now_ms;
+			sources[s].seen = true;
+		}
+		bool fresh(source_id s, std::uint32_t now_ms) const;
+
+		// Applies every rule whose sources are all fresh on top of 'pad'
+		void apply(XINPUT_GAMEPAD& pad, std::uint32_t now_ms) const;
+	};
+};
@@ -0,0 +1,69 @@
+#include "Gesture.hpp"
+
+namespace procon {
+	action key_chord(const std::uint8_t k0, const std::uint8_t k1,
+					 const std::uint8_t k2, const std::uint8_t k3) {
+		action a;
+		a.type = action_type::key_chord;
+		a.keys = {k0, k1, k2, k3};
+		return a;
+	}
+
+	action profile_switch(const std::uint8_t profile) {
+		action a;
+		a.type = action_type::profile_switch;
+		a.index = profile;
+		return a;
+	}
+
+	action run_macro(const std::uint8_t macro) {
+		action a;
+		a.type = action_type::macro;
+		a.index = macro;
+		return a;
+	}
+
+	void gesture_engine::load(const std::vector<gesture>& gestures,
+							  const gesture_timing t) {
+		slots = {};
+		chords.clear();
+		timing = t;
+		pending = 0;
+		// Buttons already down when a profile loads must be released first
+		latched = previous;
+
+		for (const auto& g : gestures) {
+			const auto single = g.buttons != 0 && !(g.buttons & (g.buttons - 1));
+
+			if (g.type == gesture_type::chord) {
+				if (single || g.buttons == 0)
+					throw std::invalid_argument("chord needs two or more buttons");
+				chords[g.buttons] = g.act;
+				continue;
+			}
+			if (!single)
+				throw std::invalid_argument("gesture needs exactly one button");
+
+			unsigned bit = 0;
+			while (!(g.buttons >> bit & 1u))
+				++bit;
+			if (bit >= button_count)
+				throw std::invalid_argument("gesture names an unknown button");
+
+			auto& s = slots[bit];
+			switch (g.type) {
+			case gesture_type::tap:
+				s.tap = g.act;
+				break;
+			case gesture_type::hold:
+				s.hold = g.act;
+				break;
+			case gesture_type::double_tap:
+				s.double_tap = g.act;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.hpp"
+
+namespace procon {
+	enum class action_type : std::uint8_t {
+		none,
+		key_chord,      // press keys in order, release in reverse
+		profile_switch, // activate profile 'index'
+		macro,          // start macro 'index' of the active profile
+	};
+
+	struct action {
+		action_type type {action_type::none};
+		std::uint8_t index {0};
+		std::array<std::uint8_t, 4> keys {}; // virtual-key codes, 0 = unused
+	};
+
+	action key_chord(std::uint8_t k0, std::uint8_t k1 = 0,
+					 std::uint8_t k2 = 0, std::uint8_t k3 = 0);
+	action profile_switch(std::uint8_t profile);
+	action run_macro(std::uint8_t macro);
+
+	enum class gesture_type : std::uint8_t {
+		tap,        // pressed and released before hold_ms
+		hold,       // kept down for hold_ms
+		double_tap, // pressed twice within double_tap_ms
+		chord,      // exactly 'buttons' pressed together
+	};
+
+	struct gesture {
+		gesture_type type;
+		button_mask buttons; // one button, except for chords
+		action act;
+	};
+
+	struct gesture_timing {
+		std::uint32_t hold_ms {500};
+		std::uint32_t double_tap_ms {250};
+	};
+
+	// Table-driven recognizer for tap/hold/double-tap on single buttons and
+	// chords on button sets. Every button owns a fixed slot, and chords are
+	// looked up by their exact mask, so the work per report is bounded by the
+	// number of buttons, not by the number of configured gestures.
+	class gesture_engine {
+		enum class phase : std::uint8_t {
+			idle,
+			down,        // pressed, hold not yet reached
+			held,        // hold fired, waiting for release
+			wait_second, // released once, waiting for a second press
+			second_down, // double tap fired, waiting for release
+		};
+
+		struct slot {
+			action tap, hold, double_tap;
+			std::uint32_t since {0};
+			phase state {phase::idle};
+		};
+
+		std::array<slot, button_count> slots;
+		std::unordered_map<button_mask, action> chords;
+		gesture_timing timing;
+		button_mask previous {0};
+		button_mask pending {0}; // slots waiting on a timeout
+		button_mask latched {0}; // buttons consumed by a chord until released
+
+		template<class Dispatch>
+		void fire(const action& a, Dispatch& dispatch) {
+			if (a.type != action_type::none)
+				dispatch(a);
+		}
+
+		template<class Dispatch>
+		void step(unsigned bit, bool down, bool edge, std::uint32_t now,
+				  Dispatch& dispatch);
+
+	public:
+		// Replaces every binding; throws std::invalid_argument on a gesture
+		// that names no button, or several buttons for a non-chord gesture.
+		void load(const std::vector<gesture>& gestures, gesture_timing t);
+
+		// Feeds the button state of one report stamped 'now_ms'. Recognized
+		// gestures are passed to 'dispatch(const action&)'.
+		template<class Dispatch>
+		void update(button_mask pressed, std::uint32_t now_ms, Dispatch dispatch);
+	};
+
+	template<class Dispatch>
+	void gesture_engine::step(const unsigned bit, const bool down,
+							  const bool edge, const std::uint32_t now,
+							  Dispatch& dispatch) {
+		auto& s = slots[bit];
+		const auto mask = 1u << bit;
+		const auto elapsed = now - s.since;
+
+		if (latched & mask) {
+			if (!down) {
+				latched &= ~mask;
+				s.state = phase::idle;
+			}
+			pending &= ~mask;
+			return;
+		}
+
+		// Timeouts first, so a late report still sees them in order
+		switch (s.state) {
+		case phase::down:
+			if (s.hold.type != action_type::none && elapsed >= timing.hold_ms) {
+				fire(s.hold, dispatch);
+				s.state = phase::held;
+				pending &= ~mask;
+			}
+			break;
+		case phase::wait_second:
+			if (elapsed >= timing.double_tap_ms) {
+				fire(s.tap, dispatch);
+				s.state = phase::idle;
+				pending &= ~mask;
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (!edge)
+			return;
+
+		switch (s.state) {
+		case phase::idle:
+			if (down) {
+				s.state = phase::down;
+				s.since = now;
+				if (s.hold.type != action_type::none)
+					pending |= mask;
+			}
+			break;
+		case phase::down:
+			if (!down) {
+				pending &= ~mask;
+				if (s.double_tap.type != action_type::none) {
+					s.state = phase::wait_second;
+					s.since = now;
+					pending |= mask;
+				} else {
+					fire(s.tap, dispatch);
+					s.state = phase::idle;
+				}
+			}
+			break;
+		case phase::wait_second:
+			if (down) {
+				fire(s.double_tap, dispatch);
+				s.state = phase::second_down;
+				pending &= ~mask;
+			}
+			break;
+		case phase::held:
+		case phase::second_down:
+			if (!down)
+				s.state = phase::idle;
+			break;
+		}
+	}
+
+	template<class Dispatch>
+	void gesture_engine::update(const button_mask pressed,
+								const std::uint32_t now_ms, Dispatch dispatch) {
+		const auto changed = pressed ^ previous;
+
+		if ((changed & pressed) && !chords.empty()) {
+			const auto chord = chords.find(pressed);
+
+			if (chord != chords.end()) {
+				latched |= pressed;
+				fire(chord->second, dispatch);
+			}
+		}
+
+		for (auto bits = changed | pending; bits; bits &= bits - 1) {
+			unsigned bit = 0;
+
+			while (!(bits >> bit & 1u))
+				++bit;
+			step(bit, (pressed >> bit & 1u) != 0, (changed >> bit & 1u) != 0,
+				 now_ms, dispatch);
+		}
+
+		previous = pressed;
+	}
+};
@@ -0,0 +1,90 @@
+#include "Handshake.hpp"
+
+#include <array>
+#include <chrono>
+#include <thread>
+
+#include "Clock.hpp"
+#include "Trace.hpp"
+
+namespace procon {
+	namespace {
+		// Reads until 'match' accepts a report or the timeout passes
+		template<class F>
+		bool wait_for(transport& t, const std::uint32_t timeout_ms, F match) {
+			uchar buf[64];
+			const auto end = clock_us() + timeout_ms * 1000ull;
+
+			do {
+				int size;
+				while ((size = t.read(buf, sizeof buf)) > 0)
+					if (match(buf, static_cast<std::size_t>(size)))
+						return true;
+				if (size < 0)
+					return false;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			} while (clock_us() < end);
+			return false;
+		}
+
+		struct usb_step {
+			uchar command;
+			bool replies;
+			const char* name;
+		};
+
+		const std::array<usb_step, 4> usb_steps = {{
+			{0x02, true, "USB handshake"},
+			{0x03, true, "USB 3 Mbit baud rate"},
+			{0x02, true, "USB handshake at 3 Mbit"},
+			{0x04, false, "USB only mode"},
+		}};
+	}
+
+	handshake_result run_handshake(transport& t, const handshake_config& c, std::uint8_t& counter) {
+		const auto fail = [&c](const char* step) {
+			return handshake_result {false, c.mode, step};
+		};
+
+		if (c.link == link_type::usb) {
+			for (const auto& step : usb_steps) {
+				const uchar packet[] = {0x80, step.command};
+				if (t.write(packet, sizeof packet) < 0)
+					return fail(step.name);
+
+				const auto command = step.command;
+				if (step.replies && !wait_for(t, c.step_timeout_ms,
+						[command](const uchar* d, const std::size_t size) {
+							return size >= 2 && d[0] == 0x81 && d[1] == command;
+						}))
+					return fail(step.name);
+			}
+		}
+
+		// Subcommand 0x03 with neutral rumble
+		const auto mode = static_cast<uchar>(c.mode);
+		const std::array<uchar, 12> set_mode {{0x01, static_cast<uchar>(counter++ & 0x0F),
+											   0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40,
+											   0x03, mode}};
+		if (t.write(set_mode.data(), set_mode.size()) < 0)
+			return fail("set report mode");
+
+		auto acked = false;
+		if (!wait_for(t, c.step_timeout_ms, [&acked](const uchar* d, const std::size_t size) {
+				input_report r;
+				if (!decode_full_report(d, size, r) || r.id != 0x21 || r.subcommand != 0x03)
+					return false;
+				acked = (r.ack & 0x80) != 0;
+				return true;
+			}) || !acked)
+			return fail("set report mode");
+		trace::emit(trace::event::subcommand_reply, 0x03u << 8 | mode);
+
+		if (!wait_for(t, c.step_timeout_ms, [mode](const uchar* d, const std::size_t size) {
+				return size != 0 && d[0] == mode;
+			}))
+			return fail("first report in the new mode");
+
+		return {true, c.mode, nullptr};
+	}
+};
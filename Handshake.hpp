@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Devices.hpp"
+#include "Report.hpp"
+#include "Transport.hpp"
+
+namespace procon {
+	struct handshake_config {
+		link_type link {link_type::bluetooth};
+		report_mode mode {report_mode::full};
+		std::uint32_t step_timeout_ms {500};
+	};
+
+	struct handshake_result {
+		bool ok;
+		report_mode mode;        // the mode reports now arrive in, if ok
+		const char* failed_step; // nullptr if ok
+	};
+
+	// Brings a freshly opened controller into a known state before its
+	// reports are used. Over USB that is the vendor handshake: handshake,
+	// 3 Mbit baud rate, handshake again, then USB only, which stops the
+	// controller timing out and keeps it from dropping back to Bluetooth.
+	// Then subcommand 0x03 selects the report mode, and the first report in
+	// that mode confirms it. Reports read meanwhile are dropped. Blocks for
+	// at most a few step timeouts; 'counter' is the output packet counter.
+	handshake_result run_handshake(transport& t, const handshake_config& c, std::uint8_t& counter);
+};
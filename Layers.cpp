@@ -0,0 +1,95 @@
+#include "Layers.hpp"
+
+#include "Clock.hpp"
+#include "Controller.hpp"
+
+namespace procon {
+	void input_layers::set_profiles(std::vector<profile> p, const std::size_t index) {
+		// Nothing is bound yet, so there's nothing to release
+		profiles = std::move(p);
+		active = requested = 0;
+		load(index);
+	}
+
+	void input_layers::load(const std::size_t index) {
+		if (index >= profiles.size())
+			return;
+
+		const auto& p = profiles[index];
+
+		// Keys held through the old profile's bindings must not stay stuck
+		for (const auto key : profiles[active].keys)
+			keys.key_up(key);
+		bound_keys_pressed = 0;
+
+		gestures.load(p.gestures, p.timing);
+		pad_curves.bake(p);
+		macros.load(p.macros, p.turbos);
+		active = requested = index;
+	}
+
+	void input_layers::dispatch(const action& a, const std::uint32_t now_ms) {
+		switch (a.type) {
+		case action_type::key_chord:
+			keys.key_chord(a);
+			break;
+		case action_type::profile_switch:
+			// Applied once the gesture engine is done with this report
+			requested = a.index;
+			break;
+		case action_type::macro:
+			macros.start(a.index, now_ms);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Presses and releases the keys bound to buttons that changed state
+	void input_layers::update_bound_keys(const button_mask pressed) {
+		const auto& bound = profiles[active].keys;
+		const auto changed = pressed ^ bound_keys_pressed;
+
+		for (auto bits = changed; bits; bits &= bits - 1) {
+			unsigned bit = 0;
+
+			while (!(bits >> bit & 1u))
+				++bit;
+			if (pressed >> bit & 1u)
+				keys.key_down(bound[bit]);
+			else
+				keys.key_up(bound[bit]);
+		}
+		bound_keys_pressed = pressed;
+	}
+
+	bool input_layers::input(const button_mask pressed, const std::uint32_t now_ms) {
+		gestures.update(pressed, now_ms, [this, now_ms](const action& a) {
+			dispatch(a, now_ms);
+		});
+		const auto switched = requested != active;
+		if (switched)
+			load(requested);
+		update_bound_keys(pressed);
+		// Everything this report produced goes out in one SendInput call
+		keys.flush();
+		return switched;
+	}
+
+	void input_layers::overlay(XINPUT_GAMEPAD& pad, const std::uint32_t now_ms) {
+		fused.apply(pad, now_ms);
+		macros.apply(pad, now_ms);
+	}
+
+	void export_pad(const controller& c, const XINPUT_GAMEPAD& pad, shared::controller_state& s) {
+		s.connected = c.connected();
+		s.user_index = c.slot();
+		s.raw = c.last_report();
+		s.pad = pad;
+		s.timing.last_report_us = c.last_report_us();
+		s.timing.reports = c.stats().received;
+		s.timing.map_us = static_cast<std::uint32_t>(clock_us() - c.last_report_us());
+		++s.timing.submits;
+		s.link = c.stats();
+	}
+};
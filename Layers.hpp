@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+#include "Curve.hpp"
+#include "Fusion.hpp"
+#include "Gesture.hpp"
+#include "Macro.hpp"
+#include "Output.hpp"
+#include "Profile.hpp"
+#include "SharedState.hpp"
+
+namespace procon {
+	class controller;
+
+	// The layers the first controller's pad goes through on its way to the
+	// bus, whichever path read it: gestures and the actions they fire, keys
+	// bound to buttons, fusion with extra devices and turbo and macros. One
+	// thread at a time.
+	class input_layers {
+		output_sink& keys;
+		fusion& fused;
+		std::vector<profile> profiles;
+		std::size_t active {0};
+		std::size_t requested {0};
+		gesture_engine gestures;
+		response_curves pad_curves;
+		macro_engine macros;
+		button_mask bound_keys_pressed {0};
+
+		void dispatch(const action& a, std::uint32_t now_ms);
+		void update_bound_keys(button_mask pressed);
+	public:
+		// Keys go out through 'k'; extra devices are set on 'f' by whoever
+		// polls them
+		input_layers(output_sink& k, fusion& f) : keys(k), fused(f) {}
+		input_layers(const input_layers&) = delete;
+		input_layers& operator=(const input_layers&) = delete;
+
+		// Installs 'p' and loads profile 'index'
+		void set_profiles(std::vector<profile> p, std::size_t index);
+		// Releases keys held through the old profile's bindings first
+		void load(std::size_t index);
+		const profile& active_profile() const { return profiles[active]; }
+		// The active profile's, for paths that map the pad themselves
+		response_curves& curves() { return pad_curves; }
+
+		// Gestures, a requested profile switch and bound keys, for the
+		// buttons held now; whatever keys that produces go out in one
+		// batch. True if the profile changed, so pads reload it.
+		bool input(button_mask pressed, std::uint32_t now_ms);
+
+		// Fusion, then turbo and macros last, on exactly what is about to be
+		// submitted. Poll extra devices in between input() and this.
+		void overlay(XINPUT_GAMEPAD& pad, std::uint32_t now_ms);
+	};
+
+	// The reactor's per-pad view in the shared state region, updated for a
+	// pad about to be submitted. Publishing is left to the caller.
+	void export_pad(const controller& c, const XINPUT_GAMEPAD& pad, shared::controller_state& s);
+};
@@ -0,0 +1,97 @@
+#include "LinkStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace procon {
+	constexpr std::size_t link_monitor::window;
+
+	namespace {
+		// Smoothing weights, as in RFC 3550's jitter estimator
+		constexpr double smooth = 1.0 / 16;
+		constexpr double tick_smooth = 1.0 / 64;
+		constexpr double tick_slack = 0.005;
+	}
+
+	void link_monitor::learn_stride(const std::uint8_t step) {
+		// The most common step rather than the smallest, so a short one from
+		// jitter doesn't make every normal step after it look like a loss
+		auto evicted = step; // none until the window fills
+		if (kept == window) {
+			evicted = steps[next];
+			--seen[evicted];
+		} else {
+			++kept;
+		}
+		steps[next] = step;
+		next = (next + 1) % window;
+		++seen[step];
+
+		if (evicted == stride && step != stride) {
+			// Only the most common step lost ground; rare, so look again
+			for (unsigned v = 1; v < seen.size(); ++v)
+				if (seen[v] > seen[stride])
+					stride = static_cast<std::uint8_t>(v);
+		} else if (seen[step] > seen[stride] || (seen[step] == seen[stride] && step < stride)) {
+			stride = step;
+		}
+	}
+
+	void link_monitor::report(const std::uint8_t timer, const std::uint64_t arrived_us) {
+		if (s.received++ == 0) {
+			last_timer = timer;
+			last_us = arrived_us;
+			earliest_us = static_cast<double>(arrived_us);
+			return;
+		}
+
+		const unsigned step = static_cast<std::uint8_t>(timer - last_timer);
+		const auto interval = static_cast<double>(arrived_us - last_us);
+		last_timer = timer;
+		last_us = arrived_us;
+
+		if (step == 0) {
+			++s.duplicates;
+			return;
+		}
+		learn_stride(static_cast<std::uint8_t>(step));
+
+		// Reports this step spans, rounded so timer jitter of a tick or so
+		// isn't mistaken for loss
+		const auto spanned = std::max(1u, (step + stride / 2) / stride);
+		if (spanned > 1) {
+			s.lost += spanned - 1;
+			++s.gaps;
+		}
+		if (interval > s.longest_gap_us)
+			s.longest_gap_us = static_cast<std::uint32_t>(interval);
+
+		interval_us = interval_us == 0 ? interval
+				: interval_us + (interval - interval_us) * smooth;
+		s.rate_hz = interval_us > 0 ? static_cast<float>(1e6 / interval_us) : 0;
+
+		// Reads that were queued arrive back to back, so only the long-run
+		// average of interval per tick is the controller's clock
+		if (spanned == 1) {
+			const auto per_tick = interval / step;
+			s.tick_us = s.tick_us == 0 ? static_cast<float>(per_tick)
+					: static_cast<float>(s.tick_us + (per_tick - s.tick_us) * tick_smooth);
+		}
+		if (s.tick_us == 0)
+			return;
+
+		// RFC 3550 jitter: how far each interval strays from what the timer
+		// says elapsed on the controller
+		const auto expected = step * static_cast<double>(s.tick_us);
+		s.jitter_us = static_cast<float>(s.jitter_us
+				+ (std::fabs(interval - expected) - s.jitter_us) * smooth);
+
+		// The earliest this report could have been read if the previous one
+		// was. Whatever we read later than that sat queued on the host. The
+		// slack keeps a slightly low tick estimate from accumulating as delay.
+		earliest_us = std::min(static_cast<double>(arrived_us),
+							   earliest_us + expected * (1 + tick_slack));
+		s.queue_us = static_cast<float>(s.queue_us
+				+ (arrived_us - earliest_us - s.queue_us) * smooth);
+	}
+};
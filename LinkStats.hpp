@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace procon {
+	// Link health derived from the timer byte every report carries. The
+	// controller bumps it by a fixed stride per report it sends, so a larger
+	// step means reports were lost on the way and a step of 0 a duplicate.
+	struct link_stats {
+		std::uint64_t received;
+		std::uint64_t lost;        // reports the timer says were sent but never arrived
+		std::uint64_t gaps;        // runs of one or more lost reports
+		std::uint64_t duplicates;  // same timer value twice in a row
+		std::uint32_t longest_gap_us; // longest time between two arrivals
+		float rate_hz;    // reports actually received per second
+		float tick_us;    // controller time per timer tick, learned
+		float jitter_us;  // smoothed inter-arrival jitter against the controller clock
+		float queue_us;   // smoothed time reports sat queued before being read
+	};
+
+	// Updates link_stats in constant time per report from its timer byte and
+	// the host time it was read.
+	class link_monitor {
+		static constexpr std::size_t window = 32; // recent steps the stride is learned from
+
+		link_stats s {};
+		std::uint8_t last_timer {0};
+		std::uint8_t stride {0};                  // most common recent step: one report
+		std::array<std::uint8_t, window> steps {}; // oldest at 'next' once full
+		std::array<std::uint8_t, 256> seen {};    // how often each step is in 'steps'
+		std::size_t next {0};
+		std::size_t kept {0};
+		std::uint64_t last_us {0};
+		double interval_us {0};   // smoothed time between arrivals
+		double earliest_us {0};   // earliest the last report could have been read
+
+		void learn_stride(std::uint8_t step);
+	public:
+		void report(std::uint8_t timer, std::uint64_t arrived_us);
+
+		// Call when the controller reconnects; its timer restarts
+		void reset() { *this = link_monitor(); }
+
+		const link_stats& stats() const { return s; }
+	};
+};
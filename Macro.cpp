@@ -0,0 +1,244 @@
+#include "Macro.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace procon {
+	namespace {
+		std::uint32_t half_period(const turbo& t) {
+			return std::max<std::uint32_t>(1, 500u / t.hz);
+		}
+
+		bool not_after(const std::uint32_t due, const std::uint32_t now) {
+			return static_cast<std::int32_t>(due - now) <= 0;
+		}
+	}
+
+	constexpr std::size_t macro_engine::max_timers;
+	constexpr std::uint32_t macro_engine::wheel_size;
+	constexpr std::uint16_t macro_engine::nil;
+	constexpr std::uint8_t macro_engine::no_turbo;
+
+	macro_engine::macro_engine() {
+		load({}, {});
+	}
+
+	void macro_engine::load(const std::vector<macro>& m, const std::vector<turbo>& t) {
+		for (const auto& x : m) {
+			if (x.steps.empty())
+				throw std::invalid_argument("macro '" + x.name + "' has no steps");
+			for (const auto& s : x.steps)
+				if (s.ms == 0)
+					throw std::invalid_argument("macro '" + x.name + "' has a zero-length step");
+		}
+		for (const auto& x : t)
+			if (x.buttons == 0 || x.hz == 0)
+				throw std::invalid_argument("turbo needs buttons and a rate");
+		if (t.size() >= no_turbo)
+			throw std::invalid_argument("too many turbo bindings");
+
+		macros = m;
+		turbos = t;
+
+		slots.fill(nil);
+		for (std::size_t i = 0; i < pool.size(); ++i)
+			pool[i].next = static_cast<std::uint16_t>(i + 1 < pool.size() ? i + 1 : nil);
+		free_list = 0;
+
+		turbo_timer.assign(turbos.size(), nil);
+		turbo_of_bit.fill(no_turbo);
+		turbo_buttons = 0;
+		for (std::size_t i = 0; i < turbos.size(); ++i) {
+			for (unsigned bit = 0; bit < 16; ++bit)
+				if (turbos[i].buttons >> bit & 1u)
+					turbo_of_bit[bit] = static_cast<std::uint8_t>(i);
+			turbo_buttons |= turbos[i].buttons;
+		}
+		turbo_off = 0;
+		// Turbo buttons already held start pulsing on the next report
+		previous = 0;
+
+		held.fill(0);
+		forced = 0;
+		trigger_sum = {};
+	}
+
+	std::uint16_t macro_engine::allocate() {
+		const auto t = free_list;
+
+		if (t != nil)
+			free_list = pool[t].next;
+		return t;
+	}
+
+	void macro_engine::release(const std::uint16_t t) {
+		pool[t].next = free_list;
+		free_list = t;
+	}
+
+	void macro_engine::schedule(const std::uint16_t t, const std::uint32_t due) {
+		auto& slot = slots[due % wheel_size];
+
+		pool[t].due = due;
+		pool[t].next = slot;
+		slot = t;
+	}
+
+	void macro_engine::unschedule(const std::uint16_t t) {
+		// Slots hold a handful of timers at most
+		auto* link = &slots[pool[t].due % wheel_size];
+		while (*link != t)
+			link = &pool[*link].next;
+		*link = pool[t].next;
+	}
+
+	void macro_engine::enter_step(const macro_step& s, const int sign) {
+		for (unsigned bit = 0; bit < 16; ++bit) {
+			if (!(s.buttons >> bit & 1u))
+				continue;
+			held[bit] = static_cast<std::uint8_t>(held[bit] + sign);
+			if (held[bit])
+				forced |= 1u << bit;
+			else
+				forced &= ~(1u << bit);
+		}
+		trigger_sum[0] += sign * s.left_trigger;
+		trigger_sum[1] += sign * s.right_trigger;
+	}
+
+	void macro_engine::fire(const std::uint16_t t, const std::uint32_t now) {
+		auto& x = pool[t];
+		std::uint32_t due;
+
+		if (x.type == kind::turbo) {
+			turbo_off ^= turbos[x.index].buttons;
+			due = x.due + half_period(turbos[x.index]);
+		} else {
+			const auto& m = macros[x.index];
+
+			enter_step(m.steps[x.step], -1);
+			if (++x.step == m.steps.size()) {
+				if (!m.repeat) {
+					release(t);
+					return;
+				}
+				x.step = 0;
+			}
+			enter_step(m.steps[x.step], 1);
+			due = x.due + m.steps[x.step].ms;
+		}
+
+		// After a long gap, skip the missed periods instead of replaying them
+		if (not_after(due, now))
+			due = now + 1;
+		schedule(t, due);
+	}
+
+	void macro_engine::advance(const std::uint32_t now_ms) {
+		if (!started) {
+			clock = now_ms;
+			started = true;
+			return;
+		}
+		if (not_after(now_ms, clock))
+			return;
+
+		// One lap visits every slot, so anything overdue is still found
+		if (now_ms - clock > wheel_size)
+			clock = now_ms - wheel_size;
+
+		while (clock != now_ms) {
+			++clock;
+
+			auto& slot = slots[clock % wheel_size];
+			auto t = slot;
+
+			slot = nil;
+			while (t != nil) {
+				const auto next = pool[t].next;
+
+				if (not_after(pool[t].due, clock)) {
+					fire(t, clock);
+				} else {
+					pool[t].next = slot;
+					slot = t;
+				}
+				t = next;
+			}
+		}
+	}
+
+	void macro_engine::turbo_edges(const WORD buttons, const std::uint32_t now_ms) {
+		const auto changed = static_cast<WORD>((buttons ^ previous) & turbo_buttons);
+
+		for (unsigned bit = 0; bit < 16; ++bit) {
+			if (!(changed >> bit & 1u))
+				continue;
+
+			const auto i = turbo_of_bit[bit];
+			const auto mask = turbos[i].buttons;
+			const bool now_held = (buttons & mask) != 0;
+			const bool was_held = (previous & mask) != 0;
+
+			if (now_held == was_held)
+				continue;
+
+			// Either edge restarts the pulse from 'pressed'. A press takes
+			// over the timer the turbo already has, and a release frees it,
+			// so mashing a turbo button can't drain the pool.
+			turbo_off &= ~mask;
+			auto& t = turbo_timer[i];
+			if (t != nil)
+				unschedule(t);
+			if (!now_held) {
+				if (t != nil)
+					release(t);
+				t = nil;
+				continue;
+			}
+
+			if (t == nil)
+				t = allocate();
+			if (t == nil)
+				continue;
+			pool[t].type = kind::turbo;
+			pool[t].index = i;
+			schedule(t, now_ms + half_period(turbos[i]));
+		}
+	}
+
+	bool macro_engine::start(const std::uint8_t index, const std::uint32_t now_ms) {
+		if (index >= macros.size())
+			return false;
+
+		advance(now_ms);
+
+		const auto t = allocate();
+		if (t == nil)
+			return false;
+
+		const auto& first = macros[index].steps.front();
+
+		pool[t].type = kind::macro;
+		pool[t].index = index;
+		pool[t].step = 0;
+		enter_step(first, 1);
+		schedule(t, now_ms + first.ms);
+		return true;
+	}
+
+	void macro_engine::apply(XINPUT_GAMEPAD& pad, const std::uint32_t now_ms) {
+		advance(now_ms);
+
+		const auto buttons = pad.wButtons;
+
+		turbo_edges(buttons, now_ms);
+		previous = buttons;
+
+		pad.wButtons = static_cast<WORD>((buttons & ~turbo_off) | forced);
+		pad.bLeftTrigger = static_cast<BYTE>(std::max<int>(pad.bLeftTrigger,
+				std::min(255, trigger_sum[0])));
+		pad.bRightTrigger = static_cast<BYTE>(std::max<int>(pad.bRightTrigger,
+				std::min(255, trigger_sum[1])));
+	}
+};
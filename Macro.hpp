@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+namespace procon {
+	struct macro_step {
+		WORD buttons;     // XINPUT_GAMEPAD_* bits held for the step
+		BYTE left_trigger, right_trigger;
+		std::uint16_t ms; // duration, at least 1
+	};
+
+	struct macro {
+		std::string name;
+		std::vector<macro_step> steps;
+		bool repeat {false}; // loop until the profile changes
+	};
+
+	// While any of 'buttons' is held on the mapped pad it is pulsed at 'hz'
+	struct turbo {
+		WORD buttons;
+		std::uint16_t hz;
+	};
+
+	// Runs turbo and macro timers on a hashed timing wheel driven by the
+	// output clock and overlays the result on the mapped pad right before it
+	// is submitted. Timers live in a fixed pool and only the slots the clock
+	// passes over are visited, so a tick costs the same with one macro or
+	// dozens running.
+	class macro_engine {
+	public:
+		static constexpr std::size_t max_timers = 64;
+
+	private:
+		static constexpr std::uint32_t wheel_size = 256; // slots of 1 ms
+		static constexpr std::uint16_t nil = 0xFFFF;
+		static constexpr std::uint8_t no_turbo = 0xFF;
+
+		enum class kind : std::uint8_t {
+			macro,
+			turbo,
+		};
+
+		struct timer {
+			std::uint32_t due;
+			std::uint16_t next; // next timer in the same slot, or free list
+			std::uint16_t step; // macro step
+			std::uint8_t index; // macro or turbo index
+			kind type;
+		};
+
+		std::array<timer, max_timers> pool;
+		std::array<std::uint16_t, wheel_size> slots;
+		std::uint16_t free_list {nil};
+		std::uint32_t clock {0};
+		bool started {false};
+
+		std::vector<macro> macros;
+		std::vector<turbo> turbos;
+		std::vector<std::uint16_t> turbo_timer; // per turbo while held, or nil
+		std::array<std::uint8_t, 16> turbo_of_bit; // turbo per button bit, or no_turbo
+		WORD turbo_buttons {0};
+		WORD turbo_off {0}; // buttons in the 'released' half of their pulse
+		WORD previous {0};
+
+		std::array<std::uint8_t, 16> held; // macros holding each button bit
+		WORD forced {0};
+		std::array<int, 2> trigger_sum {};
+
+		std::uint16_t allocate();
+		void release(std::uint16_t t);
+		void schedule(std::uint16_t t, std::uint32_t due);
+		void unschedule(std::uint16_t t);
+		void enter_step(const macro_step& s, int sign);
+		void fire(std::uint16_t t, std::uint32_t now);
+		void advance(std::uint32_t now_ms);
+		void turbo_edges(WORD buttons, std::uint32_t now_ms);
+
+	public:
+		macro_engine();
+
+		// Cancels everything running and installs new definitions; throws
+		// std::invalid_argument on an empty macro, a zero-length step or a
+		// turbo without buttons or rate
+		void load(const std::vector<macro>& m, const std::vector<turbo>& t);
+
+		// Starts macro 'index'; false if unknown or out of timers
+		bool start(std::uint8_t index, std::uint32_t now_ms);
+
+		void apply(XINPUT_GAMEPAD& pad, std::uint32_t now_ms);
+	};
+};
@@ -0,0 +1,145 @@
+#include "Output.hpp"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+namespace procon {
+	void output_sink::push(const output_event& e) {
+		if (queued == queue.size())
+			flush();
+		queue[queued++] = e;
+	}
+
+	void output_sink::key_down(const std::uint8_t key) {
+		if (key == 0 || keys_down[key])
+			return;
+		keys_down[key] = true;
+		push({output_event::kind::key, true, key, 0, 0});
+	}
+
+	void output_sink::key_up(const std::uint8_t key) {
+		if (key == 0 || !keys_down[key])
+			return;
+		keys_down[key] = false;
+		push({output_event::kind::key, false, key, 0, 0});
+	}
+
+	void output_sink::key_chord(const action& a) {
+		std::array<std::uint8_t, 4> pressed {};
+		std::size_t count = 0;
+
+		for (const auto key : a.keys) {
+			if (key == 0 || keys_down[key])
+				continue;
+			key_down(key);
+			pressed[count++] = key;
+		}
+		while (count > 0)
+			key_up(pressed[--count]);
+	}
+
+	void output_sink::mouse_down(const mouse_button b) {
+		const auto bit = static_cast<std::uint8_t>(1u << static_cast<unsigned>(b));
+
+		if (buttons_down & bit)
+			return;
+		buttons_down |= bit;
+		push({output_event::kind::mouse_button, true,
+			  static_cast<std::uint8_t>(b), 0, 0});
+	}
+
+	void output_sink::mouse_up(const mouse_button b) {
+		const auto bit = static_cast<std::uint8_t>(1u << static_cast<unsigned>(b));
+
+		if (!(buttons_down & bit))
+			return;
+		buttons_down &= ~bit;
+		push({output_event::kind::mouse_button, false,
+			  static_cast<std::uint8_t>(b), 0, 0});
+	}
+
+	void output_sink::mouse_move(const std::int32_t dx, const std::int32_t dy) {
+		if (dx == 0 && dy == 0)
+			return;
+		if (queued > 0 && queue[queued - 1].type == output_event::kind::mouse_move) {
+			queue[queued - 1].dx += dx;
+			queue[queued - 1].dy += dy;
+			return;
+		}
+		push({output_event::kind::mouse_move, false, 0, dx, dy});
+	}
+
+	void output_sink::wheel(const std::int32_t delta) {
+		if (delta != 0)
+			push({output_event::kind::wheel, false, 0, 0, delta});
+	}
+
+	void output_sink::release_all() {
+		for (unsigned key = 0; key < keys_down.size(); ++key)
+			if (keys_down[key])
+				key_up(static_cast<std::uint8_t>(key));
+		mouse_up(mouse_button::left);
+		mouse_up(mouse_button::right);
+		mouse_up(mouse_button::middle);
+	}
+
+	void output_sink::flush() {
+		if (queued == 0)
+			return;
+		inject(queue.data(), queued);
+		queued = 0;
+	}
+
+	void sendinput_sink::inject(const output_event* events, const std::size_t count) {
+		static const DWORD button_flags[3][2] = {
+			{MOUSEEVENTF_LEFTUP, MOUSEEVENTF_LEFTDOWN},
+			{MOUSEEVENTF_RIGHTUP, MOUSEEVENTF_RIGHTDOWN},
+			{MOUSEEVENTF_MIDDLEUP, MOUSEEVENTF_MIDDLEDOWN},
+		};
+		INPUT ip[batch_capacity];
+
+		for (std::size_t i = 0; i < count; ++i) {
+			const auto& e = events[i];
+			auto& in = ip[i];
+
+			in = {};
+			if (e.type == output_event::kind::key) {
+				in.type = INPUT_KEYBOARD;
+				in.ki.wVk = e.code;
+				in.ki.dwFlags = e.down ? 0 : KEYEVENTF_KEYUP;
+				continue;
+			}
+			in.type = INPUT_MOUSE;
+			switch (e.type) {
+			case output_event::kind::mouse_button:
+				in.mi.dwFlags = button_flags[e.code][e.down];
+				break;
+			case output_event::kind::mouse_move:
+				in.mi.dx = e.dx;
+				in.mi.dy = e.dy;
+				in.mi.dwFlags = MOUSEEVENTF_MOVE;
+				break;
+			case output_event::kind::wheel:
+				in.mi.mouseData = static_cast<DWORD>(e.dy);
+				in.mi.dwFlags = MOUSEEVENTF_WHEEL;
+				break;
+			default:
+				break;
+			}
+		}
+
+		SendInput(static_cast<UINT>(count), ip, sizeof(INPUT));
+	}
+
+	sendinput_sink::~sendinput_sink() {
+		release_all();
+		flush();
+	}
+
+	void recording_sink::inject(const output_event* events, const std::size_t count) {
+		this->events.insert(this->events.end(), events, events + count);
+		batch_sizes.push_back(count);
+	}
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#include "Gesture.hpp"
+
+namespace procon {
+	enum class mouse_button : std::uint8_t {
+		left,
+		right,
+		middle,
+	};
+
+	struct output_event {
+		enum class kind : std::uint8_t {
+			key,          // 'code' is a virtual-key code
+			mouse_button, // 'code' is a mouse_button
+			mouse_move,   // relative motion by (dx, dy)
+			wheel,        // wheel motion by dy
+		};
+
+		kind type;
+		bool down;
+		std::uint8_t code;
+		std::int32_t dx, dy;
+	};
+
+	// Collects the keyboard and mouse events produced while handling one
+	// report and injects them in a single call on flush(). Keys and mouse
+	// buttons are tracked so a press is never repeated, a release is never
+	// sent for something that is not down, and everything still held can be
+	// released in one go.
+	class output_sink {
+	public:
+		static constexpr std::size_t batch_capacity = 64;
+
+	private:
+		std::array<output_event, batch_capacity> queue;
+		std::size_t queued {0};
+		std::bitset<256> keys_down;
+		std::uint8_t buttons_down {0};
+
+		void push(const output_event& e);
+
+	protected:
+		// Delivers 'count' events, in order, to the OS
+		virtual void inject(const output_event* events, std::size_t count) = 0;
+
+	public:
+		output_sink() = default;
+		output_sink(const output_sink&) = delete;
+		output_sink& operator=(const output_sink&) = delete;
+		virtual ~output_sink() = default;
+
+		void key_down(std::uint8_t key);
+		void key_up(std::uint8_t key);
+		// Presses the action's keys in order and releases them in reverse.
+		// Keys already held by someone else are left alone.
+		void key_chord(const action& a);
+
+		void mouse_down(mouse_button b);
+		void mouse_up(mouse_button b);
+		// Consecutive moves within one batch are merged
+		void mouse_move(std::int32_t dx, std::int32_t dy);
+		void wheel(std::int32_t delta);
+
+		bool is_down(const std::uint8_t key) const { return keys_down[key]; }
+
+		// Queues a release for every held key and mouse button
+		void release_all();
+		void flush();
+	};
+
+	// Injects through SendInput; releases whatever is still held on destruction
+	class sendinput_sink : public output_sink {
+	protected:
+		void inject(const output_event* events, std::size_t count) override;
+	public:
+		~sendinput_sink() override;
+	};
+
+	// Keeps every injected batch, for tests and replay diagnostics
+	class recording_sink : public output_sink {
+	protected:
+		void inject(const output_event* events, std::size_t count) override;
+	public:
+		std::vector<output_event> events;
+		std::vector<std::size_t> batch_sizes;
+
+		void clear() {
+			events.clear();
+			batch_sizes.clear();
+		}
+	};
+};
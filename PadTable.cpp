@@ -0,0 +1,150 @@
+#include "PadTable.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PROCON_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace procon {
+	constexpr std::size_t pad_table::lanes;
+
+	pad_table::slot_id pad_table::add(const response_curves& c, const BYTE limit) {
+		const auto s = used++;
+		if (used > staged.size())
+			grow();
+
+		curves[s] = &c;
+		rumble_limit[s] = limit;
+		return s;
+	}
+
+	void pad_table::grow() {
+		const auto capacity = staged.size() + lanes;
+
+		for (auto& c : raw)
+			c.resize(capacity, 2048);
+		for (std::size_t a = 0; a < 4; ++a) {
+			axes[a].resize(capacity, 0);
+			magnitude[a].resize(capacity, 0);
+			negative[a].resize(capacity, 0);
+		}
+		buttons.resize(capacity, 0);
+		for (std::size_t i = 0; i < 2; ++i) {
+			ramped[i].resize(capacity, 0);
+			triggers[i].resize(capacity, 0);
+			requested[i].resize(capacity, 0);
+			motors[i].resize(capacity, 0);
+		}
+		rumble_limit.resize(capacity, 0);
+		staged.resize(capacity, 0);
+		curves.resize(capacity, nullptr);
+	}
+
+	// 12-bit travel centred on 2048 to the full signed range, as map_report
+	// does it ((v - 2048) * 16 fits 16 bits, so only -32768 needs clamping),
+	// then split into the curve table's index and the sign
+	void pad_table::split_scalar(const std::size_t from) {
+		for (std::size_t a = 0; a < raw.size(); ++a)
+			for (auto i = from; i < staged.size(); ++i) {
+				const auto v = std::max(-32767, (static_cast<int>(raw[a][i]) - 2048) * 16);
+				magnitude[a][i] = static_cast<std::uint16_t>(std::abs(v) >> 3);
+				negative[a][i] = static_cast<std::int16_t>(v < 0 ? -1 : 0);
+			}
+	}
+
+	void pad_table::look_up_curves() {
+		// Each slot has its own baked tables and SSE2 has no gather, so the
+		// lookups are the one step that goes a slot at a time
+		for (std::size_t s = 0; s < used; ++s) {
+			const auto& c = *curves[s];
+			for (auto a = 0; a < 4; ++a)
+				axes[a][s] = c.stick(a).magnitude(magnitude[a][s]);
+			triggers[0][s] = c.analog_trigger(0, ramped[0][s]);
+			triggers[1][s] = c.analog_trigger(1, ramped[1][s]);
+		}
+	}
+
+	void pad_table::sign_scalar(const std::size_t from) {
+		for (std::size_t a = 0; a < axes.size(); ++a)
+			for (auto i = from; i < staged.size(); ++i)
+				if (negative[a][i])
+					axes[a][i] = static_cast<std::int16_t>(-axes[a][i]);
+	}
+
+	void pad_table::process() {
+		std::size_t done = 0;
+#ifdef PROCON_SSE2
+		const auto centre = _mm_set1_epi16(2048);
+		const auto lowest = _mm_set1_epi16(-32767);
+
+		for (std::size_t a = 0; a < raw.size(); ++a)
+			for (std::size_t i = 0; i < staged.size(); i += lanes) {
+				const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw[a].data() + i));
+				const auto scaled = _mm_max_epi16(_mm_slli_epi16(_mm_sub_epi16(v, centre), 4), lowest);
+				// |x| as (x ^ m) - m, m all ones where x is negative
+				const auto m = _mm_srai_epi16(scaled, 15);
+				const auto abs = _mm_sub_epi16(_mm_xor_si128(scaled, m), m);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(magnitude[a].data() + i), _mm_srli_epi16(abs, 3));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(negative[a].data() + i), m);
+			}
+
+		look_up_curves();
+
+		for (std::size_t a = 0; a < axes.size(); ++a)
+			for (std::size_t i = 0; i < staged.size(); i += lanes) {
+				const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(axes[a].data() + i));
+				const auto m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(negative[a].data() + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(axes[a].data() + i),
+								 _mm_sub_epi16(_mm_xor_si128(v, m), m));
+			}
+		done = staged.size();
+#else
+		split_scalar(0);
+		look_up_curves();
+#endif
+		sign_scalar(done);
+	}
+
+	void pad_table::process_scalar() {
+		split_scalar(0);
+		look_up_curves();
+		sign_scalar(0);
+	}
+
+	// level * limit / 255, rounded down like the scalar path in
+	// controller::apply_feedback
+	void pad_table::scale_motors_scalar(const std::size_t from) {
+		for (std::size_t m = 0; m < 2; ++m)
+			for (auto i = from; i < staged.size(); ++i)
+				motors[m][i] = static_cast<BYTE>(requested[m][i] * rumble_limit[i] / 255);
+	}
+
+	void pad_table::scale_motors() {
+		std::size_t done = 0;
+#ifdef PROCON_SSE2
+		const auto zero = _mm_setzero_si128();
+		const auto one = _mm_set1_epi16(1);
+
+		for (std::size_t m = 0; m < 2; ++m)
+			for (std::size_t i = 0; i < staged.size(); i += lanes) {
+				const auto level = _mm_unpacklo_epi8(
+						_mm_loadl_epi64(reinterpret_cast<const __m128i*>(requested[m].data() + i)), zero);
+				const auto limit = _mm_unpacklo_epi8(
+						_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rumble_limit.data() + i)), zero);
+				// x / 255 == (x + 1 + (x >> 8)) >> 8 for every product of two bytes
+				const auto x = _mm_mullo_epi16(level, limit);
+				const auto q = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, one), _mm_srli_epi16(x, 8)), 8);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(motors[m].data() + i), _mm_packus_epi16(q, zero));
+			}
+		done = staged.size();
+#endif
+		scale_motors_scalar(done);
+	}
+
+	void pad_table::scale_motors_scalar() {
+		scale_motors_scalar(0);
+	}
+};
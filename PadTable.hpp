@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include "Common.hpp"
+#include "Curve.hpp"
+#include "Report.hpp"
+
+namespace procon {
+	// The hot per-controller state of a whole rig, one column per field, so
+	// a frame's stick and rumble arithmetic runs across every controller at
+	// once: SSE2 kernels eight slots at a time, scalar where SSE2 is
+	// missing. Each controller owns one slot; columns are padded to whole
+	// vectors and unused lanes hold neutral values.
+	class pad_table {
+	public:
+		using slot_id = std::size_t;
+		static constexpr std::size_t lanes = 8;
+
+	private:
+		// Inputs as staged; process() derives the outputs from them, so it
+		// can run any number of times per frame
+		std::array<std::vector<std::uint16_t>, 4> raw; // 12-bit travel
+		std::array<std::vector<std::int16_t>, 4> axes; // signed, through the curves
+		std::array<std::vector<std::uint16_t>, 4> magnitude; // curve table index
+		std::array<std::vector<std::int16_t>, 4> negative;   // -1 where the axis is
+		std::vector<button_mask> buttons;
+		std::array<std::vector<BYTE>, 2> ramped;       // digital triggers' levels
+		std::array<std::vector<BYTE>, 2> triggers;     // through the curves
+		std::array<std::vector<BYTE>, 2> requested;    // large, small motor
+		std::array<std::vector<BYTE>, 2> motors;       // limited
+		std::vector<BYTE> rumble_limit;
+		std::vector<BYTE> staged;
+		std::vector<const response_curves*> curves;
+		std::size_t used {0};
+
+		void grow();
+		void split_scalar(std::size_t from);
+		void sign_scalar(std::size_t from);
+		void scale_motors_scalar(std::size_t from);
+		void look_up_curves();
+	public:
+		// 'c' must outlive the slot; it shapes the slot's sticks and triggers
+		slot_id add(const response_curves& c, BYTE limit);
+
+		// A report's sticks and buttons, and the triggers' ramped levels
+		void stage(const slot_id s, const input_report& r, const BYTE left_trigger, const BYTE right_trigger) {
+			raw[0][s] = r.lx;
+			raw[1][s] = r.ly;
+			raw[2][s] = r.rx;
+			raw[3][s] = r.ry;
+			buttons[s] = r.buttons;
+			ramped[0][s] = left_trigger;
+			ramped[1][s] = right_trigger;
+			staged[s] = 1;
+		}
+
+		void set_motors(const slot_id s, const BYTE large, const BYTE small) {
+			requested[0][s] = large;
+			requested[1][s] = small;
+		}
+		void set_rumble_limit(const slot_id s, const BYTE limit) { rumble_limit[s] = limit; }
+
+		// Centres, scales and clamps every slot's sticks, then runs them and
+		// the triggers through each slot's curves
+		void process();
+		// process() without the vector kernels, for comparison
+		void process_scalar();
+
+		// Scales every slot's motor levels by its rumble limit
+		void scale_motors();
+		void scale_motors_scalar();
+
+		bool is_staged(const slot_id s) const { return staged[s] != 0; }
+		void clear(const slot_id s) { staged[s] = 0; }
+
+		std::size_t size() const { return used; }
+		SHORT axis(const slot_id s, const int i) const { return axes[i][s]; }
+		BYTE trigger(const slot_id s, const int i) const { return triggers[i][s]; }
+		button_mask pressed(const slot_id s) const { return buttons[s]; }
+		BYTE motor(const slot_id s, const int i) const { return motors[i][s]; }
+	};
+};
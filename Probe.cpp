@@ -0,0 +1,66 @@
+#include "Probe.hpp"
+
+#include <algorithm>
+
+namespace procon {
+	namespace {
+		std::uint32_t percentile(const rtt_stats& s, const std::uint64_t rank) {
+			std::uint64_t seen = 0;
+
+			for (std::size_t i = 0; i < rtt_buckets; ++i) {
+				seen += s.histogram[i];
+				if (seen >= rank)
+					return i + 1 == rtt_buckets ? s.max_us
+							: static_cast<std::uint32_t>((i + 1) * 1000);
+			}
+			return s.max_us;
+		}
+	}
+
+	bool rtt_probe::due(const std::uint64_t now_us) {
+		if (in_flight_us != 0 && now_us - in_flight_us >= cfg.timeout_ms * 1000ull) {
+			in_flight_us = 0;
+			++s.timeouts;
+		}
+		return in_flight_us == 0 && now_us >= next_us;
+	}
+
+	rtt_probe::request rtt_probe::send(const std::uint8_t counter,
+									   const std::array<uchar, 8>& rumble,
+									   const std::uint64_t now_us) {
+		request r;
+
+		r[0] = 0x01;
+		r[1] = static_cast<uchar>(counter & 0x0F);
+		std::copy(rumble.begin(), rumble.end(), r.begin() + 2);
+		r[10] = cfg.subcommand;
+
+		in_flight_us = now_us;
+		next_us = now_us + cfg.interval_ms * 1000ull;
+		++s.sent;
+		return r;
+	}
+
+	bool rtt_probe::reply(const input_report& r, const std::uint64_t now_us) {
+		if (in_flight_us == 0 || r.id != 0x21 || r.subcommand != cfg.subcommand)
+			return false;
+
+		record(static_cast<std::uint32_t>(now_us - in_flight_us));
+		in_flight_us = 0;
+		return true;
+	}
+
+	void rtt_probe::record(const std::uint32_t rtt_us) {
+		s.last_us = rtt_us;
+		s.min_us = s.answered == 0 ? rtt_us : std::min(s.min_us, rtt_us);
+		s.max_us = std::max(s.max_us, rtt_us);
+		++s.answered;
+		total_us += rtt_us;
+		s.mean_us = static_cast<float>(total_us) / s.answered;
+		++s.histogram[std::min<std::size_t>(rtt_us / 1000, rtt_buckets - 1)];
+
+		// Rank p of n is the ceil(p * n)th sample
+		s.p50_us = percentile(s, (s.answered + 1) / 2);
+		s.p99_us = percentile(s, (s.answered * 99 + 99) / 100);
+	}
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Common.hpp"
+#include "Report.hpp"
+
+namespace procon {
+	constexpr std::size_t rtt_buckets = 64; // 1 ms each, the last one open-ended
+
+	struct rtt_stats {
+		std::uint64_t sent;
+		std::uint64_t answered;
+		std::uint64_t timeouts;
+		std::uint32_t last_us, min_us, max_us;
+		std::uint32_t p50_us, p99_us; // upper edge of the bucket holding them
+		float mean_us;
+		std::uint32_t histogram[rtt_buckets];
+	};
+
+	// Measures what the radio link adds to latency by periodically sending a
+	// harmless subcommand and timing its 0x21 reply. One probe is in flight at
+	// a time and is matched by subcommand ID, so replies to LED or other
+	// subcommands are never mistaken for it.
+	class rtt_probe {
+	public:
+		struct config {
+			std::uint32_t interval_ms {1000};
+			std::uint32_t timeout_ms {500};
+			uchar subcommand {0x50}; // get regulated voltage: no side effects
+		};
+
+		// Output report 0x01: counter, 8 rumble bytes, subcommand
+		using request = std::array<uchar, 11>;
+
+	private:
+		config cfg;
+		rtt_stats s {};
+		std::uint64_t in_flight_us {0}; // 0 when nothing is outstanding
+		std::uint64_t next_us {0};
+		std::uint64_t total_us {0};
+
+		void record(std::uint32_t rtt_us);
+	public:
+		rtt_probe() = default;
+		explicit rtt_probe(const config& c) : cfg(c) {}
+
+		// True when a probe should go out; also expires a lost one
+		bool due(std::uint64_t now_us);
+
+		// Builds the probe and marks it sent. 'rumble' is the rumble data
+		// currently playing, so the probe doesn't interrupt it.
+		request send(std::uint8_t counter, const std::array<uchar, 8>& rumble,
+					 std::uint64_t now_us);
+
+		// Feed every decoded report; returns true if it answered the probe
+		bool reply(const input_report& r, std::uint64_t now_us);
+
+		const rtt_stats& stats() const { return s; }
+	};
+};
@@ -0,0 +1,36 @@
+#include "Profile.hpp"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+namespace procon {
+	namespace {
+		profile make_profile(std::string name, const bool positional,
+							 const std::uint8_t other) {
+			profile p;
+			p.name = std::move(name);
+			p.positional = positional;
+			p.gestures = {
+				// Capture: tap saves a screenshot, hold saves the instant replay
+				{gesture_type::tap, mask_of(button::capture),
+				 key_chord(VK_MENU, VK_F1)},
+				{gesture_type::hold, mask_of(button::capture),
+				 key_chord(VK_MENU, VK_F10)},
+				// Capture+Home flips to the other face button layout
+				{gesture_type::chord,
+				 mask_of(button::capture) | mask_of(button::home),
+				 profile_switch(other)},
+			};
+			return p;
+		}
+	}
+
+	std::vector<profile> default_profiles() {
+		return {
+			make_profile("label", false, 1),
+			make_profile("positional", true, 0),
+		};
+	}
+};
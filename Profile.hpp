@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "Curve.hpp"
+#include "Gesture.hpp"
+#include "Macro.hpp"
+
+namespace procon {
+	// Everything that changes how a controller is mapped. Switching profile
+	// at runtime (see action_type::profile_switch) reloads the mapping stage.
+	struct profile {
+		std::string name;
+		bool positional {false}; // A/B/X/Y follow the Xbox layout by position, not label
+		gesture_timing timing;
+		std::vector<gesture> gestures;
+		// Virtual-key code held down for as long as the button is, 0 = none
+		std::array<std::uint8_t, button_count> keys {};
+		std::array<curve, 4> sticks;   // lx, ly, rx, ry
+		std::array<curve, 2> triggers; // left, right
+		// ZL/ZR are digital; a ramp makes them sweep like an analog pull
+		std::array<trigger_ramp, 2> trigger_ramps;
+		std::vector<macro> macros; // started by action_type::macro
+		std::vector<turbo> turbos;
+	};
+
+	// The built-in profiles: 0 maps face buttons by label, 1 by position.
+	std::vector<profile> default_profiles();
+};
@@ -0,0 +1,265 @@
+#include "Reactor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "Clock.hpp"
+#include "Trace.hpp"
+
+namespace procon {
+	constexpr std::size_t reactor::max_batch;
+	constexpr std::size_t reactor::max_writes;
+	constexpr std::size_t reactor::default_read_depth;
+
+	namespace {
+		// Completion keys are device pointers, except for these
+		constexpr ULONG_PTR stop_key = 0;
+		constexpr ULONG_PTR post_key = 1;
+		constexpr ULONG_PTR wake_key = 2;
+	}
+
+	reactor::reactor()
+			: port(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1)),
+			  writes(new operation[max_writes]()),
+			  write_buffers(new std::array<uchar, 64>[max_writes]()),
+			  free_writes(nullptr) {
+		if (port == nullptr)
+			throw std::runtime_error("unable to create an I/O completion port");
+
+		for (std::size_t i = 0; i < max_writes; ++i) {
+			writes[i].data = write_buffers[i].data();
+			writes[i].next_free = free_writes;
+			free_writes = &writes[i];
+		}
+	}
+
+	reactor::~reactor() {
+		for (auto& d : devices)
+			CancelIoEx(d->handle, nullptr);
+
+		// Cancelling only asks: every operation still completes, into its
+		// OVERLAPPED and buffer, and posts to the port. Nothing may be freed
+		// until each of those completions has been dequeued.
+		const auto drained = drain();
+		for (auto& d : devices)
+			CloseHandle(d->handle);
+		if (!drained) {
+			// The port broke with I/O outstanding; leaking the buffers it
+			// may still land in is the only safe thing left
+			for (auto& d : devices)
+				d.release();
+			writes.release();
+			write_buffers.release();
+		}
+		CloseHandle(port);
+	}
+
+	bool reactor::drain() {
+		OVERLAPPED_ENTRY entries[max_batch];
+		while (in_flight.load() != 0) {
+			ULONG n = 0;
+			if (!GetQueuedCompletionStatusEx(port, entries, max_batch, &n, INFINITE, FALSE))
+				return false;
+			for (ULONG i = 0; i < n; ++i)
+				// stop(), post() and wake() carry no OVERLAPPED
+				if (entries[i].lpOverlapped != nullptr)
+					--in_flight;
+		}
+		return true;
+	}
+
+	reactor::device_id reactor::add(const HANDLE handle, const std::size_t input_length,
+									const std::size_t output_length, report_handler& h,
+									const std::size_t read_depth) {
+		if (output_length > std::tuple_size<std::array<uchar, 64>>::value)
+			throw std::runtime_error("output reports longer than 64 bytes aren't supported");
+
+		std::unique_ptr<device> d(new device);
+		d->handle = handle;
+		d->handler = &h;
+		d->input_length = input_length;
+		d->output_length = output_length;
+		d->depth = std::max<std::size_t>(1, read_depth);
+		d->reads.reset(new operation[d->depth]());
+		d->buffers.reset(new uchar[d->depth * input_length]);
+		for (std::size_t i = 0; i < d->depth; ++i) {
+			auto& op = d->reads[i];
+			op.is_read = true;
+			op.target = d.get();
+			op.data = d->buffers.get() + i * input_length;
+		}
+
+		// The device pointer is the completion key
+		if (CreateIoCompletionPort(handle, port, reinterpret_cast<ULONG_PTR>(d.get()), 0) == nullptr)
+			throw std::runtime_error("unable to associate a device with the completion port");
+
+		devices.push_back(std::move(d));
+		// Added from a posted function: its reads start now
+		if (running)
+			for (std::size_t i = 0; i < devices.back()->depth && !devices.back()->dead; ++i)
+				queue_read(devices.back()->reads[i]);
+		return devices.size() - 1;
+	}
+
+	bool reactor::queue_read(operation& op) {
+		auto& d = *op.target;
+
+		std::memset(&op.ol, 0, sizeof op.ol);
+		++calls.reads;
+		++in_flight;
+		if (ReadFile(d.handle, op.data, static_cast<DWORD>(d.input_length), nullptr, &op.ol))
+			return true; // completed already; the completion is still queued
+		const auto error = GetLastError();
+		if (error == ERROR_IO_PENDING)
+			return true;
+		--in_flight; // failed outright, so nothing is posted
+		fail(d, error);
+		return false;
+	}
+
+	void reactor::fail(device& d, const DWORD error) {
+		if (d.dead)
+			return;
+		d.dead = true;
+		trace::emit(trace::event::error, error);
+		d.handler->on_error(error);
+	}
+
+	void reactor::release(operation* op) {
+		std::lock_guard<std::mutex> lk(write_mutex);
+		op->next_free = free_writes;
+		free_writes = op;
+	}
+
+	bool reactor::write(const device_id id, const uchar* data, const std::size_t size) {
+		if (id >= devices.size() || devices[id]->dead)
+			return false;
+		auto& d = *devices[id];
+
+		operation* op;
+		{
+			std::lock_guard<std::mutex> lk(write_mutex);
+			op = free_writes;
+			if (op == nullptr)
+				return false;
+			free_writes = op->next_free;
+			++calls.writes;
+		}
+
+		std::memset(&op->ol, 0, sizeof op->ol);
+		op->target = &d;
+		const auto n = std::min(size, d.output_length);
+		std::memcpy(op->data, data, n);
+		std::memset(op->data + n, 0, d.output_length - n);
+
+		++in_flight;
+		if (!WriteFile(d.handle, op->data, static_cast<DWORD>(d.output_length),
+					   nullptr, &op->ol) && GetLastError() != ERROR_IO_PENDING) {
+			--in_flight;
+			release(op);
+			return false;
+		}
+		return true;
+	}
+
+	void reactor::run_posted() {
+		std::vector<std::function<void()>> run;
+		{
+			std::lock_guard<std::mutex> lk(post_mutex);
+			run.swap(posted);
+		}
+		for (auto& f : run)
+			f();
+	}
+
+	void reactor::run(const DWORD tick_ms, const std::function<void(std::uint64_t)>& tick) {
+		for (auto& d : devices)
+			for (std::size_t i = 0; i < d->depth && !d->dead; ++i)
+				queue_read(d->reads[i]);
+		running = true;
+		run_posted();
+
+		OVERLAPPED_ENTRY entries[max_batch];
+		std::vector<device*> touched;
+		touched.reserve(devices.size());
+
+		while (!stopping.load(std::memory_order_relaxed)) {
+			ULONG n = 0;
+			++calls.waits;
+			if (!GetQueuedCompletionStatusEx(port, entries, max_batch, &n, tick_ms, FALSE))
+				n = 0; // timed out
+			calls.completions += n;
+
+			const auto now = clock_us();
+			for (ULONG i = 0; i < n; ++i) {
+				const auto& e = entries[i];
+				if (e.lpCompletionKey == stop_key)
+					continue; // stop(); the loop condition sees it
+				if (e.lpCompletionKey == post_key) {
+					run_posted();
+					continue;
+				}
+				if (e.lpCompletionKey == wake_key)
+					continue; // the tick below is what it's for
+
+				auto& d = *reinterpret_cast<device*>(e.lpCompletionKey);
+				auto& op = *reinterpret_cast<operation*>(e.lpOverlapped);
+				--in_flight;
+				// Internal holds the NTSTATUS of the operation
+				const auto failed = op.ol.Internal != 0;
+
+				if (!op.is_read) {
+					release(&op);
+					continue;
+				}
+				if (failed) {
+					fail(d, static_cast<DWORD>(op.ol.Internal));
+					continue;
+				}
+				if (d.dead)
+					continue; // a read queued before another one failed
+
+				// Reads on one handle complete in the order they were queued,
+				// and the port keeps that order
+				trace::emit(trace::event::report_received, e.dwNumberOfBytesTransferred);
+				d.handler->on_report(op.data, e.dwNumberOfBytesTransferred, now);
+				if (!d.touched) {
+					d.touched = true;
+					touched.push_back(&d);
+				}
+				queue_read(op);
+			}
+
+			for (auto* d : touched) {
+				d->touched = false;
+				d->handler->on_batch_end(now);
+			}
+			touched.clear();
+
+			if (tick)
+				tick(now);
+		}
+		// What was posted before stop() still runs; devices it adds are
+		// closed with the rest but never read
+		running = false;
+		run_posted();
+	}
+
+	void reactor::stop() {
+		stopping = true;
+		PostQueuedCompletionStatus(port, 0, stop_key, nullptr);
+	}
+
+	void reactor::wake() {
+		PostQueuedCompletionStatus(port, 0, wake_key, nullptr);
+	}
+
+	void reactor::post(std::function<void()> f) {
+		{
+			std::lock_guard<std::mutex> lk(post_mutex);
+			posted.push_back(std::move(f));
+		}
+		PostQueuedCompletionStatus(port, 0, post_key, nullptr);
+	}
+};
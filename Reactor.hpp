@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include "Common.hpp"
+#include "Transport.hpp"
+
+namespace procon {
+	// Receives what the reactor reads from one device, on the reactor thread
+	class report_handler {
+	public:
+		virtual ~report_handler() = default;
+
+		virtual void on_report(const uchar* data, std::size_t size, std::uint64_t now_us) = 0;
+		// After a wakeup that delivered at least one report to this handler
+		virtual void on_batch_end(std::uint64_t now_us) = 0;
+		// The device stopped reading (unplugged, usually); no more calls follow
+		virtual void on_error(DWORD error) = 0;
+	};
+
+	// One thread multiplexing every controller's I/O on a completion port.
+	// Each device keeps several overlapped reads queued, so reports that
+	// arrive back to back complete without waiting for a read to be issued;
+	// a wakeup dequeues every completion that is ready, hands each report to
+	// its handler inline and queues that read again. Writes complete on the
+	// same port, so a busy rig costs one wait per batch rather than one per
+	// report.
+	class reactor {
+	public:
+		using device_id = std::size_t;
+		static constexpr std::size_t max_batch = 64;
+		static constexpr std::size_t max_writes = 64; // in flight across all devices
+		static constexpr std::size_t default_read_depth = 4;
+
+		// System calls made so far; exact once run() has returned
+		struct counters {
+			std::uint64_t waits;       // GetQueuedCompletionStatusEx
+			std::uint64_t completions; // reads and writes dequeued
+			std::uint64_t reads;       // ReadFile
+			std::uint64_t writes;      // WriteFile
+		};
+
+	private:
+		struct device;
+
+		// OVERLAPPED first: a dequeued OVERLAPPED* is the operation
+		struct operation {
+			OVERLAPPED ol;
+			bool is_read;
+			device* target;
+			uchar* data;
+			operation* next_free; // writes only
+		};
+
+		struct device {
+			HANDLE handle;
+			report_handler* handler;
+			std::size_t input_length;
+			std::size_t output_length;
+			std::size_t depth;
+			std::unique_ptr<operation[]> reads;
+			std::unique_ptr<uchar[]> buffers; // 'depth' input reports, back to back
+			bool touched {false};
+			bool dead {false};
+		};
+
+		HANDLE port;
+		std::vector<std::unique_ptr<device>> devices;
+		std::unique_ptr<operation[]> writes;
+		std::unique_ptr<std::array<uchar, 64>[]> write_buffers;
+		operation* free_writes;
+		std::mutex write_mutex; // writes may come from other threads
+		std::vector<std::function<void()>> posted;
+		std::mutex post_mutex;
+		std::atomic<bool> stopping {false};
+		// Reads and writes issued whose completion hasn't been dequeued yet;
+		// the kernel may still write into their OVERLAPPED and buffer
+		std::atomic<std::size_t> in_flight {0};
+		bool running {false}; // reactor thread only
+		counters calls {};
+
+		bool queue_read(operation& op);
+		void fail(device& d, DWORD error);
+		void release(operation* op);
+		void run_posted();
+		bool drain();
+	public:
+		reactor();
+		reactor(const reactor&) = delete;
+		reactor& operator=(const reactor&) = delete;
+		// Cancels outstanding I/O, waits for every cancelled operation to
+		// complete and closes every device handle. Call it once run() has
+		// returned and nothing else writes.
+		~reactor();
+
+		// Takes ownership of 'handle', which must be opened with
+		// FILE_FLAG_OVERLAPPED, and keeps 'read_depth' reads queued on it
+		// once run() starts. Call it before run() or, once running, from a
+		// posted function. Throws std::runtime_error if the handle can't
+		// join the port.
+		device_id add(HANDLE handle, std::size_t input_length, std::size_t output_length,
+					  report_handler& h, std::size_t read_depth = default_read_depth);
+
+		// Overlapped write padded to the device's output report length; false
+		// if the device is gone or too many writes are in flight
+		bool write(device_id id, const uchar* data, std::size_t size);
+
+		// Runs until stop(). 'tick' is called after every wakeup and at least
+		// every 'tick_ms' when nothing arrives.
+		void run(DWORD tick_ms, const std::function<void(std::uint64_t now_us)>& tick);
+
+		// Any thread
+		void stop();
+
+		// Any thread: 'tick' runs now rather than at the next wakeup or
+		// timeout. Costs no allocation, unlike post().
+		void wake();
+
+		// Any thread: runs 'f' on the reactor thread at its next wakeup, or
+		// as soon as run() starts. For setup, such as adding a device whose
+		// handshake finished after the reactor started. Whatever is posted
+		// before stop() runs before run() returns.
+		void post(std::function<void()> f);
+
+		const counters& syscalls() const { return calls; }
+	};
+
+	// Output side of a reactor-managed device: reports arrive through the
+	// reactor, so read() never has anything
+	class reactor_transport : public transport {
+		reactor& r;
+		reactor::device_id id;
+	public:
+		reactor_transport(reactor& owner, const reactor::device_id device)
+				: r(owner), id(device) {}
+
+		int read(uchar*, std::size_t) override { return 0; }
+
+		int write(const uchar* data, const std::size_t size) override {
+			return r.write(id, data, size) ? static_cast<int>(size) : -1;
+		}
+	};
+};
@@ -0,0 +1,134 @@
+#include "Report.hpp"
+
+#include <cstring>
+
+namespace procon {
+	namespace {
+		using mask_table = std::array<button_mask, 256>;
+
+		mask_table make_table(const std::array<button, 8>& bitmap) {
+			mask_table t {};
+
+			for (unsigned v = 0; v < 256; ++v)
+				for (unsigned bit = 0; bit < 8; ++bit)
+					if (v >> bit & 1u)
+						t[v] |= mask_of(bitmap[bit]);
+			return t;
+		}
+
+		const mask_table right_buttons = make_table(joycon_r_bitmap);
+		const mask_table middle_buttons = make_table(joycon_mid_bitmap);
+		const mask_table left_buttons = make_table(joycon_l_bitmap);
+
+		void decode_stick(const uchar* d, std::uint16_t& x, std::uint16_t& y) {
+			x = static_cast<std::uint16_t>(d[0] | (d[1] & 0x0F) << 8);
+			y = static_cast<std::uint16_t>(d[1] >> 4 | d[2] << 4);
+		}
+
+		std::int16_t le16(const uchar* d) {
+			return static_cast<std::int16_t>(d[0] | d[1] << 8);
+		}
+
+		// Simple HID mode: the button order DirectInput shows, then the
+		// d-pad as a hat
+		const std::array<button, 16> simple_bitmap = {
+			button::b, button::a, button::y, button::x,
+			button::l, button::r, button::zl, button::zr,
+			button::minus, button::plus, button::left_stick, button::right_stick,
+			button::home, button::capture, button::none, button::none,
+		};
+
+		// Hat values 0 (up) .. 7 clockwise; 8 is centred
+		const std::array<button_mask, 9> hat_buttons = {
+			mask_of(button::d_pad_up),
+			mask_of(button::d_pad_up) | mask_of(button::d_pad_right),
+			mask_of(button::d_pad_right),
+			mask_of(button::d_pad_down) | mask_of(button::d_pad_right),
+			mask_of(button::d_pad_down),
+			mask_of(button::d_pad_down) | mask_of(button::d_pad_left),
+			mask_of(button::d_pad_left),
+			mask_of(button::d_pad_up) | mask_of(button::d_pad_left),
+			0,
+		};
+
+		std::uint16_t simple_axis(const uchar* d, const bool invert) {
+			// 16-bit little endian to the full mode's 12 bits; y grows
+			// downwards here and upwards there
+			const auto v = static_cast<std::uint16_t>((d[0] | d[1] << 8) >> 4);
+			return invert ? static_cast<std::uint16_t>(4095 - v) : v;
+		}
+	}
+
+	bool decode_report(const uchar* data, const std::size_t size, input_report& out) {
+		if (size != 0 && data[0] == static_cast<uchar>(report_mode::simple))
+			return decode_simple_report(data, size, out);
+		return decode_full_report(data, size, out);
+	}
+
+	button_mask decode_buttons(const uchar* d) {
+		return right_buttons[d[0]] | middle_buttons[d[1]] | left_buttons[d[2]];
+	}
+
+	report_decoder decoder_for(const report_mode mode) {
+		return mode == report_mode::simple ? decode_simple_report : decode_full_report;
+	}
+
+	bool decode_simple_report(const uchar* data, const std::size_t size, input_report& out) {
+		if (size == 0 || data[0] != static_cast<uchar>(report_mode::simple))
+			return decode_full_report(data, size, out) && out.id == 0x21;
+
+		std::memset(&out, 0, sizeof out);
+		if (size < 12)
+			return false;
+
+		out.id = data[0];
+		const auto bits = static_cast<unsigned>(data[1] | data[2] << 8);
+		for (unsigned bit = 0; bit < simple_bitmap.size(); ++bit)
+			if (bits >> bit & 1u)
+				out.buttons |= mask_of(simple_bitmap[bit]);
+		out.buttons |= hat_buttons[data[3] < hat_buttons.size() ? data[3] : 8];
+
+		out.lx = simple_axis(data + 4, false);
+		out.ly = simple_axis(data + 6, true);
+		out.rx = simple_axis(data + 8, false);
+		out.ry = simple_axis(data + 10, true);
+		return true;
+	}
+
+	bool decode_full_report(const uchar* data, const std::size_t size, input_report& out) {
+		std::memset(&out, 0, sizeof out);
+
+		if (size < 13)
+			return false;
+
+		out.id = data[0];
+		if (out.id != 0x30 && out.id != 0x21 && out.id != 0x31)
+			return false;
+
+		out.timer = data[1];
+		out.battery = static_cast<uchar>(data[2] >> 5);
+		out.charging = static_cast<uchar>(data[2] >> 4 & 1);
+		out.connection = static_cast<uchar>(data[2] & 0x0F);
+		out.buttons = decode_buttons(data + 3);
+		decode_stick(data + 6, out.lx, out.ly);
+		decode_stick(data + 9, out.rx, out.ry);
+
+		if (out.id == 0x21) {
+			if (size >= 15) {
+				out.ack = data[13];
+				out.subcommand = data[14];
+			}
+		} else if (size >= input_report_size) {
+			for (auto i = 0; i < 3; ++i) {
+				const auto* s = data + 13 + 12 * i;
+
+				for (auto axis = 0; axis < 3; ++axis) {
+					out.imu[i].accel[axis] = le16(s + 2 * axis);
+					out.imu[i].gyro[axis] = le16(s + 6 + 2 * axis);
+				}
+			}
+		}
+
+		return true;
+	}
+};
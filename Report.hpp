@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.hpp"
+
+namespace procon {
+	constexpr std::size_t input_report_size = 49;
+
+	// Input report mode set with subcommand 0x03. A Pro Controller starts
+	// out in simple HID mode; full mode adds the timer, 12-bit sticks and
+	// the IMU.
+	enum class report_mode : uchar {
+		full = 0x30,
+		simple = 0x3F,
+	};
+
+	struct imu_sample {
+		std::int16_t accel[3];
+		std::int16_t gyro[3];
+	};
+
+	// One decoded input report. Plain data with a fixed layout, so it can be
+	// copied into shared memory or capture files as-is.
+	struct input_report {
+		uchar id;         // 0x30/0x31 full, 0x3F simple, 0x21 subcommand reply
+		uchar timer;      // increments with every report the controller sends;
+						  // simple reports have none and leave it 0
+		uchar battery;    // 0 (empty) .. 4 (full); not in simple reports
+		uchar charging;
+		uchar connection; // low nibble of the battery byte
+		uchar subcommand; // 0x21 only: the subcommand being acknowledged
+		uchar ack;        // 0x21 only: ack byte, bit 7 set on success
+		uchar reserved;
+		button_mask buttons;
+		// Raw 12-bit stick travel, 0..4095 with rest near 2048
+		std::uint16_t lx, ly, rx, ry;
+		imu_sample imu[3]; // 0x30 only: three samples 5 ms apart
+	};
+
+	// Decodes a report as returned by hid_read (report ID first). Returns
+	// false if the report is too short or not a type we understand.
+	bool decode_report(const uchar* data, std::size_t size, input_report& out);
+
+	// Decoders for one report mode, each also taking 0x21 subcommand replies.
+	// A connection picks one once it knows its mode, so reports of the wrong
+	// kind are rejected rather than misread.
+	using report_decoder = bool (*)(const uchar* data, std::size_t size, input_report& out);
+
+	bool decode_full_report(const uchar* data, std::size_t size, input_report& out);
+	bool decode_simple_report(const uchar* data, std::size_t size, input_report& out);
+
+	// A full report's three button bytes (data + 3) as a button_mask
+	button_mask decode_buttons(const uchar* d);
+
+	report_decoder decoder_for(report_mode mode);
+};
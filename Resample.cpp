@@ -0,0 +1,145 @@
+#include "Resample.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace procon {
+	constexpr std::size_t resampler::stick_axes;
+	constexpr std::size_t resampler::imu_axes;
+	constexpr std::size_t resampler::imu_history;
+	constexpr std::uint32_t resampler::imu_period_us;
+
+	namespace {
+		constexpr double smooth = 1.0 / 16;
+
+		template<class T>
+		T clamp_to(const float v, const float lo, const float hi) {
+			return static_cast<T>(std::lround(std::max(lo, std::min(hi, v))));
+		}
+
+		// 'back' before 't', or 0 for a moment before the clock started
+		std::uint64_t since(const std::uint64_t t, const std::uint64_t back) {
+			return t > back ? t - back : 0;
+		}
+	}
+
+	template<std::size_t N>
+	std::array<float, N> resampler::lerp(const std::array<float, N>& a, const std::array<float, N>& b,
+										 const double f) {
+		std::array<float, N> out;
+		for (std::size_t i = 0; i < N; ++i)
+			out[i] = static_cast<float>(a[i] + (b[i] - a[i]) * f);
+		return out;
+	}
+
+	template<std::size_t N>
+	std::array<float, N> resampler::extrapolate(const std::array<float, N>& prev, const std::array<float, N>& last,
+												const double steps) const {
+		// Carrying on along the last step, never more than 'overshoot' of
+		// it: when the stick stops or turns, that's as far as it goes wrong
+		return lerp(prev, last, 1 + std::min(steps, static_cast<double>(cfg.overshoot)));
+	}
+
+	void resampler::add(const input_report& r, const std::uint64_t arrived_us) {
+		const point p {arrived_us, {{static_cast<float>(r.lx), static_cast<float>(r.ly),
+									 static_cast<float>(r.rx), static_cast<float>(r.ry)}}};
+
+		if (reports++ == 0) {
+			sticks = {{p, p}};
+		} else {
+			if (arrived_us > sticks[1].t) {
+				const auto interval = static_cast<double>(arrived_us - sticks[1].t);
+				interval_us = interval_us == 0 ? interval : interval_us + (interval - interval_us) * smooth;
+			}
+			sticks[0] = sticks[1];
+			sticks[1] = p;
+		}
+		newest = r;
+
+		// Subcommand replies and simple reports carry no IMU data
+		if (r.id != 0x30 && r.id != 0x31)
+			return;
+
+		// Reports read in one batch share an arrival time, and Bluetooth ones
+		// may come closer together than their three samples span. Samples
+		// are kept strictly in order regardless, which imu_at() relies on.
+		auto after = imu_count == 0 ? 0 : imu.back().t + 1;
+		std::rotate(imu.begin(), imu.begin() + 3, imu.end());
+		for (std::size_t i = 0; i < 3; ++i) {
+			auto& s = imu[imu_history - 3 + i];
+			s.t = std::max(since(arrived_us, (2 - i) * imu_period_us), after);
+			after = s.t + 1;
+			for (std::size_t axis = 0; axis < 3; ++axis) {
+				s.v[axis] = r.imu[i].accel[axis];
+				s.v[3 + axis] = r.imu[i].gyro[axis];
+			}
+		}
+		imu_count = std::min(imu_history, imu_count + 3);
+	}
+
+	std::array<float, resampler::imu_axes> resampler::imu_at(const std::uint64_t t) const {
+		const auto first = imu.begin() + (imu_history - imu_count);
+		const auto& last = imu.back();
+
+		if (t >= last.t) {
+			if (cfg.mode != resample_mode::extrapolate || imu_count < 2)
+				return last.v;
+			const auto ahead = std::min<std::uint64_t>(t - last.t, cfg.horizon_us);
+			return extrapolate(imu[imu_history - 2].v, last.v, static_cast<double>(ahead) / imu_period_us);
+		}
+		if (t <= first->t)
+			return first->v;
+
+		const auto next = std::upper_bound(first, imu.end(), t,
+			[](const std::uint64_t at, const imu_point& p) { return at < p.t; });
+		const auto& a = *(next - 1);
+		const auto& b = *next;
+		return lerp(a.v, b.v, static_cast<double>(t - a.t) / (b.t - a.t));
+	}
+
+	bool resampler::sample(const std::uint64_t at_us, input_report& out) const {
+		if (reports == 0)
+			return false;
+		out = newest;
+		if (!enabled())
+			return true;
+
+		const auto& prev = sticks[0];
+		const auto& last = sticks[1];
+		std::array<float, stick_axes> v;
+		std::uint64_t imu_t;
+
+		if (cfg.mode == resample_mode::interpolate) {
+			// One interval back, the two newest reports bracket the moment
+			const auto delay = static_cast<std::uint64_t>(interval_us);
+			const auto t = at_us > delay ? at_us - delay : 0;
+			if (t >= last.t || last.t == prev.t)
+				v = last.v;
+			else if (t <= prev.t)
+				v = prev.v;
+			else
+				v = lerp(prev.v, last.v, static_cast<double>(t - prev.t) / (last.t - prev.t));
+			imu_t = t;
+		} else {
+			const auto ahead = at_us > last.t ? std::min<std::uint64_t>(at_us - last.t, cfg.horizon_us) : 0;
+			v = interval_us > 0 ? extrapolate(prev.v, last.v, ahead / interval_us) : last.v;
+			imu_t = last.t + ahead;
+		}
+
+		out.lx = clamp_to<std::uint16_t>(v[0], 0, 4095);
+		out.ly = clamp_to<std::uint16_t>(v[1], 0, 4095);
+		out.rx = clamp_to<std::uint16_t>(v[2], 0, 4095);
+		out.ry = clamp_to<std::uint16_t>(v[3], 0, 4095);
+
+		if (imu_count == 0)
+			return true;
+		for (std::size_t i = 0; i < 3; ++i) {
+			const auto s = imu_at(since(imu_t, (2 - i) * imu_period_us));
+			for (std::size_t axis = 0; axis < 3; ++axis) {
+				out.imu[i].accel[axis] = clamp_to<std::int16_t>(s[axis], -32768, 32767);
+				out.imu[i].gyro[axis] = clamp_to<std::int16_t>(s[3 + axis], -32768, 32767);
+			}
+		}
+		return true;
+	}
+};
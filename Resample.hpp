@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Report.hpp"
+
+namespace procon {
+	enum class resample_mode {
+		off,         // each report is submitted as it's read
+		interpolate, // one report interval behind, between the reports around it
+		extrapolate, // ahead of the newest report, along its last step
+	};
+
+	struct resample_config {
+		resample_mode mode {resample_mode::off};
+		std::uint32_t output_hz {250};
+		// Furthest extrapolation reaches past the newest report
+		std::uint32_t horizon_us {8000};
+		// Extrapolation moves an axis at most this fraction of its last step
+		float overshoot {0.5f};
+	};
+
+	// Stick and IMU state at any moment, from timestamped reports, so the
+	// pad can be submitted on a steady cadence of its own instead of
+	// whenever a report happens to arrive. Interpolation trades one report
+	// interval of delay for output that never leaves the path the stick
+	// took; extrapolation has no added delay and overshoots by a bounded
+	// amount when the stick turns.
+	class resampler {
+		static constexpr std::size_t stick_axes = 4;  // lx, ly, rx, ry
+		static constexpr std::size_t imu_axes = 6;    // accel xyz, gyro xyz
+		static constexpr std::size_t imu_history = 6; // two reports' worth
+		static constexpr std::uint32_t imu_period_us = 5000;
+
+		struct point {
+			std::uint64_t t;
+			std::array<float, stick_axes> v;
+		};
+
+		struct imu_point {
+			std::uint64_t t;
+			std::array<float, imu_axes> v;
+		};
+
+		resample_config cfg;
+		input_report newest {};
+		std::array<point, 2> sticks {};        // previous and newest report
+		std::array<imu_point, imu_history> imu {}; // oldest first
+		std::size_t reports {0};
+		std::size_t imu_count {0};
+		double interval_us {0}; // smoothed time between reports
+
+		template<std::size_t N>
+		static std::array<float, N> lerp(const std::array<float, N>& a, const std::array<float, N>& b, double f);
+
+		template<std::size_t N>
+		std::array<float, N> extrapolate(const std::array<float, N>& prev, const std::array<float, N>& last,
+										 double steps) const;
+
+		std::array<float, imu_axes> imu_at(std::uint64_t t) const;
+	public:
+		resampler() = default;
+		explicit resampler(const resample_config& c) : cfg(c) {}
+
+		const resample_config& config() const { return cfg; }
+		bool enabled() const { return cfg.mode != resample_mode::off && cfg.output_hz != 0; }
+		std::uint64_t period_us() const { return 1000000 / cfg.output_hz; }
+
+		// Call for every decoded report, in arrival order
+		void add(const input_report& r, std::uint64_t arrived_us);
+
+		// The newest report with its sticks and IMU moved to 'at_us'. False
+		// until a report has arrived. With resampling off, the newest report
+		// as it is.
+		bool sample(std::uint64_t at_us, input_report& out) const;
+	};
+};
@@ -0,0 +1,86 @@
+#include "SharedState.hpp"
+
+#include <cstring>
+#include <new>
+
+namespace procon {
+	state_publisher::~state_publisher() {
+		if (view != nullptr)
+			UnmapViewOfFile(view);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+	}
+
+	bool state_publisher::open() {
+		if (view != nullptr)
+			return true;
+
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+				0, sizeof(shared::region), shared::region_name);
+		if (mapping == nullptr)
+			return false;
+		// Another driver is publishing there; resetting its sequences under
+		// it would break every reader's snapshot
+		if (GetLastError() == ERROR_ALREADY_EXISTS) {
+			CloseHandle(mapping);
+			mapping = nullptr;
+			SetLastError(ERROR_ALREADY_EXISTS);
+			return false;
+		}
+
+		view = static_cast<shared::region*>(MapViewOfFile(mapping,
+				FILE_MAP_ALL_ACCESS, 0, 0, sizeof(shared::region)));
+		if (view == nullptr) {
+			CloseHandle(mapping);
+			mapping = nullptr;
+			return false;
+		}
+
+		// A fresh mapping is zero-filled. Claim it by writing the header last,
+		// so readers never accept a region that is still being set up.
+		for (auto& s : view->slots)
+			new (&s.sequence) std::atomic<std::uint32_t>(0);
+		view->max_controllers = shared::max_controllers;
+		view->size = sizeof(shared::region);
+		view->version = shared::region_version;
+		std::atomic_thread_fence(std::memory_order_release);
+		view->magic = shared::region_magic;
+		return true;
+	}
+
+	void state_publisher::publish(const std::size_t index,
+								  const shared::controller_state& s) {
+		if (view == nullptr || index >= shared::max_controllers)
+			return;
+
+		auto& slot = view->slots[index];
+		const auto seq = slot.sequence.load(std::memory_order_relaxed);
+
+		slot.sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&slot.state, &s, sizeof s);
+		slot.sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	bool read_shared_state(const shared::region& r, const std::size_t index,
+						   shared::controller_state& out, const int attempts) {
+		if (r.magic != shared::region_magic || r.version != shared::region_version
+		 || r.size != sizeof(shared::region) || index >= r.max_controllers
+		 || index >= shared::max_controllers)
+			return false;
+
+		const auto& slot = r.slots[index];
+
+		for (auto i = 0; i < attempts; ++i) {
+			const auto before = slot.sequence.load(std::memory_order_acquire);
+
+			if (before & 1u)
+				continue;
+			std::memcpy(&out, &slot.state, sizeof out);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == before)
+				return true;
+		}
+		return false;
+	}
+};
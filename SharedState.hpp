@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <Xinput.h>
+
+#include "LinkStats.hpp"
+#include "Probe.hpp"
+#include "Report.hpp"
+
+namespace procon {
+	// Live controller state published for overlays and telemetry tools.
+	// Readers open the mapping by name and copy a slot out with
+	// read_shared_state(); nothing they do reaches the forwarding thread.
+	namespace shared {
+		constexpr char region_name[] = "Local\\ProconXInput.State";
+		constexpr std::uint32_t region_magic = 0x49584350; // "PCXI"
+		constexpr std::uint32_t region_version = 3;
+		constexpr std::size_t max_controllers = 8;
+
+		struct latency {
+			std::uint64_t last_report_us; // clock_us() when the last report arrived
+			std::uint64_t reports;        // reports decoded
+			std::uint64_t submits;        // pad states sent to the bus
+			std::uint32_t map_us;         // report arrival -> submit started
+			std::uint32_t submit_us;      // duration of the submit call
+		};
+
+		struct controller_state {
+			std::uint32_t connected;
+			std::uint32_t user_index; // virtual bus slot
+			input_report raw;
+			XINPUT_GAMEPAD pad;
+			latency timing;
+			link_stats link;
+			rtt_stats rtt; // empty unless probing
+		};
+
+		// Seqlock: odd while the writer is inside, bumped by 2 per publish
+		struct alignas(64) slot {
+			std::atomic<std::uint32_t> sequence;
+			controller_state state;
+		};
+
+		struct region {
+			std::uint32_t magic;
+			std::uint32_t version;
+			std::uint32_t size; // sizeof(region), catches layout mismatches
+			std::uint32_t max_controllers;
+			slot slots[shared::max_controllers];
+		};
+	};
+
+	// Owns the named region. If it can't be created, publishing is a no-op;
+	// telemetry is never worth failing the driver over.
+	class state_publisher {
+		HANDLE mapping {nullptr};
+		shared::region* view {nullptr};
+	public:
+		state_publisher() = default;
+		state_publisher(const state_publisher&) = delete;
+		state_publisher& operator=(const state_publisher&) = delete;
+		~state_publisher();
+
+		// Returns false (and stays a no-op) if the region can't be created
+		// or another instance already owns it
+		bool open();
+		bool is_open() const { return view != nullptr; }
+
+		// Single writer per slot
+		void publish(std::size_t index, const shared::controller_state& s);
+	};
+
+	// Copies a consistent snapshot of slot 'index' out of a mapped region.
+	// Returns false if the region's version or layout isn't this build's,
+	// or if the writer kept it busy for every attempt.
+	bool read_shared_state(const shared::region& r, std::size_t index,
+						   shared::controller_state& out, int attempts = 64);
+};
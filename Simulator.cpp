@@ -0,0 +1,223 @@
+#include "Simulator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Clock.hpp"
+
+namespace procon {
+	constexpr std::size_t simulated_controller::max_queued;
+
+	namespace {
+		void encode_stick(uchar* d, const unsigned x, const unsigned y) {
+			d[0] = static_cast<uchar>(x & 0xFF);
+			d[1] = static_cast<uchar>(x >> 8 | (y & 0x0F) << 4);
+			d[2] = static_cast<uchar>(y >> 4);
+		}
+
+		void put_le16(uchar* d, const unsigned v) {
+			d[0] = static_cast<uchar>(v & 0xFF);
+			d[1] = static_cast<uchar>(v >> 8);
+		}
+
+		// Rewrites a full report's input as the simple HID layout
+		template<std::size_t N>
+		void to_simple(std::array<uchar, N>& d) {
+			static const std::array<button, 14> order = {
+				button::b, button::a, button::y, button::x, button::l, button::r,
+				button::zl, button::zr, button::minus, button::plus,
+				button::left_stick, button::right_stick, button::home, button::capture,
+			};
+			static const std::array<button_mask, 8> hat = {
+				mask_of(button::d_pad_up),
+				mask_of(button::d_pad_up) | mask_of(button::d_pad_right),
+				mask_of(button::d_pad_right),
+				mask_of(button::d_pad_down) | mask_of(button::d_pad_right),
+				mask_of(button::d_pad_down),
+				mask_of(button::d_pad_down) | mask_of(button::d_pad_left),
+				mask_of(button::d_pad_left),
+				mask_of(button::d_pad_up) | mask_of(button::d_pad_left),
+			};
+			constexpr auto d_pad = mask_of(button::d_pad_up) | mask_of(button::d_pad_down)
+					| mask_of(button::d_pad_left) | mask_of(button::d_pad_right);
+
+			input_report r;
+			d[0] = 0x30;
+			decode_full_report(d.data(), d.size(), r);
+			d.fill(0);
+			d[0] = static_cast<uchar>(report_mode::simple);
+
+			unsigned bits = 0;
+			for (unsigned i = 0; i < order.size(); ++i)
+				if (r.buttons & mask_of(order[i]))
+					bits |= 1u << i;
+			put_le16(d.data() + 1, bits);
+
+			d[3] = 8;
+			for (unsigned i = 0; i < hat.size(); ++i)
+				if ((r.buttons & d_pad) == hat[i])
+					d[3] = static_cast<uchar>(i);
+
+			put_le16(d.data() + 4, r.lx << 4);
+			put_le16(d.data() + 6, (4095 - r.ly) << 4);
+			put_le16(d.data() + 8, r.rx << 4);
+			put_le16(d.data() + 10, (4095 - r.ry) << 4);
+		}
+	}
+
+	std::uint32_t simulated_controller::random() {
+		// xorshift32: cheap and reproducible between runs
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	void simulated_controller::fill_input(report_bytes& d, const std::uint64_t at_us) {
+		d[2] = 0x80; // full battery, not charging, Pro Controller
+
+		if (!cfg.recording.empty()) {
+			// Next full report of the recording, input bytes only; the timer
+			// and framing stay ours
+			for (std::size_t tries = 0; tries < cfg.recording.size(); ++tries) {
+				const auto& r = cfg.recording[replayed++ % cfg.recording.size()];
+				if (r.data.size() < 13 || r.data[0] != 0x30)
+					continue;
+				std::copy(r.data.begin() + 3,
+						  r.data.begin() + std::min(r.data.size(), d.size()), d.begin() + 3);
+				return;
+			}
+		}
+
+		if (cfg.pattern == sim_pattern::sweep) {
+			const auto t = (at_us - start_us) / 1e6;
+			const auto c = std::cos(2 * 3.14159265358979 * t);
+			const auto s = std::sin(2 * 3.14159265358979 * t);
+			encode_stick(d.data() + 6, static_cast<unsigned>(2048 + 1500 * c),
+						 static_cast<unsigned>(2048 + 1500 * s));
+			encode_stick(d.data() + 9, static_cast<unsigned>(2048 - 1500 * c),
+						 static_cast<unsigned>(2048 + 1500 * s));
+
+			// A new button every 250 ms, walking all 24 bits of bytes 3..5
+			const auto bit = static_cast<unsigned>(t * 4) % 24;
+			d[3 + bit / 8] = static_cast<uchar>(1u << bit % 8);
+			return;
+		}
+
+		encode_stick(d.data() + 6, 2048, 2048);
+		encode_stick(d.data() + 9, 2048, 2048);
+	}
+
+	void simulated_controller::emit(const std::uint64_t at_us) {
+		report_bytes d {};
+
+		sent_us[timer] = at_us;
+		d[1] = timer++;
+		fill_input(d, at_us);
+
+		if (!replies.empty() && replies.front().due_us <= at_us) {
+			const auto& r = replies.front();
+			d[0] = 0x21;
+			d[13] = r.ack;
+			d[14] = r.subcommand;
+			d[15] = r.data[0];
+			d[16] = r.data[1];
+			std::fill(d.begin() + 17, d.end(), 0);
+			if (r.subcommand == 0x03 && r.ack & 0x80)
+				mode = static_cast<report_mode>(r.data[0]);
+			replies.pop_front();
+		} else if (mode == report_mode::simple) {
+			to_simple(d);
+		} else {
+			d[0] = 0x30;
+		}
+
+		++sent;
+		if (cfg.drop_per_mille != 0 && random() % 1000 < cfg.drop_per_mille)
+			return;
+
+		queued.push_back(d);
+		if (queued.size() > max_queued)
+			queued.pop_front();
+	}
+
+	void simulated_controller::generate(const std::uint64_t now_us) {
+		if (start_us == 0)
+			start_us = now_us;
+
+		if (cfg.rate_hz == 0) {
+			while (!replies.empty() && replies.front().due_us <= now_us)
+				emit(replies.front().due_us);
+			return;
+		}
+
+		// Slot times come from the count, so the rate doesn't drift
+		for (;;) {
+			const auto at = start_us + sent * 1000000 / cfg.rate_hz;
+			if (at > now_us)
+				break;
+			emit(at);
+		}
+	}
+
+	int simulated_controller::read(uchar* data, const std::size_t size) {
+		generate(clock_us());
+		if (queued.empty())
+			return 0;
+
+		const auto n = std::min(size, queued.front().size());
+		std::memcpy(data, queued.front().data(), n);
+		queued.pop_front();
+		return static_cast<int>(n);
+	}
+
+	int simulated_controller::write(const uchar* data, const std::size_t size) {
+		// USB commands are acknowledged at once with 0x81, except 0x04
+		// (force USB), which has no reply
+		if (cfg.usb && size >= 2 && data[0] == 0x80 && data[1] >= 0x01 && data[1] <= 0x03) {
+			report_bytes d {};
+			d[0] = 0x81;
+			d[1] = data[1];
+			queued.push_back(d);
+			if (queued.size() > max_queued)
+				queued.pop_front();
+			return static_cast<int>(size);
+		}
+
+		// Only 0x01 (rumble + subcommand) gets a reply
+		if (size < 11 || data[0] != 0x01)
+			return static_cast<int>(size);
+
+		reply r {clock_us() + cfg.reply_delay_us, 0x80, data[10], {}};
+		if (cfg.reply_jitter_us != 0) {
+			const auto span = 2 * cfg.reply_jitter_us + 1;
+			r.due_us = r.due_us + random() % span - cfg.reply_jitter_us;
+		}
+
+		switch (r.subcommand) {
+		case 0x02: // device info: firmware 3.72
+			r.ack = 0x82;
+			r.data = {0x03, 0x48};
+			break;
+		case 0x03: // report mode, switched once the reply goes out
+			if (size < 12 || (data[11] != 0x30 && data[11] != 0x3F))
+				r.ack = 0x00;
+			else
+				r.data = {data[11], 0x00};
+			break;
+		case 0x50: // regulated voltage: 1.5 V
+			r.ack = 0xD0;
+			r.data = {0xDC, 0x05};
+			break;
+		default:
+			break;
+		}
+
+		// Jitter can reorder replies; keep them sorted by due time
+		const auto at = std::upper_bound(replies.begin(), replies.end(), r.due_us,
+			[](const std::uint64_t due, const reply& q) { return due < q.due_us; });
+		replies.insert(at, r);
+		return static_cast<int>(size);
+	}
+};
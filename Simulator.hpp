@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Capture.hpp"
+#include "Report.hpp"
+#include "Transport.hpp"
+
+namespace procon {
+	// Input the simulator streams when no recording is given
+	enum class sim_pattern {
+		idle,  // centred sticks, nothing pressed
+		sweep, // sticks circling once a second, one button at a time
+	};
+
+	// A Pro Controller in software. It streams 0x30 (or 0x3F) reports on a
+	// fixed schedule and answers subcommands with 0x21 replies, which (as on
+	// the real controller) take the place of the next scheduled report.
+	// Subcommand 0x03 switches the report mode and, when wired, the 0x80 USB
+	// commands are acknowledged. Reports nobody reads queue up to the same 64
+	// the HID driver keeps.
+	class simulated_controller : public transport {
+	public:
+		struct config {
+			std::uint32_t rate_hz {0}; // 0: send nothing but replies
+			sim_pattern pattern {sim_pattern::idle};
+			std::vector<captured_report> recording; // replayed in a loop instead of 'pattern'
+			std::uint32_t drop_per_mille {0};       // reports lost on the way
+			std::uint32_t reply_delay_us {8000};
+			std::uint32_t reply_jitter_us {0};      // uniform, +/-
+			// A real controller starts in simple mode; full saves tools
+			// that don't handshake from having to
+			report_mode mode {report_mode::full};
+			bool usb {false};
+		};
+
+		static constexpr std::size_t max_queued = 64;
+
+	private:
+		using report_bytes = std::array<uchar, input_report_size>;
+
+		struct reply {
+			std::uint64_t due_us;
+			uchar ack;
+			uchar subcommand;
+			std::array<uchar, 2> data;
+		};
+
+		config cfg;
+		report_mode mode;
+		std::deque<reply> replies;       // ordered by due time
+		std::deque<report_bytes> queued; // sent, waiting to be read
+		std::uint64_t start_us {0};
+		std::uint64_t sent {0};
+		std::array<std::uint64_t, 256> sent_us {}; // by timer byte
+		std::size_t replayed {0};
+		std::uint8_t timer {0};
+		std::uint32_t seed {0x2009};
+
+		std::uint32_t random();
+		void fill_input(report_bytes& d, std::uint64_t at_us);
+		void emit(std::uint64_t at_us);
+		void generate(std::uint64_t now_us);
+	public:
+		simulated_controller() : mode(cfg.mode) {}
+		explicit simulated_controller(config c) : cfg(std::move(c)), mode(cfg.mode) {}
+
+		int read(uchar* data, std::size_t size) override;
+		int write(const uchar* data, std::size_t size) override;
+
+		// Reports produced so far, including dropped ones
+		std::uint64_t reports_sent() const { return sent; }
+
+		report_mode current_mode() const { return mode; }
+
+		// When the report carrying 'timer' was sent, for the last 256 reports
+		std::uint64_t sent_at(std::uint8_t t) const { return sent_us[t]; }
+	};
+};
@@ -0,0 +1,47 @@
+#include "Startup.hpp"
+
+#include <cstdio>
+#include <ostream>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include "Clock.hpp"
+
+namespace procon {
+	namespace {
+		std::uint64_t to_us(const FILETIME& f) {
+			return (static_cast<std::uint64_t>(f.dwHighDateTime) << 32 | f.dwLowDateTime) / 10;
+		}
+
+		// The wall clock says how long ago the process was created; the
+		// steady clock is what everything else is stamped with
+		std::uint64_t launched_at_us() {
+			const auto now_us = clock_us();
+			FILETIME created, exited, kernel, user, wall;
+			if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+				return now_us;
+			GetSystemTimePreciseAsFileTime(&wall);
+
+			const auto since = to_us(wall) > to_us(created) ? to_us(wall) - to_us(created) : 0;
+			return since < now_us ? now_us - since : 0;
+		}
+	}
+
+	startup_timeline::startup_timeline(std::ostream& out)
+			: log(out), origin_us(launched_at_us()) {}
+
+	std::uint64_t startup_timeline::elapsed_us() const {
+		return clock_us() - origin_us;
+	}
+
+	void startup_timeline::mark(const std::string& what) {
+		// Formatted apart, so the stream's own flags stay as they are
+		char at[32];
+		std::snprintf(at, sizeof at, "%8.1f", elapsed_us() / 1000.0);
+		std::lock_guard<std::mutex> lk(lock);
+		log << "startup " << at << " ms  " << what << std::endl;
+	}
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+
+namespace procon {
+	// Logs how long after launch each step of startup finished. Times are
+	// from the process's creation, so loading the executable counts too.
+	// Steps may finish on any thread.
+	class startup_timeline {
+		std::ostream& log;
+		std::mutex lock;
+		std::uint64_t origin_us; // process creation on the clock_us() clock
+	public:
+		explicit startup_timeline(std::ostream& out);
+		startup_timeline(const startup_timeline&) = delete;
+		startup_timeline& operator=(const startup_timeline&) = delete;
+
+		std::uint64_t elapsed_us() const;
+
+		// Writes one line: the time since launch and 'what'
+		void mark(const std::string& what);
+	};
+};
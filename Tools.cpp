@@ -0,0 +1,1828 @@
+// Procon Tools: offline diagnostics for the driver. Each subcommand is one
+// entry in 'commands'.
+
+#pragma comment(lib, "hid")
+#pragma comment(lib, "Setupapi")
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocCount.hpp"
+#include "Analyze.hpp"
+#include "Backend.hpp"
+#include "BatchDecode.hpp"
+#include "Capture.hpp"
+#include "Clock.hpp"
+#include "Controller.hpp"
+#include "Devices.hpp"
+#include "Fusion.hpp"
+#include "Handshake.hpp"
+#include "Layers.hpp"
+#include "LinkStats.hpp"
+#include "Output.hpp"
+#include "PadTable.hpp"
+#include "Probe.hpp"
+#include "Profile.hpp"
+#include "Reactor.hpp"
+#include "Resample.hpp"
+#include "SharedState.hpp"
+#include "Simulator.hpp"
+#include "Trace.hpp"
+
+namespace {
+	using args = std::vector<std::string>;
+
+	struct usage_error : std::runtime_error {
+		using std::runtime_error::runtime_error;
+	};
+
+	// Returns the value following 'flag' and removes both, or 'fallback'
+	std::string take_option(args& a, const char* flag, const std::string& fallback = "") {
+		const auto it = std::find(a.begin(), a.end(), flag);
+		if (it == a.end())
+			return fallback;
+		if (it + 1 == a.end())
+			throw usage_error(std::string(flag) + " needs a value");
+
+		auto value = *(it + 1);
+		a.erase(it, it + 2);
+		return value;
+	}
+
+	// Removes 'flag' and returns whether it was there
+	bool take_flag(args& a, const char* flag) {
+		const auto it = std::find(a.begin(), a.end(), flag);
+		if (it == a.end())
+			return false;
+		a.erase(it);
+		return true;
+	}
+
+	// Every record of a dump on one clock, oldest first
+	struct timeline_entry {
+		double us; // since the first record
+		std::uint32_t thread_id;
+		procon::trace::record rec;
+	};
+
+	std::vector<timeline_entry> merge(const procon::trace::capture& c) {
+		std::vector<timeline_entry> out;
+		std::uint64_t origin = UINT64_MAX;
+
+		for (const auto& t : c.threads)
+			for (const auto& r : t.records)
+				origin = std::min(origin, r.tsc);
+
+		const auto ticks_per_us = c.tsc_per_second ? c.tsc_per_second / 1e6 : 1.0;
+		for (const auto& t : c.threads)
+			for (const auto& r : t.records)
+				out.push_back({(r.tsc - origin) / ticks_per_us, t.thread_id, r});
+
+		std::sort(out.begin(), out.end(), [](const timeline_entry& a, const timeline_entry& b) {
+			return a.rec.tsc < b.rec.tsc;
+		});
+		return out;
+	}
+
+	void write_timeline(const std::vector<timeline_entry>& entries, std::ostream& os) {
+		std::vector<std::pair<std::uint32_t, double>> last; // per thread
+		double worst_gap = 0, previous_report = -1;
+
+		os << std::fixed << std::setprecision(1);
+		os << "      time_us  thread  event              arg         +us\n";
+		for (const auto& e : entries) {
+			auto it = std::find_if(last.begin(), last.end(), [&](const std::pair<std::uint32_t, double>& p) {
+				return p.first == e.thread_id;
+			});
+			const auto delta = it == last.end() ? 0.0 : e.us - it->second;
+			if (it == last.end())
+				last.emplace_back(e.thread_id, e.us);
+			else
+				it->second = e.us;
+
+			if (e.rec.type == procon::trace::event::report_received) {
+				if (previous_report >= 0)
+					worst_gap = std::max(worst_gap, e.us - previous_report);
+				previous_report = e.us;
+			}
+
+			os << std::setw(13) << e.us << "  " << std::setw(6) << e.thread_id
+			   << "  " << std::left << std::setw(17) << procon::trace::event_name(e.rec.type)
+			   << std::right << "  0x" << std::hex << std::setw(8) << std::setfill('0')
+			   << e.rec.arg << std::dec << std::setfill(' ') << std::setw(12) << delta << '\n';
+		}
+
+		os << entries.size() << " records, longest gap between reports "
+		   << worst_gap / 1000 << " ms\n";
+	}
+
+	// Chrome trace event format, loadable in chrome://tracing or Perfetto
+	void write_chrome(const std::vector<timeline_entry>& entries, std::ostream& os) {
+		os << std::fixed << std::setprecision(3);
+		os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (std::size_t i = 0; i < entries.size(); ++i) {
+			const auto& e = entries[i];
+			os << "{\"name\":\"" << procon::trace::event_name(e.rec.type)
+			   << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << e.thread_id
+			   << ",\"ts\":" << e.us << ",\"args\":{\"arg\":" << e.rec.arg << "}}"
+			   << (i + 1 < entries.size() ? ",\n" : "\n");
+		}
+		os << "]}\n";
+	}
+
+	int trace_dump(args a) {
+		const auto chrome = take_option(a, "--chrome");
+		if (a.size() != 1)
+			throw usage_error("expected one dump file");
+
+		const auto entries = merge(procon::trace::load(a[0]));
+
+		if (chrome.empty()) {
+			write_timeline(entries, std::cout);
+			return 0;
+		}
+
+		std::ofstream out(chrome);
+		if (!out)
+			throw std::runtime_error("can't write " + chrome);
+		write_chrome(entries, out);
+		std::cout << entries.size() << " records written to " << chrome << '\n';
+		return 0;
+	}
+
+	std::uint32_t to_uint(const std::string& s, const char* what) {
+		try {
+			std::size_t used;
+			const auto v = std::stoul(s, &used);
+			if (used == s.size())
+				return static_cast<std::uint32_t>(v);
+		} catch (const std::exception&) {}
+		throw usage_error(std::string(what) + " must be a whole number");
+	}
+
+	// Probes a connected controller, or the simulator when a fake delay is
+	// given, and prints the round-trip distribution
+	int rtt_probe(args a) {
+		const auto fake_delay = take_option(a, "--fake-delay-ms");
+		const auto fake_jitter = take_option(a, "--fake-jitter-ms", "0");
+		const auto count = to_uint(take_option(a, "--count", "100"), "--count");
+
+		procon::rtt_probe::config cfg;
+		cfg.interval_ms = to_uint(take_option(a, "--interval-ms", "50"), "--interval-ms");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+
+		std::unique_ptr<procon::transport> device;
+		if (!fake_delay.empty()) {
+			procon::simulated_controller::config sim;
+			sim.reply_delay_us = to_uint(fake_delay, "--fake-delay-ms") * 1000;
+			sim.reply_jitter_us = to_uint(fake_jitter, "--fake-jitter-ms") * 1000;
+			device.reset(new procon::simulated_controller(sim));
+		} else {
+			auto* d = hid_open(0x057E, 0x2009, nullptr);
+			if (d == nullptr)
+				throw std::runtime_error("no Pro Controller found");
+			device.reset(new procon::hid_transport(d));
+		}
+
+		procon::rtt_probe probe(cfg);
+		const std::array<procon::uchar, 8> neutral = {0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40};
+		std::uint8_t counter = 0;
+		procon::uchar buf[64];
+		procon::input_report report;
+
+		while (probe.stats().answered + probe.stats().timeouts < count) {
+			const auto now = procon::clock_us();
+			if (probe.due(now)) {
+				const auto r = probe.send(counter++, neutral, now);
+				if (device->write(r.data(), r.size()) < 0)
+					throw std::runtime_error("write failed");
+			}
+
+			int size;
+			while ((size = device->read(buf, sizeof buf)) > 0)
+				if (procon::decode_report(buf, static_cast<std::size_t>(size), report))
+					probe.reply(report, procon::clock_us());
+			if (size < 0)
+				throw std::runtime_error("read failed");
+
+			std::this_thread::sleep_for(std::chrono::microseconds(250));
+		}
+
+		const auto& s = probe.stats();
+		std::cout << std::fixed << std::setprecision(2)
+				  << s.answered << " answered, " << s.timeouts << " timed out\n"
+				  << "rtt ms: min " << s.min_us / 1000.0 << "  mean " << s.mean_us / 1000
+				  << "  p50 <" << s.p50_us / 1000.0 << "  p99 <" << s.p99_us / 1000.0
+				  << "  max " << s.max_us / 1000.0 << '\n';
+		for (std::size_t i = 0; i < procon::rtt_buckets; ++i)
+			if (s.histogram[i] != 0)
+				std::cout << std::setw(4) << i << (i + 1 == procon::rtt_buckets ? "+ ms " : "  ms ")
+						  << std::string(std::max<std::size_t>(1, s.histogram[i] * 60 / s.answered), '#')
+						  << ' ' << s.histogram[i] << '\n';
+		return 0;
+	}
+
+	// Runs the connection handshake on a connected controller, or the
+	// simulator, then checks a second of reports decodes in the mode it chose
+	int handshake(args a) {
+		const auto mode = take_option(a, "--mode", "full");
+		const auto usb = take_flag(a, "--usb");
+		const auto simulate = take_flag(a, "--simulate");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+
+		procon::handshake_config cfg;
+		cfg.link = usb ? procon::link_type::usb : procon::link_type::bluetooth;
+		if (mode == "full")
+			cfg.mode = procon::report_mode::full;
+		else if (mode == "simple")
+			cfg.mode = procon::report_mode::simple;
+		else
+			throw usage_error("--mode must be full or simple");
+
+		std::unique_ptr<procon::transport> device;
+		if (simulate) {
+			procon::simulated_controller::config sim;
+			sim.rate_hz = 120;
+			sim.mode = procon::report_mode::simple; // as a controller powers up
+			sim.usb = usb;
+			device.reset(new procon::simulated_controller(sim));
+		} else {
+			auto* d = hid_open(procon::pro_controller_vendor, procon::pro_controller_product, nullptr);
+			if (d == nullptr)
+				throw std::runtime_error("no Pro Controller found");
+			device.reset(new procon::hid_transport(d));
+		}
+
+		std::uint8_t counter = 0;
+		const auto start = procon::clock_us();
+		const auto result = procon::run_handshake(*device, cfg, counter);
+		if (!result.ok)
+			throw std::runtime_error(std::string("failed at ") + result.failed_step);
+		std::cout << "handshake done in " << (procon::clock_us() - start) / 1000.0 << " ms\n";
+
+		const auto decode = procon::decoder_for(result.mode);
+		const auto end = procon::clock_us() + 1000000;
+		procon::uchar buf[64];
+		procon::input_report report;
+		std::uint32_t read = 0, decoded = 0;
+		while (procon::clock_us() < end) {
+			int size;
+			while ((size = device->read(buf, sizeof buf)) > 0) {
+				++read;
+				if (decode(buf, static_cast<std::size_t>(size), report))
+					++decoded;
+			}
+			if (size < 0)
+				throw std::runtime_error("read failed");
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::cout << decoded << " of " << read << " reports decoded as 0x" << std::hex
+				  << static_cast<unsigned>(result.mode) << std::dec << '\n';
+		return read != 0 && decoded == read ? 0 : 1;
+	}
+
+	const char* link_name(const procon::link_type l) {
+		return l == procon::link_type::usb ? "usb" : "bluetooth";
+	}
+
+	struct link_result {
+		double handshake_ms;
+		procon::link_stats link;
+		procon::rtt_stats rtt;
+	};
+
+	// Handshakes, then reads everything one controller sends for 'seconds'
+	// through the link monitor, with a subcommand round trip every 50 ms
+	link_result measure_link(procon::transport& t, const procon::link_type link,
+							 const std::uint32_t seconds) {
+		procon::handshake_config cfg;
+		cfg.link = link;
+		std::uint8_t counter = 0;
+		link_result out {};
+
+		const auto start = procon::clock_us();
+		const auto shake = procon::run_handshake(t, cfg, counter);
+		if (!shake.ok)
+			throw std::runtime_error(std::string(link_name(link)) + " handshake failed at "
+									 + shake.failed_step);
+		out.handshake_ms = (procon::clock_us() - start) / 1000.0;
+
+		procon::rtt_probe::config probe_cfg;
+		probe_cfg.interval_ms = 50;
+		procon::rtt_probe probe(probe_cfg);
+		procon::link_monitor monitor;
+		const std::array<procon::uchar, 8> neutral = {0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40};
+		procon::uchar buf[64];
+		procon::input_report report;
+
+		const auto end = procon::clock_us() + seconds * 1000000ull;
+		for (auto now = procon::clock_us(); now < end; now = procon::clock_us()) {
+			if (probe.due(now)) {
+				const auto r = probe.send(counter++, neutral, now);
+				if (t.write(r.data(), r.size()) < 0)
+					throw std::runtime_error("write failed");
+			}
+
+			int size;
+			while ((size = t.read(buf, sizeof buf)) > 0) {
+				const auto arrived = procon::clock_us();
+				if (!procon::decode_full_report(buf, static_cast<std::size_t>(size), report))
+					continue;
+				monitor.report(report.timer, arrived);
+				probe.reply(report, arrived);
+			}
+			if (size < 0)
+				throw std::runtime_error("read failed");
+
+			std::this_thread::sleep_for(std::chrono::microseconds(250));
+		}
+
+		out.link = monitor.stats();
+		out.rtt = probe.stats();
+		return out;
+	}
+
+	// Wired against Bluetooth: every connected controller in turn, or a
+	// simulated pair with typical timings of each link
+	int link_bench(args a) {
+		const auto seconds = to_uint(take_option(a, "--seconds", "5"), "--seconds");
+		const auto simulate = take_flag(a, "--simulate");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+
+		struct target {
+			procon::link_type link;
+			std::string name;
+			std::unique_ptr<procon::transport> device;
+		};
+		std::vector<target> targets;
+
+		if (simulate) {
+			for (const auto link : {procon::link_type::bluetooth, procon::link_type::usb}) {
+				procon::simulated_controller::config sim;
+				sim.mode = procon::report_mode::simple;
+				sim.usb = link == procon::link_type::usb;
+				// Stock rates: a 15 ms radio slot against 8 ms USB polling
+				sim.rate_hz = sim.usb ? 125 : 66;
+				sim.reply_delay_us = sim.usb ? 1000 : 8000;
+				sim.reply_jitter_us = sim.usb ? 0 : 3000;
+				sim.drop_per_mille = sim.usb ? 0 : 5;
+				targets.push_back({link, "simulated",
+								   std::unique_ptr<procon::transport>(new procon::simulated_controller(sim))});
+			}
+		} else {
+			for (const auto& f : procon::find_pro_controllers(std::cerr)) {
+				auto* d = hid_open_path(f.path.c_str());
+				if (d == nullptr) {
+					std::cerr << "can't open " << f.path << '\n';
+					continue;
+				}
+				targets.push_back({f.link, f.path,
+								   std::unique_ptr<procon::transport>(new procon::hid_transport(d))});
+			}
+			if (targets.empty())
+				throw std::runtime_error("no Pro Controller found");
+		}
+
+		std::cout << "link       handshake ms  rate Hz  jitter us  queued us  lost  longest gap ms"
+					 "  rtt p50 ms  rtt p99 ms  rtt mean ms\n"
+				  << std::fixed << std::setprecision(1);
+		for (auto& t : targets) {
+			// One at a time, so the links don't share the host's attention
+			const auto r = measure_link(*t.device, t.link, seconds);
+			std::cout << std::left << std::setw(9) << link_name(t.link) << std::right
+					  << std::setw(14) << r.handshake_ms
+					  << std::setw(9) << r.link.rate_hz
+					  << std::setw(11) << r.link.jitter_us
+					  << std::setw(11) << r.link.queue_us
+					  << std::setw(6) << r.link.lost
+					  << std::setw(16) << r.link.longest_gap_us / 1000.0
+					  << std::setw(12) << r.rtt.p50_us / 1000.0
+					  << std::setw(12) << r.rtt.p99_us / 1000.0
+					  << std::setw(13) << r.rtt.mean_us / 1000
+					  << "  " << t.name << '\n';
+		}
+		return 0;
+	}
+
+	float to_float(const std::string& s, const char* what) {
+		try {
+			std::size_t used;
+			const auto v = std::stof(s, &used);
+			if (used == s.size())
+				return v;
+		} catch (const std::exception&) {}
+		throw usage_error(std::string(what) + " must be a number");
+	}
+
+	struct stick_sample {
+		std::uint64_t t;
+		std::array<float, 4> v;
+	};
+
+	// The recorded sticks at 't', straight between the reports around it.
+	// Uses the report after 't', which the resampler never gets to see.
+	std::array<float, 4> truth_at(const std::vector<stick_sample>& truth, const std::uint64_t t) {
+		const auto next = std::upper_bound(truth.begin(), truth.end(), t,
+			[](const std::uint64_t at, const stick_sample& s) { return at < s.t; });
+		if (next == truth.begin())
+			return next->v;
+		if (next == truth.end())
+			return truth.back().v;
+
+		const auto& a = *(next - 1);
+		const auto f = static_cast<float>(t - a.t) / (next->t - a.t);
+		std::array<float, 4> v;
+		for (std::size_t i = 0; i < 4; ++i)
+			v[i] = a.v[i] + (next->v[i] - a.v[i]) * f;
+		return v;
+	}
+
+	// Replays a capture through the resampler on its own clock and scores
+	// each mode against the recorded sticks: error, the delay that best
+	// explains the output, and overshoot past anything the stick did
+	// within 40 ms either side
+	int resample_eval(args a) {
+		if (a.empty())
+			throw usage_error("expected a capture file");
+		const auto path = a[0];
+		a.erase(a.begin());
+
+		procon::resample_config cfg;
+		cfg.output_hz = to_uint(take_option(a, "--output-hz", "250"), "--output-hz");
+		cfg.horizon_us = to_uint(take_option(a, "--horizon-ms", "8"), "--horizon-ms") * 1000;
+		cfg.overshoot = to_float(take_option(a, "--overshoot", "0.5"), "--overshoot");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+		if (cfg.output_hz == 0)
+			throw usage_error("--output-hz must be at least 1");
+
+		std::vector<procon::input_report> reports;
+		std::vector<stick_sample> truth;
+		for (const auto& c : procon::read_capture(path)) {
+			procon::input_report r;
+			if (!procon::decode_report(c.data.data(), c.data.size(), r))
+				continue;
+			reports.push_back(r);
+			truth.push_back({c.time_us, {{static_cast<float>(r.lx), static_cast<float>(r.ly),
+										  static_cast<float>(r.rx), static_cast<float>(r.ry)}}});
+		}
+		if (truth.size() < 2)
+			throw std::runtime_error("the capture needs at least two reports");
+
+		constexpr std::uint64_t window_us = 40000;
+		const auto period = 1000000 / cfg.output_hz;
+		const auto first = truth.front().t + window_us;
+		const auto last = truth.back().t > window_us ? truth.back().t - window_us : 0;
+		if (first >= last)
+			throw std::runtime_error("the capture is too short to score");
+
+		std::cout << truth.size() << " reports over " << (truth.back().t - truth.front().t) / 1e6
+				  << " s, output at " << cfg.output_hz << " Hz; errors in % of stick travel\n"
+				  << "mode          mean err   max err   lag ms   mean overshoot   max overshoot\n"
+				  << std::fixed;
+
+		const std::pair<procon::resample_mode, const char*> modes[] = {
+			{procon::resample_mode::off, "hold"},
+			{procon::resample_mode::interpolate, "interpolate"},
+			{procon::resample_mode::extrapolate, "extrapolate"},
+		};
+		for (const auto& m : modes) {
+			auto mode_cfg = cfg;
+			mode_cfg.mode = m.first;
+			procon::resampler resampler(mode_cfg);
+
+			std::vector<stick_sample> output;
+			double error_sum = 0, error_max = 0, over_sum = 0, over_max = 0;
+			std::size_t fed = 0, lo = 0, hi = 0;
+
+			for (auto t = first; t < last; t += period) {
+				while (fed < truth.size() && truth[fed].t <= t) {
+					resampler.add(reports[fed], truth[fed].t);
+					++fed;
+				}
+				procon::input_report r;
+				resampler.sample(t, r);
+				const stick_sample out {t, {{static_cast<float>(r.lx), static_cast<float>(r.ly),
+											 static_cast<float>(r.rx), static_cast<float>(r.ry)}}};
+				output.push_back(out);
+
+				while (truth[lo].t + window_us < t)
+					++lo;
+				while (hi + 1 < truth.size() && truth[hi + 1].t <= t + window_us)
+					++hi;
+
+				const auto expected = truth_at(truth, t);
+				for (std::size_t axis = 0; axis < 4; ++axis) {
+					const double e = std::fabs(out.v[axis] - expected[axis]);
+					error_sum += e;
+					error_max = std::max(error_max, e);
+
+					auto min = out.v[axis], max = out.v[axis];
+					for (auto i = lo; i <= hi; ++i) {
+						min = std::min(min, truth[i].v[axis]);
+						max = std::max(max, truth[i].v[axis]);
+					}
+					const double over = std::max({0.0f, out.v[axis] - max, min - out.v[axis]});
+					over_sum += over;
+					over_max = std::max(over_max, over);
+				}
+			}
+
+			// The delay, in 0.25 ms steps, that lines the output up best with
+			// the recording
+			double best_lag = 0, best_error = -1;
+			for (auto lag_us = -10000; lag_us <= 40000; lag_us += 250) {
+				double sum = 0;
+				for (const auto& o : output) {
+					const auto v = truth_at(truth, static_cast<std::uint64_t>(static_cast<std::int64_t>(o.t) - lag_us));
+					for (std::size_t axis = 0; axis < 4; ++axis)
+						sum += (o.v[axis] - v[axis]) * (o.v[axis] - v[axis]);
+				}
+				if (best_error < 0 || sum < best_error) {
+					best_error = sum;
+					best_lag = lag_us / 1000.0;
+				}
+			}
+
+			const auto samples = static_cast<double>(output.size() * 4);
+			const auto percent = 100.0 / 4095;
+			std::cout << std::left << std::setw(12) << m.second << std::right << std::setprecision(2)
+					  << std::setw(11) << error_sum / samples * percent
+					  << std::setw(10) << error_max * percent
+					  << std::setw(9) << best_lag
+					  << std::setw(17) << over_sum / samples * percent
+					  << std::setw(16) << over_max * percent << '\n';
+		}
+		return 0;
+	}
+
+	// Splits "1,4,16" into numbers
+	std::vector<std::uint32_t> to_uint_list(const std::string& s, const char* what) {
+		std::vector<std::uint32_t> out;
+		std::size_t from = 0;
+		for (;;) {
+			const auto comma = s.find(',', from);
+			out.push_back(to_uint(s.substr(from, comma - from), what));
+			if (comma == std::string::npos)
+				return out;
+			from = comma + 1;
+		}
+	}
+
+	// The per-frame stick, trigger and rumble arithmetic for a rig, done per
+	// controller as the pipeline used to, and across a pad_table with and
+	// without its vector kernels
+	int table_bench(args a) {
+		const auto counts = to_uint_list(take_option(a, "--controllers", "1,4,16"), "--controllers");
+		const auto frames = to_uint(take_option(a, "--frames", "200000"), "--frames");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+
+		// Reports to cycle through, so every frame has work to do
+		std::vector<procon::input_report> reports(256);
+		std::uint32_t seed = 0x9E3779B9;
+		const auto random = [&seed] {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return seed;
+		};
+		for (auto& r : reports) {
+			r = {};
+			r.buttons = random() & ((1u << procon::button_count) - 1);
+			r.lx = random() % 4096;
+			r.ly = random() % 4096;
+			r.rx = random() % 4096;
+			r.ry = random() % 4096;
+		}
+
+		procon::profile shaped;
+		for (auto& c : shaped.sticks) {
+			c.deadzone = 0.1;
+			c.exponent = 1.5;
+		}
+		const procon::profile plain;
+		const auto zl = procon::mask_of(procon::button::zl);
+		const auto zr = procon::mask_of(procon::button::zr);
+
+		std::cout << std::fixed << std::setprecision(1)
+				  << "controllers  per-controller ns  table ns  table scalar ns  (per frame)\n";
+		for (const auto count : counts) {
+			if (count < 1 || count > 64)
+				throw usage_error("--controllers must be 1 to 64");
+
+			// Half the pads on each profile, so lanes don't share curves
+			std::vector<std::unique_ptr<procon::response_curves>> curves;
+			for (unsigned i = 0; i < count; ++i) {
+				curves.emplace_back(new procon::response_curves);
+				curves.back()->bake(i % 2 ? shaped : plain);
+			}
+
+			std::vector<XINPUT_GAMEPAD> pads(count);
+			std::vector<BYTE> motors(2 * count);
+			std::uint64_t checksum = 0;
+			const auto sum = [&] {
+				for (unsigned i = 0; i < count; ++i)
+					checksum += pads[i].wButtons + pads[i].sThumbLX + pads[i].sThumbRY
+							  + pads[i].bLeftTrigger + motors[2 * i] + motors[2 * i + 1];
+			};
+
+			const auto per_controller = [&](const std::uint32_t frame) {
+				for (unsigned i = 0; i < count; ++i) {
+					const auto& r = reports[(frame + i) & 0xFF];
+					auto& pad = pads[i];
+					procon::map_report(r, false, pad);
+					curves[i]->apply_sticks(pad);
+					pad.bLeftTrigger = curves[i]->digital_trigger(0, (r.buttons & zl) != 0, frame);
+					pad.bRightTrigger = curves[i]->digital_trigger(1, (r.buttons & zr) != 0, frame);
+					motors[2 * i] = static_cast<BYTE>(r.lx % 256 * 200 / 255);
+					motors[2 * i + 1] = static_cast<BYTE>(r.ly % 256 * 200 / 255);
+				}
+			};
+
+			procon::pad_table table;
+			for (unsigned i = 0; i < count; ++i)
+				table.add(*curves[i], 200);
+			const auto through_table = [&](const std::uint32_t frame, const bool vector) {
+				for (unsigned i = 0; i < count; ++i) {
+					const auto& r = reports[(frame + i) & 0xFF];
+					table.stage(i, r, curves[i]->ramp_trigger(0, (r.buttons & zl) != 0, frame),
+								curves[i]->ramp_trigger(1, (r.buttons & zr) != 0, frame));
+					table.set_motors(i, static_cast<BYTE>(r.lx % 256), static_cast<BYTE>(r.ly % 256));
+				}
+				if (vector) {
+					table.process();
+					table.scale_motors();
+				} else {
+					table.process_scalar();
+					table.scale_motors_scalar();
+				}
+				for (unsigned i = 0; i < count; ++i) {
+					auto& pad = pads[i];
+					table.clear(i);
+					pad.wButtons = procon::map_buttons(table.pressed(i), false);
+					pad.sThumbLX = table.axis(i, 0);
+					pad.sThumbLY = table.axis(i, 1);
+					pad.sThumbRX = table.axis(i, 2);
+					pad.sThumbRY = table.axis(i, 3);
+					pad.bLeftTrigger = table.trigger(i, 0);
+					pad.bRightTrigger = table.trigger(i, 1);
+					motors[2 * i] = table.motor(i, 0);
+					motors[2 * i + 1] = table.motor(i, 1);
+				}
+			};
+
+			const auto time = [&](const std::function<void(std::uint32_t)>& frame) {
+				checksum = 0;
+				const auto start = procon::clock_us();
+				for (std::uint32_t f = 0; f < frames; ++f) {
+					frame(f);
+					sum();
+				}
+				return (procon::clock_us() - start) * 1000.0 / frames;
+			};
+
+			const auto scalar_ns = time(per_controller);
+			const auto expected = checksum;
+			const auto table_ns = time([&](const std::uint32_t f) { through_table(f, true); });
+			const auto vector_ok = checksum == expected;
+			const auto fallback_ns = time([&](const std::uint32_t f) { through_table(f, false); });
+			if (!vector_ok || checksum != expected)
+				throw std::runtime_error("the table's output differs from the per-controller path");
+
+			std::cout << std::setw(11) << count << std::setw(19) << scalar_ns
+					  << std::setw(10) << table_ns << std::setw(17) << fallback_ns << '\n';
+		}
+		return 0;
+	}
+
+	template<class T>
+	void write_column(const std::string& path, const std::vector<T>& column) {
+		std::ofstream out(path, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(column.data()),
+				  static_cast<std::streamsize>(column.size() * sizeof(T)));
+		if (!out)
+			throw std::runtime_error("can't write " + path);
+	}
+
+	// A capture's full reports as one raw little-endian array per field, and
+	// how fast each batch decoding kernel gets through them
+	int decode(args a) {
+		if (a.empty())
+			throw usage_error("expected a capture file");
+		const auto path = a[0];
+		a.erase(a.begin());
+
+		const auto prefix = take_option(a, "--out");
+		const auto kernel_option = take_option(a, "--kernel");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+
+		const procon::batch_kernel kernels[] = {
+			procon::batch_kernel::scalar, procon::batch_kernel::ssse3, procon::batch_kernel::avx2,
+		};
+		auto kernel = procon::best_batch_kernel();
+		if (!kernel_option.empty()) {
+			const auto it = std::find_if(std::begin(kernels), std::end(kernels),
+				[&](const procon::batch_kernel k) { return kernel_option == procon::kernel_name(k); });
+			if (it == std::end(kernels))
+				throw usage_error("--kernel must be scalar, ssse3 or avx2");
+			if (!procon::kernel_supported(*it))
+				throw std::runtime_error(kernel_option + " isn't supported on this machine");
+			kernel = *it;
+		}
+
+		// Full reports packed back to back; subcommand replies, simple and
+		// short reports have no place in the columns
+		constexpr auto stride = procon::input_report_size;
+		std::vector<procon::uchar> packed;
+		std::vector<std::uint64_t> time_us;
+		std::size_t skipped = 0;
+		for (const auto& c : procon::read_capture(path)) {
+			if (c.data.size() < stride || (c.data[0] != 0x30 && c.data[0] != 0x31)) {
+				++skipped;
+				continue;
+			}
+			packed.insert(packed.end(), c.data.begin(), c.data.begin() + stride);
+			time_us.push_back(c.time_us);
+		}
+		const auto count = time_us.size();
+		if (count == 0)
+			throw std::runtime_error("the capture has no full reports");
+
+		procon::report_columns columns;
+		columns.resize(count);
+		procon::decode_batch(packed.data(), stride, count, columns, 0, kernel);
+
+		// Every row against the one-report decoder the driver uses
+		for (std::size_t i = 0; i < count; ++i) {
+			procon::input_report r;
+			procon::decode_full_report(packed.data() + i * stride, stride, r);
+			auto same = r.id == columns.id[i] && r.timer == columns.timer[i] && r.buttons == columns.buttons[i]
+					&& r.lx == columns.sticks[0][i] && r.ly == columns.sticks[1][i]
+					&& r.rx == columns.sticks[2][i] && r.ry == columns.sticks[3][i];
+			for (std::size_t s = 0; s < 3; ++s)
+				for (std::size_t axis = 0; axis < 3; ++axis)
+					same = same && r.imu[s].accel[axis] == columns.imu[6 * s + axis][i]
+							&& r.imu[s].gyro[axis] == columns.imu[6 * s + 3 + axis][i];
+			if (!same)
+				throw std::runtime_error("the " + std::string(procon::kernel_name(kernel))
+										 + " kernel disagrees with decode_full_report at report "
+										 + std::to_string(i));
+		}
+
+		std::cout << count << " full reports";
+		if (skipped != 0)
+			std::cout << ", " << skipped << " other reports skipped";
+		std::cout << "; decoded with " << procon::kernel_name(kernel) << "\n\n"
+				  << std::fixed << std::setprecision(1)
+				  << "path                   Mreports/s\n";
+
+		// Each path repeated until it has run for a while
+		const auto rate = [&](const std::function<void()>& pass) {
+			std::uint64_t passes = 0;
+			const auto start = procon::clock_us();
+			std::uint64_t elapsed;
+			do {
+				pass();
+				++passes;
+				elapsed = procon::clock_us() - start;
+			} while (elapsed < 500000);
+			return static_cast<double>(passes * count) / elapsed;
+		};
+
+		// The alternative: a capture decoded into one input_report per row
+		std::vector<procon::input_report> rows(count);
+		std::cout << std::left << std::setw(23) << "decode_full_report" << std::right << std::setw(10) << rate([&] {
+			for (std::size_t i = 0; i < count; ++i)
+				procon::decode_full_report(packed.data() + i * stride, stride, rows[i]);
+		}) << '\n';
+		procon::report_columns scratch;
+		scratch.resize(count);
+		for (const auto k : kernels) {
+			if (!procon::kernel_supported(k))
+				continue;
+			const auto per_us = rate([&] { procon::decode_batch(packed.data(), stride, count, scratch, 0, k); });
+			if (scratch.sticks != columns.sticks || scratch.imu != columns.imu)
+				throw std::runtime_error(std::string("the ") + procon::kernel_name(k) + " kernel disagrees with "
+										 + procon::kernel_name(kernel));
+			std::cout << std::left << std::setw(23) << (std::string("batch ") + procon::kernel_name(k))
+					  << std::right << std::setw(10) << per_us << '\n';
+		}
+		if (prefix.empty())
+			return 0;
+
+		const char* axes[] = {"lx", "ly", "rx", "ry"};
+		const char* imu_axes[] = {"accel_x", "accel_y", "accel_z", "gyro_x", "gyro_y", "gyro_z"};
+		write_column(prefix + ".time_us.u64", time_us);
+		write_column(prefix + ".id.u8", columns.id);
+		write_column(prefix + ".timer.u8", columns.timer);
+		write_column(prefix + ".buttons.u32", columns.buttons);
+		for (std::size_t i = 0; i < 4; ++i)
+			write_column(prefix + '.' + axes[i] + ".u16", columns.sticks[i]);
+		for (std::size_t c = 0; c < procon::report_columns::imu_channels; ++c)
+			write_column(prefix + ".imu" + std::to_string(c / 6) + '_' + imu_axes[c % 6] + ".i16", columns.imu[c]);
+		std::cout << "\nwrote " << 8 + procon::report_columns::imu_channels << " columns of " << count
+				  << " rows to " << prefix << ".<field>.<type>\n";
+		return 0;
+	}
+
+	// Rewrites a capture of either version as version 2, checks that every
+	// record survives, and times both files' encoding and decoding
+	int capture_convert(args a) {
+		if (a.size() != 2)
+			throw usage_error(a.size() < 2 ? "expected an input and an output capture"
+										   : "unexpected argument " + a[2]);
+		const auto& from = a[0];
+		const auto& to = a[1];
+
+		const auto reports = procon::read_capture(from);
+		if (reports.empty())
+			throw std::runtime_error(from + " has no reports");
+
+		procon::capture_writer writer;
+		if (!writer.open(to))
+			throw std::runtime_error("can't write " + to);
+		const auto write_start = procon::clock_us();
+		for (const auto& r : reports)
+			writer.write(r.time_us, r.data.data(), r.data.size());
+		writer.close();
+		const auto write_us = procon::clock_us() - write_start;
+		if (writer.dropped() != 0)
+			throw std::runtime_error(std::to_string(writer.dropped()) + " reports couldn't be written");
+
+		const procon::mapped_capture input(from);
+		const procon::mapped_capture output(to);
+		{
+			procon::capture_cursor cursor(output);
+			procon::capture_record r;
+			std::size_t i = 0;
+			for (; cursor.next(r); ++i)
+				if (i >= reports.size() || r.time_us != reports[i].time_us - reports[0].time_us
+						|| r.size != reports[i].data.size()
+						|| !std::equal(r.data, r.data + r.size, reports[i].data.begin()))
+					throw std::runtime_error("record " + std::to_string(i) + " differs after conversion");
+			if (i != reports.size())
+				throw std::runtime_error("the converted capture is missing records");
+
+			// From a keyframe, the middle record comes round again
+			const auto middle = reports[reports.size() / 2].time_us - reports[0].time_us;
+			cursor.seek(middle);
+			auto found = false;
+			while (!found && cursor.next(r))
+				found = r.time_us == middle;
+			if (!found)
+				throw std::runtime_error("seeking the converted capture failed");
+		}
+
+		std::uint64_t report_bytes = 0;
+		for (const auto& r : reports)
+			report_bytes += r.data.size();
+
+		// Passes over the whole file until a while has gone by, each one
+		// touching every report so none can be skipped
+		volatile std::uint64_t sink = 0;
+		const auto read_rate = [&](const procon::mapped_capture& c) {
+			std::uint64_t passes = 0, sum = 0;
+			const auto start = procon::clock_us();
+			std::uint64_t elapsed;
+			do {
+				procon::capture_cursor cursor(c);
+				procon::capture_record r;
+				while (cursor.next(r))
+					sum += r.data[r.size - 1];
+				++passes;
+				elapsed = procon::clock_us() - start;
+			} while (elapsed < 300000);
+			sink = sum;
+			return static_cast<double>(report_bytes) * passes / elapsed / 1000;
+		};
+
+		std::cout << reports.size() << " reports, " << report_bytes << " bytes of reports\n"
+				  << std::fixed << std::setprecision(2)
+				  << "                 file bytes   per report   read GB/s\n";
+		const auto row = [&](const char* name, const procon::mapped_capture& c) {
+			std::cout << std::left << std::setw(15) << name << std::right << std::setw(12) << c.size()
+					  << std::setw(13) << static_cast<double>(c.size()) / reports.size()
+					  << std::setw(12) << read_rate(c) << '\n';
+		};
+		row(input.version() == 1 ? "version 1" : "input", input);
+		row("version 2", output);
+		std::cout << "encoded in " << write_us * 1000.0 / reports.size() << " ns per report, "
+				  << output.blocks().size() << " blocks, "
+				  << 100.0 * output.size() / input.size() << "% of the input's size\n";
+		return 0;
+	}
+
+	// Per-capture and session-wide stats for any number of captures, one
+	// pass over each, several captures at a time
+	int analyze(args a) {
+		const auto jobs_option = take_option(a, "--jobs");
+		procon::analysis_config cfg;
+		cfg.deadzone = to_float(take_option(a, "--deadzone", "0.1"), "--deadzone");
+		if (a.empty())
+			throw usage_error("expected one or more capture files");
+		for (const auto& path : a)
+			if (path.compare(0, 2, "--") == 0)
+				throw usage_error("unexpected argument " + path);
+		if (cfg.deadzone < 0 || cfg.deadzone > 1)
+			throw usage_error("--deadzone must be 0 to 1");
+
+		const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+		const auto jobs = std::min<std::size_t>(a.size(),
+			jobs_option.empty() ? hardware : std::max(1u, to_uint(jobs_option, "--jobs")));
+
+		struct result {
+			procon::capture_stats stats;
+			std::string error;
+		};
+		std::vector<result> results(a.size());
+		std::atomic<std::size_t> next {0};
+
+		const auto start = procon::clock_us();
+		std::vector<std::thread> threads;
+		for (std::size_t j = 0; j < jobs; ++j)
+			threads.emplace_back([&] {
+				for (auto i = next++; i < a.size(); i = next++)
+					try {
+						const procon::mapped_capture capture(a[i]);
+						results[i].stats = procon::analyze_capture(capture, cfg);
+					} catch (const std::exception& e) {
+						results[i].error = e.what();
+					}
+			});
+		for (auto& t : threads)
+			t.join();
+		const auto elapsed_us = procon::clock_us() - start;
+
+		procon::capture_stats session {};
+		std::size_t failed = 0;
+		for (std::size_t i = 0; i < a.size(); ++i)
+			if (results[i].error.empty())
+				procon::merge(session, results[i].stats);
+			else {
+				std::cerr << results[i].error << '\n';
+				++failed;
+			}
+		if (failed == a.size())
+			return 1;
+
+		std::size_t name_width = 8;
+		for (const auto& path : a)
+			name_width = std::max(name_width, path.size() + 2);
+
+		const auto ms = [](const std::uint64_t us) { return us / 1000.0; };
+		const auto percent = [](const std::uint64_t part, const std::uint64_t whole) {
+			return whole == 0 ? 0.0 : 100.0 * part / whole;
+		};
+		const auto each = [&](const std::function<void(const procon::capture_stats&)>& row) {
+			for (std::size_t i = 0; i < a.size(); ++i)
+				if (results[i].error.empty()) {
+					std::cout << std::left << std::setw(static_cast<int>(name_width)) << a[i] << std::right;
+					row(results[i].stats);
+				}
+			std::cout << std::left << std::setw(static_cast<int>(name_width)) << "session" << std::right;
+			row(session);
+		};
+
+		std::cout << a.size() - failed << " captures, " << session.records << " records, " << jobs
+				  << (jobs == 1 ? " thread, " : " threads, ") << std::fixed << std::setprecision(1)
+				  << ms(elapsed_us) << " ms\n\n"
+				  << std::left << std::setw(static_cast<int>(name_width)) << "capture" << std::right
+				  << " reports  rate Hz  gap p50 ms   p99    max     lost  out of dz L %    R %  rumble %\n";
+		each([&](const procon::capture_stats& s) {
+			std::cout << std::setw(8) << s.reports << std::setw(9) << procon::report_rate_hz(s)
+					  << std::setprecision(2)
+					  << std::setw(12) << ms(procon::gap_percentile(s, 0.5))
+					  << std::setw(6) << ms(procon::gap_percentile(s, 0.99))
+					  << std::setw(7) << ms(s.longest_gap_us) << std::setw(9) << s.lost
+					  << std::setprecision(1)
+					  << std::setw(15) << percent(s.outside_deadzone[0], s.reports)
+					  << std::setw(7) << percent(s.outside_deadzone[1], s.reports)
+					  << std::setw(10) << percent(s.rumble_on_us, s.duration_us) << '\n';
+		});
+
+		std::cout << '\n' << std::left << std::setw(static_cast<int>(name_width)) << "stick range" << std::right
+				  << "          lx          ly          rx          ry\n";
+		each([&](const procon::capture_stats& s) {
+			for (std::size_t axis = 0; axis < 4; ++axis) {
+				const auto range = s.reports == 0 ? std::string("-")
+						: std::to_string(s.stick_min[axis]) + ".." + std::to_string(s.stick_max[axis]);
+				std::cout << std::setw(12) << range;
+			}
+			std::cout << '\n';
+		});
+
+		std::cout << "\nbutton        presses  mean hold ms  longest ms  (session)\n";
+		for (std::size_t b = 0; b < procon::button_count; ++b) {
+			const auto& h = session.buttons[b];
+			if (h.presses == 0)
+				continue;
+			std::cout << std::left << std::setw(12) << procon::button_to_string(procon::bit_to_button(b))
+					  << std::right << std::setw(9) << h.presses
+					  << std::setw(14) << ms(h.held_us / h.presses) << std::setw(12) << ms(h.longest_us) << '\n';
+		}
+		return failed == 0 ? 0 : 1;
+	}
+
+	// Streams a simulated controller through read, decode and link tracking
+	int simulate(args a) {
+		procon::simulated_controller::config sim;
+		sim.rate_hz = to_uint(take_option(a, "--rate-hz", "120"), "--rate-hz");
+		sim.drop_per_mille = to_uint(take_option(a, "--drop-per-mille", "0"), "--drop-per-mille");
+		const auto seconds = to_uint(take_option(a, "--seconds", "5"), "--seconds");
+		const auto poll_us = to_uint(take_option(a, "--poll-us", "1000"), "--poll-us");
+		const auto record = take_option(a, "--record");
+		const auto pattern = take_option(a, "--pattern", "sweep");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+
+		if (pattern == "idle")
+			sim.pattern = procon::sim_pattern::idle;
+		else if (pattern == "sweep")
+			sim.pattern = procon::sim_pattern::sweep;
+		else
+			sim.recording = procon::read_capture(pattern);
+
+		procon::capture_writer capture;
+		if (!record.empty() && !capture.open(record))
+			throw std::runtime_error("can't write " + record);
+
+		procon::simulated_controller device(std::move(sim));
+		procon::link_monitor link;
+		procon::uchar buf[64];
+		procon::input_report report;
+		std::uint64_t read = 0, decoded = 0;
+
+		const auto end = procon::clock_us() + seconds * 1000000ull;
+		while (procon::clock_us() < end) {
+			int size;
+			while ((size = device.read(buf, sizeof buf)) > 0) {
+				const auto now = procon::clock_us();
+				++read;
+				capture.write(now, buf, static_cast<std::size_t>(size));
+				if (!procon::decode_report(buf, static_cast<std::size_t>(size), report))
+					continue;
+				++decoded;
+				link.report(report.timer, now);
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(poll_us));
+		}
+
+		const auto& s = link.stats();
+		std::cout << std::fixed << std::setprecision(1)
+				  << device.reports_sent() << " sent, " << read << " read, " << decoded << " decoded\n"
+				  << "rate " << s.rate_hz << " Hz, lost " << s.lost << " in " << s.gaps
+				  << " gaps, duplicates " << s.duplicates << ", longest gap "
+				  << s.longest_gap_us / 1000.0 << " ms\n"
+				  << "tick " << s.tick_us << " us, jitter " << s.jitter_us
+				  << " us, queued " << s.queue_us << " us\n";
+		return 0;
+	}
+
+	struct cpu_times {
+		std::uint64_t user_us, kernel_us;
+	};
+
+	cpu_times process_times() {
+		FILETIME created, exited, kernel, user;
+		if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+			return {0, 0};
+
+		const auto to_us = [](const FILETIME& f) {
+			return (static_cast<std::uint64_t>(f.dwHighDateTime) << 32 | f.dwLowDateTime) / 10;
+		};
+		return {to_us(user), to_us(kernel)};
+	}
+
+	// User plus kernel time of the whole process
+	std::uint64_t process_cpu_us() {
+		const auto t = process_times();
+		return t.user_us + t.kernel_us;
+	}
+
+	// One simulated controller under benchmark and the latencies it saw,
+	// from the simulator sending a report to its pad being submitted
+	struct bench_seat {
+		procon::simulated_controller* sim;
+		std::unique_ptr<procon::controller> pipeline;
+		std::vector<std::uint32_t> latency_us;
+		std::uint64_t reports {0};
+
+		void service() {
+			const auto n = pipeline->service();
+			if (n <= 0)
+				return;
+			reports += static_cast<std::uint64_t>(n);
+			const auto sent = sim->sent_at(pipeline->last_report().timer);
+			latency_us.push_back(static_cast<std::uint32_t>(procon::clock_us() - sent));
+		}
+	};
+
+	std::uint32_t percentile(std::vector<std::uint32_t>& v, const double p) {
+		if (v.empty())
+			return 0;
+		const auto rank = static_cast<std::size_t>(p * (v.size() - 1) + 0.5);
+		std::nth_element(v.begin(), v.begin() + rank, v.end());
+		return v[rank];
+	}
+
+	// N simulated controllers through read, decode, map and submit into the
+	// memory backend, either one thread each or all on one polling thread
+	int bench(args a) {
+		const auto count = to_uint(take_option(a, "--controllers", "4"), "--controllers");
+		const auto rate = to_uint(take_option(a, "--rate-hz", "120"), "--rate-hz");
+		const auto seconds = to_uint(take_option(a, "--seconds", "5"), "--seconds");
+		const auto poll_us = to_uint(take_option(a, "--poll-us", "1000"), "--poll-us");
+		const auto mode = take_option(a, "--mode", "threads");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+		if (count < 1 || count > 64)
+			throw usage_error("--controllers must be 1 to 64");
+		if (mode != "threads" && mode != "loop")
+			throw usage_error("--mode must be threads or loop");
+
+		procon::memory_backend backend(count);
+		const procon::profile profile;
+		std::vector<bench_seat> seats(count);
+
+		for (unsigned i = 0; i < count; ++i) {
+			procon::simulated_controller::config sim;
+			sim.rate_hz = rate;
+			sim.pattern = procon::sim_pattern::sweep;
+
+			auto device = std::unique_ptr<procon::simulated_controller>(
+					new procon::simulated_controller(std::move(sim)));
+			seats[i].sim = device.get();
+			seats[i].pipeline.reset(new procon::controller(std::move(device), backend, i));
+			seats[i].pipeline->load(profile);
+			seats[i].latency_us.reserve(static_cast<std::size_t>(rate) * seconds + 64);
+			backend.plug(i);
+		}
+
+		std::atomic<std::uint64_t> wakeups {0};
+		const auto cpu_before = process_cpu_us();
+		const auto end = procon::clock_us() + seconds * 1000000ull;
+		const auto sleep = std::chrono::microseconds(poll_us);
+
+		if (mode == "threads") {
+			std::vector<std::thread> threads;
+			for (auto& seat : seats)
+				threads.emplace_back([&seat, &wakeups, end, sleep] {
+					std::uint64_t woke = 0;
+					while (procon::clock_us() < end) {
+						seat.service();
+						std::this_thread::sleep_for(sleep);
+						++woke;
+					}
+					wakeups += woke;
+				});
+			for (auto& t : threads)
+				t.join();
+		} else {
+			while (procon::clock_us() < end) {
+				for (auto& seat : seats)
+					seat.service();
+				std::this_thread::sleep_for(sleep);
+				++wakeups;
+			}
+		}
+
+		const auto cpu_us = process_cpu_us() - cpu_before;
+		std::uint64_t reports = 0;
+		std::vector<std::uint32_t> all;
+
+		std::cout << std::fixed << std::setprecision(2)
+				  << count << " controllers at " << rate << " Hz, " << mode
+				  << ", polling every " << poll_us << " us\n"
+				  << " pad  reports   p50 ms   p99 ms   max ms\n";
+		for (unsigned i = 0; i < count; ++i) {
+			auto& l = seats[i].latency_us;
+			reports += seats[i].reports;
+			all.insert(all.end(), l.begin(), l.end());
+
+			const auto max = l.empty() ? 0 : *std::max_element(l.begin(), l.end());
+			std::cout << std::setw(4) << i << std::setw(9) << seats[i].reports
+					  << std::setw(9) << percentile(l, 0.5) / 1000.0
+					  << std::setw(9) << percentile(l, 0.99) / 1000.0
+					  << std::setw(9) << max / 1000.0 << '\n';
+		}
+
+		std::cout << " all" << std::setw(9) << reports
+				  << std::setw(9) << percentile(all, 0.5) / 1000.0
+				  << std::setw(9) << percentile(all, 0.99) / 1000.0 << '\n'
+				  << "cpu " << cpu_us / 1000.0 << " ms, "
+				  << (reports ? static_cast<double>(cpu_us) / reports : 0) << " us per report\n"
+				  << "wakeups " << wakeups.load() << " ("
+				  << (reports ? static_cast<double>(wakeups.load()) / reports : 0)
+				  << " per report)\n";
+		return 0;
+	}
+
+	// What one real controller delivered during io-bench
+	struct io_seat : procon::report_handler {
+		procon::link_monitor link;
+		std::uint64_t reports {0};
+		bool failed {false};
+
+		void on_report(const procon::uchar* data, const std::size_t size,
+					   const std::uint64_t now_us) override {
+			procon::input_report r;
+			++reports;
+			if (procon::decode_report(data, size, r))
+				link.report(r.timer, now_us);
+		}
+		void on_batch_end(std::uint64_t) override {}
+		void on_error(DWORD) override { failed = true; }
+	};
+
+	// Neutral rumble, so writes are part of the load without shaking anything
+	std::array<procon::uchar, 10> rumble_packet(std::uint8_t& counter) {
+		return {{0x10, static_cast<procon::uchar>(counter++ & 0x0F),
+				 0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40}};
+	}
+
+	// Every connected Pro Controller read through hidapi (a thread each,
+	// one call per report, or per backlog with hid_read_many) or through the
+	// reactor (one thread, several reads queued per device, writes on the
+	// same port)
+	int io_bench(args a) {
+		const auto mode = take_option(a, "--mode", "reactor");
+		const auto depth = to_uint(take_option(a, "--depth",
+				std::to_string(procon::reactor::default_read_depth)), "--depth");
+		const auto seconds = to_uint(take_option(a, "--seconds", "10"), "--seconds");
+		const auto rumble_hz = to_uint(take_option(a, "--rumble-hz", "0"), "--rumble-hz");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+		if (mode != "hidapi" && mode != "hidapi-many" && mode != "reactor")
+			throw usage_error("--mode must be hidapi, hidapi-many or reactor");
+		if (depth < 1 || depth > 64)
+			throw usage_error("--depth must be 1 to 64");
+
+		const auto found = procon::find_pro_controllers(std::cerr);
+		if (found.empty())
+			throw std::runtime_error("no Pro Controller found");
+
+		std::vector<std::unique_ptr<io_seat>> seats;
+		for (std::size_t i = 0; i < found.size(); ++i)
+			seats.emplace_back(new io_seat);
+
+		const auto rumble_us = rumble_hz ? 1000000ull / rumble_hz : 0;
+		std::uint64_t calls = 0, writes = 0;
+		const auto before = process_times();
+		const auto end = procon::clock_us() + seconds * 1000000ull;
+
+		if (mode != "reactor") {
+			std::vector<hid_device*> devices;
+			for (const auto& f : found) {
+				auto* d = hid_open_path(f.path.c_str());
+				if (d == nullptr)
+					throw std::runtime_error("can't open " + f.path);
+				devices.push_back(d);
+			}
+
+			std::atomic<std::uint64_t> read_calls {0}, write_calls {0};
+			std::vector<std::thread> threads;
+			for (std::size_t i = 0; i < devices.size(); ++i)
+				threads.emplace_back([&, i] {
+					constexpr std::size_t batch = 16;
+					procon::uchar buf[batch][64];
+					std::uint8_t counter = 0;
+					std::uint64_t next_rumble = 0, n = 0, w = 0;
+					auto& seat = *seats[i];
+
+					for (auto now = procon::clock_us(); now < end; now = procon::clock_us()) {
+						if (rumble_us && now >= next_rumble) {
+							next_rumble = now + rumble_us;
+							const auto p = rumble_packet(counter);
+							hid_write(devices[i], p.data(), p.size());
+							++w;
+						}
+
+						++n;
+						std::size_t length = 0;
+						const auto got = mode == "hidapi"
+								? hid_read_timeout(devices[i], buf[0], sizeof buf[0], 10)
+								: hid_read_many(devices[i], buf[0], sizeof buf[0], batch, &length, 10);
+						if (got < 0) {
+							seat.on_error(GetLastError());
+							break;
+						}
+						const auto arrived = procon::clock_us();
+						if (mode == "hidapi" && got > 0)
+							seat.on_report(buf[0], static_cast<std::size_t>(got), arrived);
+						else
+							for (auto r = 0; r < got; ++r)
+								seat.on_report(buf[r], length, arrived);
+					}
+					read_calls += n;
+					write_calls += w;
+				});
+			for (auto& t : threads)
+				t.join();
+			for (auto* d : devices)
+				hid_close(d);
+			calls = read_calls;
+			writes = write_calls;
+		} else {
+			procon::reactor r;
+			for (std::size_t i = 0; i < found.size(); ++i) {
+				const auto handle = procon::open_overlapped(found[i].path);
+				if (handle == INVALID_HANDLE_VALUE)
+					throw std::runtime_error("can't open " + found[i].path);
+				r.add(handle, found[i].input_length, found[i].output_length, *seats[i], depth);
+			}
+
+			std::uint8_t counter = 0;
+			std::uint64_t next_rumble = 0;
+			r.run(10, [&](const std::uint64_t now_us) {
+				if (now_us >= end)
+					r.stop();
+				if (!rumble_us || now_us < next_rumble)
+					return;
+				next_rumble = now_us + rumble_us;
+				const auto p = rumble_packet(counter);
+				for (std::size_t i = 0; i < seats.size(); ++i)
+					r.write(i, p.data(), p.size());
+			});
+
+			const auto& c = r.syscalls();
+			calls = c.waits + c.reads;
+			writes = c.writes;
+			std::cout << "waits " << c.waits << ", completions " << c.completions
+					  << " (" << (c.waits ? static_cast<double>(c.completions) / c.waits : 0)
+					  << " per wait), reads " << c.reads << ", writes " << c.writes << '\n';
+		}
+
+		const auto after = process_times();
+		std::uint64_t reports = 0;
+
+		std::cout << std::fixed << std::setprecision(2)
+				  << found.size() << " controllers, " << mode;
+		if (mode == "reactor")
+			std::cout << " with " << depth << " reads queued each";
+		std::cout << ", " << seconds << " s\n"
+				  << " pad  reports  rate Hz  lost  jitter us  queued us\n";
+		for (std::size_t i = 0; i < seats.size(); ++i) {
+			const auto& s = seats[i]->link.stats();
+			reports += seats[i]->reports;
+			std::cout << std::setw(4) << i << std::setw(9) << seats[i]->reports
+					  << std::setw(9) << s.rate_hz << std::setw(6) << s.lost
+					  << std::setw(11) << s.jitter_us << std::setw(11) << s.queue_us
+					  << (seats[i]->failed ? "  (failed)" : "") << '\n';
+		}
+
+		const auto per_report = [reports](const std::uint64_t v) {
+			return reports ? static_cast<double>(v) / reports : 0;
+		};
+		// hidapi's call count is hid_read_timeout calls, each one to four
+		// system calls; the reactor's is exact
+		std::cout << (mode != "reactor" ? "hidapi calls " : "system calls ") << calls + writes
+				  << " (" << per_report(calls + writes) << " per report)\n"
+				  << "cpu user " << (after.user_us - before.user_us) / 1000.0
+				  << " ms, kernel " << (after.kernel_us - before.kernel_us) / 1000.0 << " ms, "
+				  << per_report(after.user_us - before.user_us + after.kernel_us - before.kernel_us)
+				  << " us per report\n";
+		return 0;
+	}
+
+	// A pre-built report the alloc-check transport hands out
+	struct replayed_report {
+		std::array<procon::uchar, 64> bytes;
+		std::size_t size;
+	};
+
+	// 12-bit stick axes as the controller packs them, x low
+	void pack_stick(procon::uchar* s, const unsigned x, const unsigned y) {
+		s[0] = static_cast<procon::uchar>(x & 0xFF);
+		s[1] = static_cast<procon::uchar>(x >> 8 | (y & 0x0F) << 4);
+		s[2] = static_cast<procon::uchar>(y >> 4);
+	}
+
+	// Full reports with both sticks circling, a button at a time held and
+	// the IMU bytes never the same twice in a row
+	std::vector<replayed_report> synthetic_reports() {
+		std::vector<replayed_report> out(256);
+		for (std::size_t i = 0; i < out.size(); ++i) {
+			auto& d = out[i].bytes;
+			d = {};
+			out[i].size = d.size();
+			d[0] = 0x30;
+			d[2] = 0x80; // full battery, not charging
+			d[3 + i / 8 % 3] = static_cast<procon::uchar>(1u << i % 8);
+
+			const auto angle = 2 * 3.14159265358979 * i / out.size();
+			pack_stick(d.data() + 6, static_cast<unsigned>(2048 + 1500 * std::cos(angle)),
+					   static_cast<unsigned>(2048 + 1500 * std::sin(angle)));
+			pack_stick(d.data() + 9, static_cast<unsigned>(2048 - 1500 * std::cos(angle)),
+					   static_cast<unsigned>(2048 + 1500 * std::sin(angle)));
+			for (std::size_t b = 13; b < procon::input_report_size; ++b)
+				d[b] = static_cast<procon::uchar>(i * 31 + b);
+		}
+		return out;
+	}
+
+	// The full input reports of a capture
+	std::vector<replayed_report> captured_reports(const std::string& path) {
+		const procon::mapped_capture capture(path);
+		procon::capture_cursor cursor(capture);
+		procon::capture_record r;
+		std::vector<replayed_report> out;
+
+		while (cursor.next(r)) {
+			if (r.size < procon::input_report_size || r.size > 64 || r.data[0] != 0x30)
+				continue;
+			replayed_report report {};
+			std::copy(r.data, r.data + r.size, report.bytes.begin());
+			report.size = r.size;
+			out.push_back(report);
+		}
+		if (out.empty())
+			throw std::runtime_error(path + " holds no full input reports");
+		return out;
+	}
+
+	// One end of a message-mode pipe standing in for a controller's HID
+	// handle. The reactor gets the other, overlapped end, reads the input
+	// reports written here as if a device sent them, and writes output
+	// reports back.
+	class loopback_device {
+		const std::vector<replayed_report>& reports;
+		HANDLE pipe {INVALID_HANDLE_VALUE};
+		std::size_t next {0};
+		std::uint8_t timer {0};
+		std::uint64_t written {0};
+		std::uint64_t read_back {0};
+	public:
+		loopback_device(const std::vector<replayed_report>& r) : reports(r) {}
+		loopback_device(const loopback_device&) = delete;
+		loopback_device& operator=(const loopback_device&) = delete;
+		~loopback_device() {
+			if (pipe != INVALID_HANDLE_VALUE)
+				CloseHandle(pipe);
+		}
+
+		// Returns the reactor's end, opened with FILE_FLAG_OVERLAPPED
+		HANDLE open(const unsigned index) {
+			const auto name = "\\\\.\\pipe\\procon-alloc-check-"
+					+ std::to_string(GetCurrentProcessId()) + "-" + std::to_string(index);
+			pipe = CreateNamedPipeA(name.c_str(), PIPE_ACCESS_DUPLEX,
+									PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
+									1, 4096, 4096, 0, nullptr);
+			if (pipe == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("can't create " + name);
+
+			const auto end = CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+										 OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+			DWORD mode = PIPE_READMODE_MESSAGE;
+			if (end == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("can't open " + name);
+			if (!SetNamedPipeHandleState(end, &mode, nullptr, nullptr)) {
+				CloseHandle(end);
+				throw std::runtime_error("can't read " + name + " by message");
+			}
+			return end;
+		}
+
+		// Sends 'n' more reports
+		void arrive(const std::size_t n) {
+			for (std::size_t i = 0; i < n; ++i) {
+				auto r = reports[next++ % reports.size()];
+				DWORD done = 0;
+				r.bytes[1] = timer++;
+				if (!WriteFile(pipe, r.bytes.data(), static_cast<DWORD>(r.size), &done, nullptr))
+					throw std::runtime_error("loopback write failed");
+				++written;
+			}
+		}
+
+		// Takes whatever output reports the reactor wrote
+		void drain() {
+			std::array<procon::uchar, 64> buf;
+			DWORD available = 0;
+			while (PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr) && available != 0) {
+				DWORD done = 0;
+				if (!ReadFile(pipe, buf.data(), static_cast<DWORD>(buf.size()), &done, nullptr))
+					break;
+				++read_back;
+			}
+		}
+
+		std::uint64_t sent() const { return written; }
+		std::uint64_t writes() const { return read_back; }
+	};
+
+	// A memory backend whose host always wants rumble, with the motors and
+	// player LED moving, so feedback goes down every branch
+	class rumbling_backend : public procon::memory_backend {
+		std::uint32_t calls {0};
+	public:
+		using memory_backend::memory_backend;
+
+		bool feedback(const unsigned index, procon::pad_feedback& out) override {
+			const auto n = calls++;
+			out.vibrate = 1;
+			out.large_motor = static_cast<BYTE>(n * 7 + index);
+			out.small_motor = static_cast<BYTE>(n * 13);
+			out.led = static_cast<BYTE>(n / 64 % 4);
+			return true;
+		}
+	};
+
+	// Counts what the gestures and bound keys would inject
+	class counting_sink : public procon::output_sink {
+		std::uint64_t injected {0};
+	protected:
+		void inject(const procon::output_event*, const std::size_t count) override {
+			injected += count;
+		}
+	public:
+		std::uint64_t events() const { return injected; }
+	};
+
+	struct alloc_result {
+		std::uint64_t reports;
+		std::uint64_t writes;
+		std::uint64_t submits;
+		std::uint64_t keys;
+		std::uint64_t allocations;
+		std::uint64_t bytes;
+		std::size_t first_size;
+		long handles; // opened minus closed
+		bool published;
+	};
+
+	long handle_count() {
+		DWORD n = 0;
+		GetProcessHandleCount(GetCurrentProcess(), &n);
+		return static_cast<long>(n);
+	}
+
+	// Builds 'count' controllers the way the driver's reactor path does, on
+	// a reactor reading loopback pipes, with the driver's layers and state
+	// export in the hook. Warms them up, then counts what 'total' more
+	// reports through read, decode, map, the layers, submit, export and
+	// rumble cost in allocations and handles.
+	alloc_result run_steady_state(const std::string& mode, const std::vector<replayed_report>& reports,
+								  const unsigned count, const std::uint64_t total,
+								  procon::capture_writer* capture) {
+		constexpr std::uint64_t warm_up = 1000; // per controller
+		constexpr std::uint32_t feedback_every = 8; // ticks; about 120 Hz against 1 kHz reports
+		constexpr std::size_t depth = procon::reactor::default_read_depth;
+
+		rumbling_backend backend(count);
+		procon::pad_table table;
+		procon::reactor r;
+		std::vector<std::unique_ptr<procon::controller>> pads;
+		std::vector<std::unique_ptr<loopback_device>> devices;
+
+		counting_sink keys;
+		procon::fusion fused;
+		procon::input_layers layers(keys, fused);
+		layers.set_profiles(procon::default_profiles(), 0);
+		// A no-op while a running driver owns the region
+		procon::state_publisher state;
+		state.open();
+		std::vector<procon::shared::controller_state> exports(count);
+
+		procon::resample_config resampling;
+		resampling.mode = procon::resample_mode::interpolate;
+		resampling.output_hz = 1000;
+
+		// The driver's reactor hook, less DirectInput polling
+		const auto hook = [&](procon::controller& c, XINPUT_GAMEPAD& pad, const std::uint32_t now_ms) {
+			if (c.slot() == 0) {
+				if (layers.input(c.last_report().buttons, now_ms))
+					for (auto& p : pads)
+						p->load(layers.active_profile());
+				layers.overlay(pad, now_ms);
+			}
+			auto& s = exports[c.slot()];
+			procon::export_pad(c, pad, s);
+			state.publish(c.slot(), s);
+		};
+
+		for (unsigned i = 0; i < count; ++i) {
+			devices.emplace_back(new loopback_device(reports));
+			const auto handle = devices.back()->open(i);
+			pads.emplace_back(new procon::controller(
+					std::unique_ptr<procon::transport>(new procon::reactor_transport(r, i)),
+					backend, i));
+			auto& c = *pads.back();
+			r.add(handle, 64, 64, c, depth);
+			c.load(layers.active_profile());
+			c.set_rumble_limit(200);
+			c.set_hook(hook);
+			// A capture holds the first pad's reports, as the driver's does
+			if (i == 0 && capture != nullptr)
+				c.set_recorder(capture);
+			if (mode == "resample")
+				c.set_resampling(resampling);
+			else if (mode == "table")
+				c.attach(table);
+			backend.plug(i);
+		}
+
+		std::array<procon::pad_feedback, 64> feedback;
+		std::uint64_t sent = 0, delivered = 0, writes_before = 0, submits_before = 0;
+		std::uint32_t ticks = 0;
+		long handles_before = 0;
+		auto measuring = false;
+		alloc_result result {};
+
+		r.run(1, [&](const std::uint64_t now_us) {
+			// As the driver's tick: whatever this wakeup staged, then feedback
+			for (auto& c : pads)
+				c->pace(now_us);
+			table.process();
+			for (auto& c : pads)
+				c->finish();
+			for (auto& d : devices)
+				d->drain();
+
+			if (ticks++ % feedback_every == 0) {
+				for (auto& c : pads) {
+					backend.feedback(c->slot(), feedback[c->slot()]);
+					c->stage_feedback(feedback[c->slot()]);
+				}
+				table.scale_motors();
+				for (auto& c : pads)
+					c->apply_feedback(feedback[c->slot()]);
+			}
+
+			// First use claims the thread's trace ring and the like
+			if (!measuring && delivered >= warm_up * count) {
+				for (unsigned i = 0; i < count; ++i) {
+					writes_before += devices[i]->writes();
+					submits_before += backend.submits(i);
+				}
+				result.keys = keys.events();
+				delivered = 0;
+				measuring = true;
+				handles_before = handle_count();
+				procon::alloc_count::arm();
+			} else if (measuring && delivered >= total) {
+				procon::alloc_count::disarm();
+				result.handles = handle_count() - handles_before;
+				for (unsigned i = 0; i < count; ++i) {
+					result.writes += devices[i]->writes();
+					result.submits += backend.submits(i);
+				}
+				r.stop();
+				return;
+			}
+
+			// One or two reports per controller per tick, as a device
+			// delivers them when the reactor runs late. None while the reads
+			// queued are all taken, so the pipes never fill.
+			const auto completed = r.syscalls().reads - depth * count;
+			if (sent >= completed + depth * count)
+				return;
+			const std::size_t arriving = 1 + ticks % 2;
+			for (auto& d : devices)
+				d->arrive(arriving);
+			sent += arriving * count;
+			delivered += arriving * count;
+		});
+
+		result.reports = delivered;
+		result.allocations = procon::alloc_count::allocations();
+		result.bytes = procon::alloc_count::bytes();
+		result.first_size = procon::alloc_count::first_size();
+		result.writes -= writes_before;
+		result.submits -= submits_before;
+		result.keys = keys.events() - result.keys;
+		result.published = state.is_open();
+		return result;
+	}
+
+	// Fails if the driver's reactor path (the reactor, procon::controller's
+	// decode, map, submit and rumble, and the hook's layers and state export)
+	// allocates or opens a handle once the controllers are set up, so it
+	// stays allocation-free as the code changes. Counts through a replaced
+	// global operator new. Keys are counted rather than sent, DirectInput
+	// devices aren't polled and a profile switch, which loads the new
+	// profile, isn't steady state. The dialog timer path in main.cpp, with
+	// its dialog text, isn't run here and makes no such promise.
+	int alloc_check(args a) {
+		const auto total = to_uint(take_option(a, "--reports", "100000"), "--reports");
+		const auto count = to_uint(take_option(a, "--controllers", "4"), "--controllers");
+		const auto mode = take_option(a, "--mode", "all");
+		const auto source = take_option(a, "--capture");
+		const auto record = take_option(a, "--record");
+		if (!a.empty())
+			throw usage_error("unexpected argument " + a[0]);
+		if (count < 1 || count > 64)
+			throw usage_error("--controllers must be 1 to 64");
+		if (mode != "all" && mode != "direct" && mode != "resample" && mode != "table")
+			throw usage_error("--mode must be all, direct, resample or table");
+
+		const auto reports = source.empty() ? synthetic_reports() : captured_reports(source);
+		procon::capture_writer capture;
+		if (!record.empty() && !capture.open(record))
+			throw std::runtime_error("can't write " + record);
+
+		std::vector<std::string> modes;
+		if (mode == "all")
+			modes = {"direct", "resample", "table"};
+		else
+			modes = {mode};
+
+		auto failed = false;
+		std::cout << count << " controllers, " << total << " reports per run"
+				  << (record.empty() ? "" : ", recording") << '\n'
+				  << "mode       reports   writes  submits  keys  allocations     bytes  handles\n";
+		for (const auto& m : modes) {
+			const auto r = run_steady_state(m, reports, count, total,
+											capture.is_open() ? &capture : nullptr);
+			std::cout << std::left << std::setw(8) << m << std::right
+					  << std::setw(10) << r.reports << std::setw(9) << r.writes
+					  << std::setw(9) << r.submits << std::setw(6) << r.keys << std::setw(13) << r.allocations
+					  << std::setw(10) << r.bytes << std::setw(9) << r.handles << '\n';
+			if (r.allocations != 0)
+				std::cout << "  the first allocation was " << r.first_size << " bytes\n";
+			if (!r.published)
+				std::cout << "  another driver owns the shared state region; nothing was published\n";
+			failed = failed || r.allocations != 0 || r.handles != 0;
+		}
+
+		std::cout << (failed ? "FAIL: the reactor path allocates or opens handles\n"
+							 : "ok: no allocations or handles on the reactor path\n");
+		return failed ? 1 : 0;
+	}
+
+	struct command {
+		const char* name;
+		const char* usage;
+		int (*run)(args);
+	};
+
+	const command commands[] = {
+		{"trace-dump", "<file> [--chrome <out.json>]", trace_dump},
+		{"rtt-probe", "[--count N] [--interval-ms N] [--fake-delay-ms N [--fake-jitter-ms N]]", rtt_probe},
+		{"bench", "[--controllers 1..64] [--rate-hz N] [--mode threads|loop] [--seconds N]\n"
+				  "           [--poll-us N]", bench},
+		{"io-bench", "[--mode hidapi|hidapi-many|reactor] [--depth N] [--seconds N]\n"
+					 "           [--rumble-hz N]", io_bench},
+		{"handshake", "[--mode full|simple] [--usb] [--simulate]", handshake},
+		{"link-bench", "[--seconds N] [--simulate]", link_bench},
+		{"resample-eval", "<capture> [--output-hz N] [--horizon-ms N] [--overshoot F]", resample_eval},
+		{"table-bench", "[--controllers N,N,...] [--frames N]", table_bench},
+		{"decode", "<capture> [--out <prefix>] [--kernel scalar|ssse3|avx2]", decode},
+		{"analyze", "<capture>... [--jobs N] [--deadzone F]", analyze},
+		{"capture-convert", "<capture> <out.capture>", capture_convert},
+		{"alloc-check", "[--reports N] [--controllers N] [--mode all|direct|resample|table]\n"
+						"           [--capture <file>] [--record <capture>]", alloc_check},
+		{"simulate", "[--rate-hz N] [--pattern idle|sweep|<capture>] [--drop-per-mille N]\n"
+					 "           [--seconds N] [--poll-us N] [--record <capture>]", simulate},
+	};
+
+	void print_usage() {
+		std::cerr << "usage:\n";
+		for (const auto& c : commands)
+			std::cerr << "  procon-tools " << c.name << ' ' << c.usage << '\n';
+	}
+}
+
+int main(const int argc, char** argv) {
+	if (argc < 2) {
+		print_usage();
+		return 2;
+	}
+
+	for (const auto& c : commands) {
+		if (std::strcmp(argv[1], c.name) != 0)
+			continue;
+
+		try {
+			return c.run(args(argv + 2, argv + argc));
+		} catch (const usage_error& e) {
+			std::cerr << c.name << ": " << e.what() << "\nusage: procon-tools "
+					  << c.name << ' ' << c.usage << '\n';
+			return 2;
+		} catch (const std::exception& e) {
+			std::cerr << c.name << ": " << e.what() << '\n';
+			return 1;
+		}
+	}
+
+	print_usage();
+	return 2;
+}
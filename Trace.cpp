@@ -0,0 +1,150 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include "Clock.hpp"
+
+namespace procon {
+	namespace trace {
+		namespace {
+			std::atomic<ring*> rings[max_threads];
+			std::atomic<std::uint32_t> claimed {0};
+
+			// Reference point for converting TSC ticks to time at dump
+			struct calibration {
+				std::uint64_t us;
+				std::uint64_t tsc;
+			};
+			const calibration start {clock_us(), __rdtsc()};
+
+			ring* claim() {
+				const auto i = claimed.fetch_add(1, std::memory_order_relaxed);
+				if (i >= max_threads)
+					return nullptr;
+
+				auto* r = new ring;
+				r->thread_id = GetCurrentThreadId();
+				r->index = static_cast<std::uint16_t>(i);
+				rings[i].store(r, std::memory_order_release);
+				return r;
+			}
+
+			struct file_closer {
+				void operator()(std::FILE* f) const { std::fclose(f); }
+			};
+			using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+		}
+
+		ring* this_thread_ring() {
+			// Rings are never freed: a dump may run after their thread exits
+			thread_local ring* const r = claim();
+			return r;
+		}
+
+		const char* event_name(const event type) {
+			switch (type) {
+			case event::report_received: return "report_received";
+			case event::report_decoded: return "report_decoded";
+			case event::submitted: return "submitted";
+			case event::rumble_sent: return "rumble_sent";
+			case event::subcommand_reply: return "subcommand_reply";
+			case event::error: return "error";
+			}
+			return "unknown";
+		}
+
+		bool dump(const std::string& path) {
+			const file_ptr f {std::fopen(path.c_str(), "wb")};
+			if (!f)
+				return false;
+
+			const auto elapsed_us = clock_us() - start.us;
+			const auto elapsed_tsc = __rdtsc() - start.tsc;
+
+			file_header header {};
+			header.magic = file_magic;
+			header.version = file_version;
+			header.tsc_per_second = elapsed_us == 0 ? 0
+					: static_cast<std::uint64_t>(elapsed_tsc * 1e6 / elapsed_us);
+
+			std::vector<ring*> present;
+			const auto n = std::min<std::size_t>(claimed.load(), max_threads);
+			for (std::size_t i = 0; i < n; ++i)
+				if (auto* r = rings[i].load(std::memory_order_acquire))
+					present.push_back(r);
+			header.rings = static_cast<std::uint32_t>(present.size());
+
+			if (std::fwrite(&header, sizeof header, 1, f.get()) != 1)
+				return false;
+
+			std::vector<record> copy;
+			for (auto* r : present) {
+				const auto head = r->head.load(std::memory_order_acquire);
+				const auto first = head > ring_size ? head - ring_size : 0;
+
+				copy.clear();
+				for (auto i = first; i < head; ++i)
+					copy.push_back(r->records[i & (ring_size - 1)]);
+
+				// Anything the writer lapped while we copied is torn, including
+				// the slot it may be filling right now; drop it
+				const auto after = r->head.load(std::memory_order_acquire) + 1;
+				const auto valid_from = after > ring_size ? after - ring_size : 0;
+				const auto torn = valid_from > first
+						? std::min<std::uint64_t>(valid_from - first, copy.size()) : 0;
+
+				const std::uint32_t meta[2] = {
+					r->thread_id,
+					static_cast<std::uint32_t>(copy.size() - torn)
+				};
+				if (std::fwrite(meta, sizeof meta, 1, f.get()) != 1)
+					return false;
+				if (meta[1] != 0 && std::fwrite(copy.data() + torn, sizeof(record),
+												 meta[1], f.get()) != meta[1])
+					return false;
+			}
+
+			return true;
+		}
+
+		capture load(const std::string& path) {
+			const file_ptr f {std::fopen(path.c_str(), "rb")};
+			if (!f)
+				throw std::runtime_error("can't open " + path);
+
+			file_header header;
+			if (std::fread(&header, sizeof header, 1, f.get()) != 1
+				|| header.magic != file_magic)
+				throw std::runtime_error(path + " is not a trace dump");
+			if (header.version != file_version)
+				throw std::runtime_error(path + " has an unsupported trace version");
+
+			capture c;
+			c.tsc_per_second = header.tsc_per_second;
+
+			for (std::uint32_t i = 0; i < header.rings; ++i) {
+				std::uint32_t meta[2];
+				if (std::fread(meta, sizeof meta, 1, f.get()) != 1 || meta[1] > ring_size)
+					throw std::runtime_error(path + " is truncated");
+
+				thread_records t;
+				t.thread_id = meta[0];
+				t.records.resize(meta[1]);
+				if (meta[1] != 0 && std::fread(t.records.data(), sizeof(record),
+											   meta[1], f.get()) != meta[1])
+					throw std::runtime_error(path + " is truncated");
+				c.threads.push_back(std::move(t));
+			}
+
+			return c;
+		}
+	};
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <intrin.h>
+
+namespace procon {
+	// Always-on binary trace of the forwarding path. Every thread writes
+	// fixed-size records into its own ring with no locks and no allocation
+	// after its first event; dump() snapshots all rings into a file that
+	// 'Procon Tools trace-dump' turns into a timeline or Chrome trace.
+	namespace trace {
+		enum class event : std::uint16_t {
+			report_received = 1, // arg: bytes read
+			report_decoded,      // arg: report id << 8 | timer byte
+			submitted,           // arg: XInput buttons
+			rumble_sent,         // arg: output report id << 8 | packet counter
+			subcommand_reply,    // arg: subcommand << 8 | ack
+			error,               // arg: GetLastError() or a negative hidapi result
+		};
+
+		struct record {
+			std::uint64_t tsc;
+			event type;
+			std::uint16_t thread; // ring index, fixed per thread
+			std::uint32_t arg;
+		};
+		static_assert(sizeof(record) == 16, "trace records are written to disk as-is");
+
+		constexpr std::size_t ring_size = 1 << 14; // records per thread, a power of two
+		constexpr std::size_t max_threads = 16;
+
+		// Single writer; 'head' counts every record ever written, so the
+		// newest ring_size of them are the ones still present
+		struct ring {
+			std::atomic<std::uint64_t> head {0};
+			std::uint32_t thread_id {0};
+			std::uint16_t index {0};
+			record records[ring_size];
+		};
+
+		// The calling thread's ring, claimed on first use; nullptr once all
+		// max_threads are taken, in which case the thread isn't traced
+		ring* this_thread_ring();
+
+		inline void emit(const event type, const std::uint32_t arg = 0) {
+			auto* r = this_thread_ring();
+			if (r == nullptr)
+				return;
+
+			const auto h = r->head.load(std::memory_order_relaxed);
+			auto& rec = r->records[h & (ring_size - 1)];
+			rec.tsc = __rdtsc();
+			rec.type = type;
+			rec.thread = r->index;
+			rec.arg = arg;
+			r->head.store(h + 1, std::memory_order_release);
+		}
+
+		const char* event_name(event type);
+
+		// Dump file: header, then per ring its thread id, record count and
+		// records oldest first
+		constexpr std::uint32_t file_magic = 0x52544350; // "PCTR"
+		constexpr std::uint32_t file_version = 1;
+
+		struct file_header {
+			std::uint32_t magic;
+			std::uint32_t version;
+			std::uint32_t rings;
+			std::uint32_t reserved;
+			std::uint64_t tsc_per_second; // calibrated against steady_clock
+		};
+
+		// Writes every ring to 'path'. Safe to call while other threads keep
+		// tracing; records they overwrite mid-copy are left out.
+		bool dump(const std::string& path);
+
+		struct thread_records {
+			std::uint32_t thread_id;
+			std::vector<record> records;
+		};
+
+		struct capture {
+			std::uint64_t tsc_per_second;
+			std::vector<thread_records> threads;
+		};
+
+		// Reads a dump back; throws std::runtime_error on a bad file
+		capture load(const std::string& path);
+	};
+};
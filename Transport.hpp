@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Common.hpp"
+#include "hidapi.h"
+
+namespace procon {
+	// Where reports come from and output reports go. The driver talks to a
+	// real controller through hidapi; tools and benchmarks can swap in a
+	// simulated one.
+	class transport {
+	public:
+		virtual ~transport() = default;
+
+		// Non-blocking: bytes read, 0 if nothing is queued, -1 on error
+		virtual int read(uchar* data, std::size_t size) = 0;
+
+		// Non-blocking: up to 'max' queued reports, report i at
+		// data + i * stride with its size in sizes[i]. Returns how many,
+		// -1 on error. Fewer than 'max' means the queue is empty.
+		virtual int read_many(uchar* data, const std::size_t stride,
+							  std::size_t* sizes, const std::size_t max) {
+			std::size_t n = 0;
+			int size = 0;
+
+			while (n < max && (size = read(data + n * stride, stride)) > 0)
+				sizes[n++] = static_cast<std::size_t>(size);
+			return size < 0 && n == 0 ? -1 : static_cast<int>(n);
+		}
+
+		// Bytes written or -1; 'data' starts with the report ID
+		virtual int write(const uchar* data, std::size_t size) = 0;
+	};
+
+	// Owns an open hidapi device
+	class hid_transport : public transport {
+		hid_device* device;
+	public:
+		explicit hid_transport(hid_device* d) : device(d) {
+			hid_set_nonblocking(device, 1);
+		}
+		hid_transport(const hid_transport&) = delete;
+		hid_transport& operator=(const hid_transport&) = delete;
+		~hid_transport() override { if (device != nullptr) hid_close(device); }
+
+		// Hands the device back open; the transport is unusable afterwards
+		hid_device* release() {
+			auto* const d = device;
+			device = nullptr;
+			return d;
+		}
+
+		int read(uchar* data, const std::size_t size) override {
+			return hid_read_timeout(device, data, size, 0);
+		}
+
+		int read_many(uchar* data, const std::size_t stride,
+					  std::size_t* sizes, const std::size_t max) override {
+			std::size_t length = 0;
+			const auto n = hid_read_many(device, data, stride, max, &length, 0);
+
+			for (auto i = 0; i < n; ++i)
+				sizes[i] = length;
+			return n;
+		}
+
+		int write(const uchar* data, const std::size_t size) override {
+			return hid_write(device, data, size);
+		}
+	};
+};
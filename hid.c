@@ -69,6 +69,15 @@ extern "C" {
 #undef MIN
 #define MIN(x,y) ((x) < (y)? (x): (y))
 
+/* Read buffers, each holding up to READ_BATCH reports: the HID class driver
+fills a read with as many queued reports as fit, so one ReadFile drains a
+backlog. A buffer is only refilled once every report borrowed from it with
+hid_borrow_read() is back. WRITE_SLOTS is how many output buffers
+hid_get_write_buffer() can hand out. */
+#define READ_SLOTS 4
+#define READ_BATCH 16
+#define WRITE_SLOTS 4
+
 #ifdef _MSC_VER
   /* Thanks Microsoft, but I know how to use strncpy(). */
 #pragma warning(disable:4996)
@@ -139,7 +148,13 @@ extern "C" {
 		void *last_error_str;
 		DWORD last_error_num;
 		BOOL read_pending;
-		char *read_buf;
+		char *read_buf; /* the slot the pending (or last) read fills */
+		char *read_slots; /* READ_SLOTS slots of READ_BATCH input reports */
+		size_t batch_bytes; /* what the last read brought into read_buf */
+		size_t batch_next; /* offset of the first report not handed out yet */
+		unsigned char lent[READ_SLOTS]; /* reports borrowed from each slot */
+		unsigned char *write_slots; /* WRITE_SLOTS output reports */
+		unsigned writes_taken; /* a bit per write slot handed out */
 		OVERLAPPED ol;
 	};
 
@@ -153,6 +168,12 @@ extern "C" {
 		dev->last_error_num = 0;
 		dev->read_pending = FALSE;
 		dev->read_buf = NULL;
+		dev->read_slots = NULL;
+		dev->batch_bytes = 0;
+		dev->batch_next = 0;
+		memset(dev->lent, 0, sizeof(dev->lent));
+		dev->write_slots = NULL;
+		dev->writes_taken = 0;
 		memset(&dev->ol, 0, sizeof(dev->ol));
 		dev->ol.hEvent = CreateEvent(NULL, FALSE, FALSE /*initial state f=nonsignaled*/, NULL);
 
@@ -163,7 +184,8 @@ extern "C" {
 		CloseHandle(dev->ol.hEvent);
 		CloseHandle(dev->device_handle);
 		LocalFree(dev->last_error_str);
-		free(dev->read_buf);
+		free(dev->read_slots);
+		free(dev->write_slots);
 		free(dev);
 	}
 
@@ -223,7 +245,9 @@ extern "C" {
 	static HANDLE open_device(const char *path, BOOL enumerate) {
 		HANDLE handle;
 		DWORD desired_access = (enumerate) ? 0 : (GENERIC_WRITE | GENERIC_READ);
-		DWORD share_mode = 0;
+		/* Share the device so it can still be probed (and read by the
+		OS HID stack) while we hold it open. */
+		DWORD share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE;
 
 		handle = CreateFileA(path,
 			desired_access,
@@ -582,7 +606,9 @@ extern "C" {
 		dev->input_report_length = caps.InputReportByteLength;
 		HidD_FreePreparsedData(pp_data);
 
-		dev->read_buf = (char*)malloc(dev->input_report_length);
+		dev->read_slots = (char*)malloc(READ_SLOTS * READ_BATCH * dev->input_report_length);
+		dev->read_buf = dev->read_slots;
+		dev->write_slots = (unsigned char*)malloc(WRITE_SLOTS * dev->output_report_length);
 
 		return dev;
 
@@ -593,40 +619,48 @@ extern "C" {
 		return NULL;
 	}
 
-	int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length) {
+	static unsigned char *take_write_slot(hid_device *dev) {
+		unsigned slot;
+
+		if (!dev->write_slots)
+			return NULL;
+		for (slot = 0; slot < WRITE_SLOTS; slot++) {
+			if (!(dev->writes_taken & (1u << slot))) {
+				dev->writes_taken |= 1u << slot;
+				return dev->write_slots + slot * dev->output_report_length;
+			}
+		}
+		return NULL;
+	}
+
+	/* Returns FALSE if 'buf' isn't one of the device's write slots. */
+	static BOOL put_write_slot(hid_device *dev, const unsigned char *buf) {
+		size_t slot;
+
+		if (!dev->output_report_length || buf < dev->write_slots)
+			return FALSE;
+		slot = (size_t)(buf - dev->write_slots) / dev->output_report_length;
+		if (slot >= WRITE_SLOTS)
+			return FALSE;
+		dev->writes_taken &= ~(1u << slot);
+		return TRUE;
+	}
+
+	/* Writes 'length' bytes as they are and waits for the write to finish. */
+	static int write_report(hid_device *dev, const unsigned char *buf, size_t length) {
 		DWORD bytes_written;
 		BOOL res;
 
 		OVERLAPPED ol;
-		unsigned char *buf;
 		memset(&ol, 0, sizeof(ol));
 
-		/* Make sure the right number of bytes are passed to WriteFile. Windows
-		expects the number of bytes which are in the _longest_ report (plus
-		one for the report number) bytes even if the data is a report
-		which is shorter than that. Windows gives us this value in
-		caps.OutputReportByteLength. If a user passes in fewer bytes than this,
-		create a temporary buffer which is the proper size. */
-		if (length >= dev->output_report_length) {
-			/* The user passed the right number of bytes. Use the buffer as-is. */
-			buf = (unsigned char *)data;
-		} else {
-			/* Create a temporary buffer and copy the user's data
-			into it, padding the rest with zeros. */
-			buf = (unsigned char *)malloc(dev->output_report_length);
-			memcpy(buf, data, length);
-			memset(buf + length, 0, dev->output_report_length - length);
-			length = dev->output_report_length;
-		}
-
 		res = WriteFile(dev->device_handle, buf, length, NULL, &ol);
 
 		if (!res) {
 			if (GetLastError() != ERROR_IO_PENDING) {
 				/* WriteFile() failed. Return error. */
 				register_error(dev, "WriteFile");
-				bytes_written = -1;
-				goto end_of_function;
+				return -1;
 			}
 		}
 
@@ -636,32 +670,127 @@ extern "C" {
 		if (!res) {
 			/* The Write operation failed. */
 			register_error(dev, "WriteFile");
-			bytes_written = -1;
-			goto end_of_function;
+			return -1;
+		}
+
+		return bytes_written;
+	}
+
+	int HID_API_EXPORT HID_API_CALL hid_write(hid_device *dev, const unsigned char *data, size_t length) {
+		int bytes_written;
+		unsigned char *buf;
+
+		/* Make sure the right number of bytes are passed to WriteFile. Windows
+		expects the number of bytes which are in the _longest_ report (plus
+		one for the report number) bytes even if the data is a report
+		which is shorter than that. Windows gives us this value in
+		caps.OutputReportByteLength. If a user passes in fewer bytes than this,
+		pad the data into a buffer which is the proper size: a free write slot
+		if there is one, a temporary buffer otherwise. */
+		if (length >= dev->output_report_length) {
+			/* The user passed the right number of bytes. Use the buffer as-is. */
+			buf = (unsigned char *)data;
+		} else {
+			buf = take_write_slot(dev);
+			if (!buf)
+				buf = (unsigned char *)malloc(dev->output_report_length);
+			memcpy(buf, data, length);
+			memset(buf + length, 0, dev->output_report_length - length);
+			length = dev->output_report_length;
 		}
 
-	end_of_function:
-		if (buf != data)
+		bytes_written = write_report(dev, buf, length);
+
+		if (buf != data && !put_write_slot(dev, buf))
 			free(buf);
 
 		return bytes_written;
 	}
 
+	unsigned char * HID_API_EXPORT HID_API_CALL hid_get_write_buffer(hid_device *dev, size_t *length) {
+		unsigned char *buf = take_write_slot(dev);
 
-	int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds) {
+		if (!buf) {
+			SetLastError(ERROR_BUSY);
+			register_error(dev, "hid_get_write_buffer");
+			return NULL;
+		}
+		memset(buf, 0, dev->output_report_length);
+		*length = dev->output_report_length;
+		return buf;
+	}
+
+	int HID_API_EXPORT HID_API_CALL hid_write_buffer(hid_device *dev, unsigned char *buffer) {
+		int bytes_written = write_report(dev, buffer, dev->output_report_length);
+
+		put_write_slot(dev, buffer);
+		return bytes_written;
+	}
+
+	void HID_API_EXPORT HID_API_CALL hid_put_write_buffer(hid_device *dev, unsigned char *buffer) {
+		put_write_slot(dev, buffer);
+	}
+
+	static size_t read_slot_size(const hid_device *dev) {
+		return READ_BATCH * dev->input_report_length;
+	}
+
+	/* Hands out the next report of the last read. The driver pads each
+	report to input_report_length, so they sit that far apart. */
+	static int next_report(hid_device *dev, const unsigned char **report) {
+		const char *r = dev->read_buf + dev->batch_next;
+		size_t length = MIN(dev->input_report_length, dev->batch_bytes - dev->batch_next);
+
+		dev->batch_next += dev->input_report_length;
+		*report = (const unsigned char *)r;
+		if (r[0] == 0x0) {
+			/* If report numbers aren't being used, but Windows sticks a report
+			number (0x0) on the beginning of the report anyway. To make this
+			work like the other platforms, and to make it work more like the
+			HID spec, we'll skip over this byte. */
+			length--;
+			(*report)++;
+		}
+		return length;
+	}
+
+	/* TRUE if the last read was filled to the brim, so more may be queued. */
+	static BOOL batch_was_full(const hid_device *dev) {
+		return dev->batch_bytes >= read_slot_size(dev);
+	}
+
+	/* Hands out what's left of the last read first. Otherwise starts a read
+	into a slot with nothing borrowed, unless one is pending, and waits up to
+	'milliseconds' for it. */
+	static int read_report(hid_device *dev, int milliseconds, const unsigned char **report) {
 		DWORD bytes_read = 0;
-		size_t copy_len = 0;
 		BOOL res;
+		unsigned slot;
 
 		/* Copy the handle for convenience. */
 		HANDLE ev = dev->ol.hEvent;
 
+		if (dev->batch_next < dev->batch_bytes)
+			return next_report(dev, report);
+
 		if (!dev->read_pending) {
-			/* Start an Overlapped I/O read. */
+			slot = (unsigned)((dev->read_buf - dev->read_slots) / read_slot_size(dev));
+			if (dev->lent[slot]) {
+				for (slot = 0; slot < READ_SLOTS && dev->lent[slot]; slot++)
+					;
+				if (slot == READ_SLOTS) {
+					SetLastError(ERROR_BUSY);
+					register_error(dev, "ReadFile");
+					return -1;
+				}
+				dev->read_buf = dev->read_slots + slot * read_slot_size(dev);
+			}
+
+			/* Start an Overlapped I/O read. Only the bytes it returns are
+			ever looked at, so the slot isn't cleared first. */
 			dev->read_pending = TRUE;
-			memset(dev->read_buf, 0, dev->input_report_length);
 			ResetEvent(ev);
-			res = ReadFile(dev->device_handle, dev->read_buf, dev->input_report_length, &bytes_read, &dev->ol);
+			res = ReadFile(dev->device_handle, dev->read_buf, (DWORD)read_slot_size(dev), &bytes_read, &dev->ol);
 
 			if (!res) {
 				if (GetLastError() != ERROR_IO_PENDING) {
@@ -669,7 +798,8 @@ extern "C" {
 					Clean up and return error. */
 					CancelIo(dev->device_handle);
 					dev->read_pending = FALSE;
-					goto end_of_function;
+					register_error(dev, "ReadFile");
+					return -1;
 				}
 			}
 		}
@@ -686,37 +816,83 @@ extern "C" {
 
 		/* Either WaitForSingleObject() told us that ReadFile has completed, or
 		we are in non-blocking mode. Get the number of bytes read. The actual
-		data has been copied to the data[] array which was passed to ReadFile(). */
+		data has been copied to the slot which was passed to ReadFile(). */
 		res = GetOverlappedResult(dev->device_handle, &dev->ol, &bytes_read, TRUE/*wait*/);
 
 		/* Set pending back to false, even if GetOverlappedResult() returned error. */
 		dev->read_pending = FALSE;
 
-		if (res && bytes_read > 0) {
-			if (dev->read_buf[0] == 0x0) {
-				/* If report numbers aren't being used, but Windows sticks a report
-				number (0x0) on the beginning of the report anyway. To make this
-				work like the other platforms, and to make it work more like the
-				HID spec, we'll skip over this byte. */
-				bytes_read--;
-				copy_len = length > bytes_read ? bytes_read : length;
-				memcpy(data, dev->read_buf + 1, copy_len);
-			} else {
-				/* Copy the whole buffer, report number and all. */
-				copy_len = length > bytes_read ? bytes_read : length;
-				memcpy(data, dev->read_buf, copy_len);
-			}
-		}
-
-	end_of_function:
 		if (!res) {
 			register_error(dev, "GetOverlappedResult");
 			return -1;
 		}
 
+		dev->batch_bytes = bytes_read;
+		dev->batch_next = 0;
+		if (bytes_read == 0)
+			return 0;
+		return next_report(dev, report);
+	}
+
+	int HID_API_EXPORT HID_API_CALL hid_read_timeout(hid_device *dev, unsigned char *data, size_t length, int milliseconds) {
+		const unsigned char *report;
+		size_t copy_len;
+		int bytes_read = read_report(dev, milliseconds, &report);
+
+		if (bytes_read <= 0)
+			return bytes_read;
+
+		copy_len = length > (size_t)bytes_read ? (size_t)bytes_read : length;
+		memcpy(data, report, copy_len);
 		return copy_len;
 	}
 
+	int HID_API_EXPORT HID_API_CALL hid_read_many(hid_device *dev, unsigned char *data, size_t stride, size_t max_reports, size_t *report_length, int milliseconds) {
+		const unsigned char *report;
+		size_t count = 0, copy_len;
+		int bytes_read;
+
+		while (count < max_reports) {
+			/* Only the first report is worth waiting for. */
+			bytes_read = read_report(dev, count ? 0 : milliseconds, &report);
+			if (bytes_read < 0)
+				return count ? (int)count : -1;
+			if (bytes_read == 0)
+				break;
+
+			copy_len = MIN((size_t)bytes_read, stride);
+			memcpy(data + count * stride, report, copy_len);
+			if (report_length)
+				*report_length = copy_len;
+			count++;
+
+			/* A read that came back with room to spare emptied the driver's
+			queue; asking again would only start a read that waits. */
+			if (dev->batch_next >= dev->batch_bytes && !batch_was_full(dev))
+				break;
+		}
+
+		return (int)count;
+	}
+
+	int HID_API_EXPORT HID_API_CALL hid_borrow_read(hid_device *dev, const unsigned char **data, int milliseconds) {
+		int bytes_read = read_report(dev, milliseconds, data);
+
+		if (bytes_read > 0)
+			dev->lent[(dev->read_buf - dev->read_slots) / read_slot_size(dev)]++;
+		return bytes_read;
+	}
+
+	void HID_API_EXPORT HID_API_CALL hid_return_read(hid_device *dev, const unsigned char *data) {
+		size_t slot;
+
+		if (!data || (const char *)data < dev->read_slots)
+			return;
+		slot = (size_t)((const char *)data - dev->read_slots) / read_slot_size(dev);
+		if (slot < READ_SLOTS && dev->lent[slot])
+			dev->lent[slot]--;
+	}
+
 	int HID_API_EXPORT HID_API_CALL hid_read(hid_device *dev, unsigned char *data, size_t length) {
 		return hid_read_timeout(dev, data, length, (dev->blocking) ? -1 : 0);
 	}
@@ -243,6 +243,98 @@ extern "C" {
 		*/
 		int  HID_API_EXPORT HID_API_CALL hid_read(hid_device *device, unsigned char *data, size_t length);
 
+		/** @brief Read every queued Input report in one call.
+
+			Waits up to @p milliseconds for the first report, then takes
+			whatever else the driver has queued without waiting. One
+			ReadFile brings back as many queued reports as fit in the
+			device's read buffer, so draining a backlog costs one system
+			call rather than one per report. Reports are in arrival
+			order, report @c i at <tt>data + i * stride</tt>, cut to
+			@p stride bytes.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param data Room for @p max_reports reports of @p stride bytes.
+			@param stride The bytes given to each report.
+			@param max_reports The most reports to return.
+			@param report_length If not NULL, set to the length of each
+				report returned; it's the same for every report of a
+				device.
+			@param milliseconds timeout in milliseconds or -1 for blocking wait.
+
+			@returns
+				This function returns the number of reports read, 0 if
+				none arrived within the timeout and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_read_many(hid_device *device, unsigned char *data, size_t stride, size_t max_reports, size_t *report_length, int milliseconds);
+
+		/** @brief Read an Input report without copying it.
+
+			Like hid_read_timeout(), but instead of copying the report
+			into a caller's buffer, @p data is pointed at the device's own
+			buffer holding it. The report stays valid until it's handed
+			back with hid_return_read(). The device has four read buffers
+			and only refills one once every report taken from it is back,
+			so hand reports back promptly; when all four are held, reads
+			fail.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param data Set to the report on success.
+			@param milliseconds timeout in milliseconds or -1 for blocking wait.
+
+			@returns
+				This function returns the number of bytes in the report,
+				0 if none arrived within the timeout and -1 on error.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_borrow_read(hid_device *device, const unsigned char **data, int milliseconds);
+
+		/** @brief Hand back a report from hid_borrow_read().
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param data The pointer hid_borrow_read() returned.
+		*/
+		void HID_API_EXPORT HID_API_CALL hid_return_read(hid_device *device, const unsigned char *data);
+
+		/** @brief Get a zeroed buffer of the device's full output report length.
+
+			Fill it in (report ID first) and send it with
+			hid_write_buffer(), which needs no padding copy, or give it
+			back unsent with hid_put_write_buffer(). Up to four buffers
+			can be out at once.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param length Set to the buffer's length.
+
+			@returns
+				The buffer, or NULL if all of them are out.
+		*/
+		unsigned char * HID_API_EXPORT HID_API_CALL hid_get_write_buffer(hid_device *device, size_t *length);
+
+		/** @brief Write a buffer from hid_get_write_buffer() and give it back.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param buffer The buffer, filled in.
+
+			@returns
+				The number of bytes written and -1 on error. The buffer
+				is given back either way.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_write_buffer(hid_device *device, unsigned char *buffer);
+
+		/** @brief Give back a buffer from hid_get_write_buffer() without
+			writing it.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param buffer The buffer.
+		*/
+		void HID_API_EXPORT HID_API_CALL hid_put_write_buffer(hid_device *device, unsigned char *buffer);
+
 		/** @brief Set the device handle to be non-blocking.
 
 			In non-blocking mode calls to hid_read() will return
@@ -1,13 +1,12 @@
 #define POSITIONAL 0
 #define DRIVING 0
 
-#undef USB
-
 #pragma comment(lib, "hid")
 #pragma comment(lib, "dxguid")
 #pragma comment(lib, "dinput8")
 #pragma comment(lib, "comctl32")
 #pragma comment(lib, "Setupapi")
+#pragma comment(lib, "winmm")
 
 #define STRICT
 #define DIRECTINPUT_VERSION 0x0800
@@ -16,17 +15,22 @@
 #define _WIN32_DCOM
 #endif
 
+#include <algorithm>
+#include <future> // async, for the bus
 #include <iostream> // cout
 #include <thread> // this_thread::sleep_for, this_thread::yield
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <array>
+#include <stdexcept>
 
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
 #include <Windows.h>
+#include <timeapi.h> // timeBeginPeriod
 #include <conio.h> // _kbhit, _getch_nolock
 #include <Dbt.h>
 #include "hidsdi.h"
@@ -46,6 +50,27 @@
 #include <dinputd.h>
 
 #include "XOutput.hpp"
+#include "Capture.hpp"
+#include "Clock.hpp"
+#include "Controller.hpp"
+#include "Curve.hpp"
+#include "Devices.hpp"
+#include "Fusion.hpp"
+#include "Gesture.hpp"
+#include "Handshake.hpp"
+#include "Layers.hpp"
+#include "LinkStats.hpp"
+#include "Macro.hpp"
+#include "Output.hpp"
+#include "PadTable.hpp"
+#include "Probe.hpp"
+#include "Profile.hpp"
+#include "Reactor.hpp"
+#include "Report.hpp"
+#include "Resample.hpp"
+#include "SharedState.hpp"
+#include "Startup.hpp"
+#include "Trace.hpp"
 
 #include "resource.h"
 #include "hidapi.h"
@@ -54,7 +79,6 @@
 #define SAFE_RELEASE(p) { if(p) { (p)->Release(); (p)=nullptr; } }
 
 using tstring = std::wstring;
-using bytes = std::vector<std::uint8_t>;
 
 std::mutex controller_map_mutex;
 LPDIRECTINPUT8          g_p_di = nullptr;
@@ -70,17 +94,88 @@ struct DI_ENUM_CONTEXT {
 struct {
 	std::string path;
 	std::uint8_t counter;
-	HANDLE handle;
-	USHORT output_size;
+	hid_device* device;
+	procon::link_type link;
+	procon::report_decoder decode; // for the mode the handshake settled on
+	std::array<procon::uchar, 8> rumble; // last rumble data sent
 	UCHAR large_motor, small_motor, led;
 	bool vibrate, led_changed;
 	unsigned char max;
 	bool connected;
 } controller;
 
-#if DRIVING
-LPDIRECTINPUTDEVICE8 g_p_joystick2 = nullptr;
-#endif
+// Extra DirectInput devices merged into the pad through fusion rules. Their
+// inputs are registered at startup, so rules can name them before (or
+// without) the device ever showing up.
+struct di_source {
+	DWORD product; // DIDEVICEINSTANCE::guidProduct.Data1
+	const char* name;
+	std::uint32_t stale_ms;
+	procon::fusion::source_id id;
+	procon::fusion::input_id first_input; // 8 axes, then 32 buttons
+	LPDIRECTINPUTDEVICE8 device;
+};
+
+std::array<di_source, 1> di_sources = {{
+	{0xBEAD1234, "pedals", 100},
+}};
+
+const std::array<const char*, 8> di_axis_names = {
+	"x", "y", "z", "rx", "ry", "rz", "slider0", "slider1"
+};
+constexpr int di_source_buttons = 32;
+
+procon::fusion fusion;
+
+procon::state_publisher state_export;
+procon::shared::controller_state exported {};
+procon::link_monitor link_monitor;
+procon::rtt_probe rtt_probe;
+bool probe_rtt = false;
+procon::capture_writer recorder;
+procon::handshake_config handshake;
+procon::resample_config resampling;
+procon::startup_timeline startup(std::cerr);
+
+// --reactor: every Pro Controller on its own bus slot, all read by one
+// thread waiting on a completion port instead of the dialog timer
+procon::scpvbus_backend bus;
+std::unique_ptr<procon::reactor> io_reactor;
+std::vector<std::unique_ptr<procon::controller>> pads;
+procon::pad_table pad_state; // --pad-table: every pad's sticks, triggers and rumble per wakeup
+bool use_pad_table = false;
+std::array<procon::shared::controller_state, procon::shared::max_controllers> pad_exports {};
+std::thread reactor_thread;
+std::vector<std::thread> bring_ups; // one per controller found, handshaking
+// hidapi's open, close and lazy initialization aren't safe to run on
+// several threads at once, so bring-ups take turns at them
+std::mutex hidapi_mutex;
+// Set by the bus's feedback listener, a bit per slot, for the reactor
+// thread to apply; the timer path gets wm_feedback at 'dialog' instead
+std::atomic<std::uint32_t> feedback_changed {0};
+std::atomic<HWND> dialog {nullptr};
+constexpr UINT wm_feedback = WM_APP + 1;
+
+procon::sendinput_sink keyboard;
+procon::input_layers layers(keyboard, fusion);
+
+// DirectInput button index -> Pro Controller button
+const std::array<procon::button, 14> di_buttons = {
+	procon::button::b,
+	procon::button::a,
+	procon::button::y,
+	procon::button::x,
+	procon::button::l,
+	procon::button::r,
+	procon::button::zl,
+	procon::button::zr,
+	procon::button::minus,
+	procon::button::plus,
+	procon::button::left_stick,
+	procon::button::right_stick,
+	procon::button::home,
+	procon::button::capture,
+};
 
 namespace {
 	bool has_broken {false};
@@ -108,108 +203,280 @@ namespace {
 	}
 }
 
-GUID hid_guid;
+// Runs the connection handshake on a freshly opened device and returns the
+// decoder for the report mode it settled on. If it fails the controller is
+// still used, taking whichever reports it sends.
+procon::report_decoder negotiate(procon::transport& t, const procon::found_controller& f,
+								  std::uint8_t& counter) {
+	auto cfg = handshake;
+	cfg.link = f.link;
+	const auto result = procon::run_handshake(t, cfg, counter);
+
+	if (result.ok)
+		return procon::decoder_for(result.mode);
+	std::cerr << f.path << ": handshake failed at " << result.failed_step << '\n';
+	return procon::decode_report;
+}
 
-void get_initial_plugged_devices() {
-	using std::unique_ptr;
+// Loads XOutput1_1.dll and checks that ScpVBus answers. Throws
+// XOutput::XOutputError if the bus can't be used.
+void connect_bus() {
+	XOutput::XOutputInitialize();
 
-	const auto devices = SetupDiGetClassDevs(&hid_guid, nullptr,
-			nullptr, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
-	
-	if (devices != INVALID_HANDLE_VALUE) {
-		DWORD i = 0;
-		SP_DEVICE_INTERFACE_DATA data;
-		data.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
-
-		while (SetupDiEnumDeviceInterfaces(devices,
-				nullptr, &hid_guid, i++, &data)) {
-			DWORD required_buffer_size;
-			const auto result = SetupDiGetDeviceInterfaceDetail(devices, &data,
-					nullptr, 0, &required_buffer_size, nullptr);
-
-			if (result == 0 && GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
-				unique_ptr<SP_DEVICE_INTERFACE_DETAIL_DATA>
-						interface_detail(static_cast<
-								PSP_DEVICE_INTERFACE_DETAIL_DATA>(
-										operator new(required_buffer_size)));
-				interface_detail->cbSize
-						= sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
-				
-				if (SetupDiGetDeviceInterfaceDetail(devices, &data,
-													interface_detail.get(),
-						required_buffer_size, nullptr, nullptr)) {
-					std::lock_guard<std::mutex> lk(controller_map_mutex);
-					controller.counter = 0;
-					controller.path = interface_detail->DevicePath;
-					controller.handle = CreateFile(
-							controller.path.c_str(),
-							GENERIC_WRITE | GENERIC_READ,
-							FILE_SHARE_WRITE | FILE_SHARE_READ,
-							nullptr, OPEN_EXISTING,
-							FILE_FLAG_OVERLAPPED,
-							nullptr);
-					
-					if (controller.handle == INVALID_HANDLE_VALUE) {
-						const auto err = GetLastError();
-
-						if (err != ERROR_ACCESS_DENIED) {
-							std::cerr << "error opening " << controller.path;
-							std::cerr << " (" << GetLastError() << ")"
-									  << std::endl;
-						}
-						continue;
-					}
-					
-					HIDD_ATTRIBUTES attributes;
-					
-					attributes.Size = sizeof attributes;
-					auto ok = HidD_GetAttributes(
-							controller.handle, &attributes);
-					
-					if (!ok) {
-						std::cerr << "Error calling HidD_GetAttributes ("
-								  << GetLastError() << ")" << std::endl;
-						continue;
-					}
-
-					if (attributes.ProductID != 0x2009
-					 || attributes.VendorID != 0x057E) {
-						// not a pro controller, fail silently
-						continue;
-					}
-
-					PHIDP_PREPARSED_DATA preparsed_data;
-					
-					ok = HidD_GetPreparsedData(controller.handle,
-											   &preparsed_data);
-					
-					if (!ok) {
-						std::cerr << "Error calling HidD_GetPreparsedData ("
-								  << GetLastError() << ")" << std::endl;
-						return;
-					}
-
-					HIDP_CAPS caps;
-					const auto status = HidP_GetCaps(preparsed_data, &caps);
-					
-					HidD_FreePreparsedData(preparsed_data);
-
-					if (status != HIDP_STATUS_SUCCESS) {
-						std::cerr << "Error calling HidP_GetCaps ("
-								  << status << ")" << std::endl;
-						return;
-					}
-
-					controller.output_size = caps.OutputReportByteLength;
-					controller.connected = true;
-					
-					XOutput::XOutputPlugIn(0);
-				}
-			}
+	DWORD unused;
+	if (!success(XOutput::XOutputGetRealUserIndex(0, &unused)))
+		throw XOutput::XOutputError("Unable to connect to ScpVBus.");
+	startup.mark("virtual bus ready");
+}
+
+// Opens and handshakes the first controller; WinMain plugs its pad in once
+// the bus is ready
+void get_initial_plugged_devices(const std::vector<procon::found_controller>& found) {
+	if (found.empty())
+		return;
+
+	std::lock_guard<std::mutex> lk(controller_map_mutex);
+	controller.counter = 0;
+	controller.path = found.front().path;
+	controller.link = found.front().link;
+	auto* const device = hid_open_path(controller.path.c_str());
+	if (device == nullptr) {
+		procon::trace::emit(procon::trace::event::error, GetLastError());
+		std::cerr << "error opening " << controller.path
+				  << " through hidapi" << std::endl;
+		return;
+	}
+
+	procon::hid_transport t(device);
+	controller.decode = negotiate(t, found.front(), controller.counter);
+	controller.device = t.release();
+	link_monitor.reset();
+	controller.connected = true;
+	startup.mark(controller.path + " handshake done");
+}
+
+void register_fusion_sources() {
+	for (auto& s : di_sources) {
+		s.id = fusion.add_source(s.name, s.stale_ms);
+		s.first_input = fusion.add_input(s.id, di_axis_names[0]);
+		for (std::size_t i = 1; i < di_axis_names.size(); ++i)
+			fusion.add_input(s.id, di_axis_names[i]);
+		for (auto i = 0; i < di_source_buttons; ++i)
+			fusion.add_input(s.id, "button" + std::to_string(i));
+	}
+
+#if DRIVING
+	// The pedal base reports a point in a triangle; each pedal's travel is
+	// its barycentric weight, l2 = 2(y - x) and l3 = 2x - y in unit axes,
+	// fully pressed from 0.5625 on.
+	const auto pedal = [](const double l) {
+		return l > 0.5625 ? 255.0 : l < 0 ? 0.0 : l * 453;
+	};
+
+	fusion.add_rule(procon::axis_rule{"pedals.y", "pedals.x", 2, -2,
+			procon::pad_target::left_trigger, procon::combine::replace, pedal});
+	fusion.add_rule(procon::axis_rule{"pedals.x", "pedals.y", 2, -1,
+			procon::pad_target::right_trigger, procon::combine::replace, pedal});
+#endif
+}
+
+// Feeds one extra device into the fusion layer. A device that fails to poll
+// is left alone and drops out once it goes stale.
+void poll_di_source(const di_source& s, const std::uint32_t now_ms) {
+	if (!s.device)
+		return;
+
+	auto hr = s.device->Poll();
+	if (FAILED(hr)) {
+		hr = s.device->Acquire();
+		while (hr == DIERR_INPUTLOST)
+			hr = s.device->Acquire();
+		return;
+	}
+
+	DIJOYSTATE2 js;
+	if (FAILED(s.device->GetDeviceState(sizeof(DIJOYSTATE2), &js)))
+		return;
+
+	const LONG axes[] = {js.lX, js.lY, js.lZ, js.lRx, js.lRy, js.lRz,
+						 js.rglSlider[0], js.rglSlider[1]};
+	auto in = s.first_input;
+
+	for (const auto axis : axes)
+		fusion.set(in++, axis - 32768);
+	for (auto i = 0; i < di_source_buttons; ++i)
+		fusion.set(in++, js.rgbButtons[i] & 0x80 ? 32767 : 0);
+	fusion.updated(s.id, now_ms);
+}
+
+// Runs on the reactor thread right before each controller submits. The
+// global layers follow the first controller, as on the timer path.
+void reactor_hook(procon::controller& c, XINPUT_GAMEPAD& pad, const std::uint32_t now_ms) {
+	if (c.slot() == 0) {
+		if (layers.input(c.last_report().buttons, now_ms))
+			for (auto& p : pads)
+				p->load(layers.active_profile());
+		for (const auto& s : di_sources)
+			poll_di_source(s, now_ms);
+		layers.overlay(pad, now_ms);
+	}
+
+	auto& s = pad_exports[c.slot()];
+	if (s.timing.submits == 0)
+		startup.mark("pad " + std::to_string(c.slot()) + " first input");
+	procon::export_pad(c, pad, s);
+	state_export.publish(c.slot(), s);
+}
+
+// Handshakes one controller, then hands it to the reactor thread, which
+// owns 'pads' and the pad table, once the bus can take it
+void bring_up(const procon::found_controller& f, const BYTE rumble_limit,
+			  const std::shared_future<void> bus_ready) {
+	// The handshake runs through hidapi, before the reactor owns the
+	// device; the report mode sticks once it's set
+	auto decode = procon::decode_report;
+	std::uint8_t counter = 0;
+	hid_device* device;
+	{
+		std::lock_guard<std::mutex> lk(hidapi_mutex);
+		device = hid_open_path(f.path.c_str());
+	}
+	if (device != nullptr) {
+		// Reads and writes on a device of its own are safe alongside the
+		// other handshakes
+		procon::hid_transport t(device);
+		decode = negotiate(t, f, counter);
+
+		std::lock_guard<std::mutex> lk(hidapi_mutex);
+		hid_close(t.release());
+	}
+
+	const auto handle = procon::open_overlapped(f.path);
+
+	if (handle == INVALID_HANDLE_VALUE) {
+		std::cerr << "error opening " << f.path << " (" << GetLastError() << ")\n";
+		return;
+	}
+	startup.mark(f.path + " handshake done");
+
+	try {
+		bus_ready.get();
+	} catch (const XOutput::XOutputError&) {
+		CloseHandle(handle); // WinMain reports it
+		return;
+	}
+
+	io_reactor->post([f, handle, decode, rumble_limit] {
+		if (pads.size() == bus.capacity()) {
+			CloseHandle(handle);
 			return;
 		}
-	}
-	SetupDiDestroyDeviceInfoList(devices);
+
+		// Device ids count up from 0 in add() order, like 'pads'; slots
+		// go in the order handshakes finish
+		const auto slot = static_cast<unsigned>(pads.size());
+		std::unique_ptr<procon::controller> c(new procon::controller(
+				std::unique_ptr<procon::transport>(
+						new procon::reactor_transport(*io_reactor, slot)),
+				bus, slot));
+
+		try {
+			io_reactor->add(handle, f.input_length, f.output_length, *c);
+		} catch (const std::runtime_error& e) {
+			CloseHandle(handle);
+			std::cerr << f.path << ": " << e.what() << '\n';
+			return;
+		}
+
+		c->load(layers.active_profile());
+		c->set_decoder(decode);
+		c->set_rumble_limit(rumble_limit);
+		c->set_resampling(resampling);
+		c->set_hook(reactor_hook);
+		// A capture holds one controller's reports: the first pad's
+		if (slot == 0 && recorder.is_open())
+			c->set_recorder(&recorder);
+		if (use_pad_table)
+			c->attach(pad_state);
+		bus.plug(slot);
+		pads.push_back(std::move(c));
+	});
+}
+
+// Starts the reactor thread with no devices, then handshakes every Pro
+// Controller on a thread of its own. Each joins the reactor, on a bus slot
+// of its own, as soon as its handshake and the bus are done, so a slow one
+// holds up nobody else. Returns the number of controllers being brought up.
+std::size_t start_reactor(const std::vector<procon::found_controller>& found, const BYTE rumble_limit,
+						  const std::shared_future<void>& bus_ready) {
+	io_reactor.reset(new procon::reactor);
+
+	// Resampled pads are submitted from the tick, so it has to come round
+	// at least once per output period
+	const auto tick_ms = resampling.mode != procon::resample_mode::off
+			? std::max<DWORD>(1, 1000 / resampling.output_hz) : DWORD {1000 / 120};
+
+	reactor_thread = std::thread([tick_ms] {
+		std::uint64_t next_feedback = 0;
+		std::array<procon::pad_feedback, procon::shared::max_controllers> feedback;
+		std::array<bool, procon::shared::max_controllers> asked;
+
+		io_reactor->run(tick_ms, [&](const std::uint64_t now_us) {
+			// Whatever this wakeup staged, for every controller in one pass
+			for (auto& c : pads)
+				c->pace(now_us);
+			pad_state.process();
+			for (auto& c : pads)
+				c->finish();
+
+			// Feedback the bus pushes goes out as soon as it changes. All of
+			// it is gone over at the timer path's rate too, which keeps a
+			// steady rumble going and is the only way in if the bus can
+			// only be polled.
+			const auto changed = feedback_changed.exchange(0);
+			const auto due = now_us >= next_feedback;
+			if (!due && changed == 0)
+				return;
+			if (due)
+				next_feedback = now_us + 1000000 / 120;
+
+			for (auto& c : pads) {
+				const auto i = c->slot();
+				asked[i] = (due || (changed >> i & 1u) != 0) && bus.feedback(i, feedback[i]);
+				if (asked[i])
+					c->stage_feedback(feedback[i]);
+			}
+			pad_state.scale_motors();
+			for (auto& c : pads)
+				if (asked[c->slot()])
+					c->apply_feedback(feedback[c->slot()]);
+		});
+	});
+
+	const auto count = std::min<std::size_t>(found.size(), bus.capacity());
+	for (std::size_t i = 0; i < count; ++i)
+		bring_ups.emplace_back(bring_up, found[i], rumble_limit, bus_ready);
+	return count;
+}
+
+void stop_reactor() {
+	if (!io_reactor)
+		return;
+
+	// Handshakes time out on their own. What they posted still runs before
+	// the reactor thread returns, so those pads are unplugged below too.
+	for (auto& t : bring_ups)
+		t.join();
+	bring_ups.clear();
+	io_reactor->stop();
+	reactor_thread.join();
+	// Nothing submits now; the listener wakes the reactor, so it goes first
+	bus.stop_watching();
+	for (auto& c : pads)
+		bus.unplug(c->slot());
+	io_reactor.reset();
+	pads.clear();
+	pad_state = procon::pad_table();
 }
 
 bool check_io_error(const DWORD err) {
@@ -228,39 +495,50 @@ bool check_io_error(const DWORD err) {
 	return ret;
 }
 
-void write_data(const bytes& data) {
-	bytes buf;
+void write_data(const procon::uchar* data, const std::size_t size) {
+	using procon::trace::event;
 
-	if (data.size() < controller.output_size) {
-		buf.resize(controller.output_size);
-		copy(data.begin(), data.end(), buf.begin());
-	} else
-		buf = data;
+	if (controller.device == nullptr)
+		return;
 
-	DWORD tmp;
-	OVERLAPPED ol = {0};
-	ol.hEvent = CreateEvent(nullptr,
-			FALSE, FALSE, TEXT(""));
+	// Built straight into one of hidapi's buffers, already padded to the
+	// device's output report length
+	std::size_t length;
+	auto* buf = hid_get_write_buffer(controller.device, &length);
+	if (buf == nullptr) {
+		procon::trace::emit(event::error, GetLastError());
+		return;
+	}
+	std::copy(data, data + std::min(size, length), buf);
 
-	WriteFile(controller.handle, buf.data(),
-			static_cast<DWORD>(buf.size()), &tmp, &ol);
+	if (hid_write_buffer(controller.device, buf) < 0) {
+		procon::trace::emit(event::error, GetLastError());
+		return;
+	}
+	procon::trace::emit(event::rumble_sent, data[0] << 8 | data[1]);
+	// Output reports go in the capture too, for rumble analysis
+	recorder.write(procon::clock_us(), data, size);
+}
 
-	CloseHandle(ol.hEvent);
+template<std::size_t N>
+void write_data(const std::array<procon::uchar, N>& data) {
+	write_data(data.data(), N);
 }
 
 void handle_rumble() {
 	using std::uint8_t;
 	if (controller.led_changed) {
-		const bytes buf = {0x01, static_cast<uint8_t>(controller.counter++ & 0x0F),
-					 0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40,
-					 0x30, static_cast<unsigned char>(1 << controller.led - 1)};
+		std::array<procon::uchar, 12> buf {{0x01, static_cast<uint8_t>(controller.counter++ & 0x0F)}};
+		std::copy(controller.rumble.begin(), controller.rumble.end(), buf.begin() + 2);
+		buf[10] = 0x30;
+		buf[11] = static_cast<unsigned char>(1 << controller.led - 1);
 		
 		write_data(buf);
 		controller.led_changed = false;
 	}
 	if (controller.vibrate) {
-		bytes buf = {0x10, static_cast<uint8_t>(controller.counter++ & 0x0F),
-					 0x80, 0x00, 0x40, 0x40, 0x80, 0x00, 0x40, 0x40};
+		std::array<procon::uchar, 10> buf {{0x10, static_cast<uint8_t>(controller.counter++ & 0x0F),
+											0x80, 0x00, 0x40, 0x40, 0x80, 0x00, 0x40, 0x40}};
 		
 		buf[2] = 0x08;
 		buf[3] = controller.large_motor;
@@ -276,9 +554,39 @@ void handle_rumble() {
 		buf[7] = controller.small_motor;
 		
 		write_data(buf);
+		std::copy(buf.begin() + 2, buf.end(), controller.rumble.begin());
+	}
+	if (probe_rtt) {
+		// Carries the rumble already playing, so probing never changes it
+		const auto now = procon::clock_us();
+		if (rtt_probe.due(now)) {
+			const auto probe = rtt_probe.send(controller.counter++, controller.rumble, now);
+			write_data(probe);
+		}
 	}
 }
 
+// Rumble and LED for the timer path's pad. Once the bus is watched this is
+// what its listener last saw, not an IOCTL of its own.
+void update_feedback() {
+	procon::pad_feedback f {};
+	bus.feedback(0, f);
+
+	if (controller.max != 255) {
+		f.large_motor = static_cast<unsigned>(f.large_motor) * static_cast<unsigned>(controller.max) / 255;
+		f.small_motor = static_cast<unsigned>(f.small_motor) * static_cast<unsigned>(controller.max) / 255;
+	}
+	
+	controller.vibrate = f.vibrate;
+	controller.large_motor = f.large_motor;
+	controller.small_motor = f.small_motor;
+	if (controller.led != f.led + 1) {
+		controller.led = f.led + 1;
+		controller.led_changed = true;
+	}
+	handle_rumble();
+}
+
 BOOL WINAPI ctrl_handler(const DWORD _In_ event) {
 	using std::exit;
 
@@ -293,48 +601,27 @@ BOOL WINAPI ctrl_handler(const DWORD _In_ event) {
 
 BOOL CALLBACK enum_joysticks_callback(const DIDEVICEINSTANCE* pdid_instance,
 									VOID* p_context) {
-#if DRIVING
-	static bool pedals_found {false};
-	static bool procon_found {false};
-#endif
-	HRESULT hr;
-
-#if DRIVING
-	if (pdid_instance->guidProduct.Data1 == 0xBEAD1234) {
-		hr = g_p_di->CreateDevice(pdid_instance->guidInstance,
-								  &g_p_joystick2, nullptr);
-		pedals_found = true;
-		
-		if (procon_found)
-			return DIENUM_STOP;
-		else
-			return DIENUM_CONTINUE;
+	for (auto& s : di_sources) {
+		if (pdid_instance->guidProduct.Data1 != s.product || s.device)
+			continue;
+		if (FAILED(g_p_di->CreateDevice(pdid_instance->guidInstance,
+										&s.device, nullptr)))
+			s.device = nullptr;
+		return DIENUM_CONTINUE;
 	}
-#endif
 
-	if (pdid_instance->guidProduct.Data1 != 0x2009057E)
+	if (pdid_instance->guidProduct.Data1 != 0x2009057E || g_p_joystick)
 		return DIENUM_CONTINUE;
 
-	// Obtain an interface to the enumerated joystick.
-	hr = g_p_di->CreateDevice(pdid_instance->guidInstance,
-							  &g_p_joystick, nullptr);
-#if DRIVING
-	procon_found = true;
-#endif
-	
-	// If it failed, then we can't use this joystick. (Maybe the user unplugged
-	// it while we were in the middle of enumerating it.)
-	if (FAILED(hr))
-		return DIENUM_CONTINUE;
+	// Obtain an interface to the enumerated joystick. If it failed, then we
+	// can't use this joystick. (Maybe the user unplugged it while we were in
+	// the middle of enumerating it.) Either way keep going, there may be
+	// fusion sources left to find.
+	if (FAILED(g_p_di->CreateDevice(pdid_instance->guidInstance,
+									&g_p_joystick, nullptr)))
+		g_p_joystick = nullptr;
 
-	// Stop enumeration. Note: we're just taking the first joystick we get. You
-	// could store all the enumerated joysticks and let the user pick.
-#if DRIVING
-	if (!pedals_found || !procon_found)
-		return DIENUM_CONTINUE;
-	else
-#endif
-	return DIENUM_STOP;
+	return DIENUM_CONTINUE;
 }
 
 BOOL CALLBACK enum_objects_callback(const DIDEVICEOBJECTINSTANCE* pdidoi,
@@ -450,21 +737,23 @@ HRESULT init_direct_input(const HWND h_dlg) {
 	// passing a DIJOYSTATE2 structure to IDirectInputDevice::GetDeviceState().
 	if (FAILED(hr = g_p_joystick->SetDataFormat(&c_dfDIJoystick2)))
 		return hr;
-#if DRIVING
-	if (FAILED(hr = g_p_joystick2->SetDataFormat(&c_dfDIJoystick2)))
-		return hr;
-#endif
 
 	// Set the cooperative level to let DInput know how this device should
 	// interact with the system and with other DInput applications.
 	if (FAILED(hr = g_p_joystick->SetCooperativeLevel(
 			h_dlg, DISCL_EXCLUSIVE | DISCL_BACKGROUND)))
 		return hr;
-#if DRIVING
-	if (FAILED(hr = g_p_joystick2->SetCooperativeLevel(
-			hDlg, DISCL_EXCLUSIVE | DISCL_BACKGROUND)))
-		return hr;
-#endif
+
+	// A fusion source that can't be set up is dropped rather than failing
+	// the whole dialog
+	for (auto& s : di_sources) {
+		if (!s.device)
+			continue;
+		if (FAILED(s.device->SetDataFormat(&c_dfDIJoystick2))
+		 || FAILED(s.device->SetCooperativeLevel(
+				h_dlg, DISCL_EXCLUSIVE | DISCL_BACKGROUND)))
+			SAFE_RELEASE(s.device);
+	}
 
 	// Enumerate the joystick objects. The callback function enabled user
 	// interface elements for objects that are found, and sets the min/max
@@ -472,36 +761,60 @@ HRESULT init_direct_input(const HWND h_dlg) {
 	if (FAILED(hr = g_p_joystick->EnumObjects(enum_objects_callback,
 		(VOID*)h_dlg, DIDFT_ALL)))
 		return hr;
-#if DRIVING
-	if (FAILED(hr = g_p_joystick2->EnumObjects(EnumObjectsCallback,
-		(VOID*)hDlg, DIDFT_ALL)))
-		return hr;
-#endif
 
 	return S_OK;
 }
 
-bytes read_data() {
-	bytes buf;
-	buf.resize(49);
-
-	DWORD tmp;
-	OVERLAPPED ol = {0};
-	ol.hEvent = CreateEvent(nullptr, FALSE, FALSE, TEXT(""));
+// Drains every report queued since the last tick. Returns false if none
+// decoded; otherwise 'out' holds the newest, stamped with its arrival time.
+bool read_reports(procon::input_report& out, std::uint64_t& arrived_us) {
+	const procon::uchar* buf;
+	procon::input_report report;
+	auto any = false;
+	int size;
+
+	if (controller.device == nullptr)
+		return false;
+
+	using procon::trace::emit;
+	using procon::trace::event;
+
+	// Each report is used where hidapi read it and handed back once decoded
+	while ((size = hid_borrow_read(controller.device, &buf, 0)) > 0) {
+		const auto give_back = procon::make_scoped([buf] {
+			hid_return_read(controller.device, buf);
+		});
+		const auto now = procon::clock_us();
+
+		emit(event::report_received, static_cast<std::uint32_t>(size));
+		recorder.write(now, buf, static_cast<std::size_t>(size));
+		if (!controller.decode(buf, static_cast<std::size_t>(size), report))
+			continue;
+		emit(event::report_decoded, report.id << 8 | report.timer);
+		if (report.id == 0x21)
+			emit(event::subcommand_reply, report.subcommand << 8 | report.ack);
+		out = report;
+		arrived_us = now;
+		// Simple reports carry no timer to track the link with
+		if (report.id != static_cast<procon::uchar>(procon::report_mode::simple))
+			link_monitor.report(report.timer, arrived_us);
+		rtt_probe.reply(report, arrived_us);
+		any = true;
+	}
+	if (size < 0)
+		emit(event::error, static_cast<std::uint32_t>(size));
 
-	ReadFile(controller.handle, buf.data(), static_cast<DWORD>(buf.size()), &tmp, &ol);
-	
-	CloseHandle(ol.hEvent);
-	
-	return buf;
+	return any;
 }
 
-HRESULT update_input_state(const HWND h_dlg) {
+// Bluetooth: the pad from DirectInput's view of the controller, which also
+// fills the dialog. S_FALSE when there's nothing to map this tick.
+HRESULT map_direct_input(const HWND h_dlg, procon::button_mask& pressed, const std::uint32_t report_ms) {
 	TCHAR str_text[512] = {0}; // Device state text
 	DIJOYSTATE2 js;           // DInput joystick state
 
 	if (!g_p_joystick)
-		return S_OK;
+		return S_FALSE;
 
 	// Poll the device to read the current state
 	auto hr = g_p_joystick->Poll();
@@ -517,13 +830,13 @@ HRESULT update_input_state(const HWND h_dlg) {
 		// hr may be DIERR_OTHERAPPHASPRIO or other errors.  This
 		// may occur when the app is minimized or in the process of 
 		// switching, so just try again later 
-		return S_OK;
+		return S_FALSE;
 	}
 
 	// Get the input's device state
 	if (FAILED(hr = g_p_joystick->GetDeviceState(sizeof(DIJOYSTATE2), &js)))
 		return hr; // The device should have been acquired during the Poll()
-	
+
 	// Display joystick state to dialog
 
 	// Axes
@@ -570,7 +883,6 @@ HRESULT update_input_state(const HWND h_dlg) {
 
 	xinState.wButtons = 0;
 
-#ifndef USB
 	switch (js.rgdwPOV[0]) {
 	case     0:
 		xinState.wButtons |= 0x1;
@@ -613,208 +925,117 @@ HRESULT update_input_state(const HWND h_dlg) {
 		xinState.wButtons |= 0x0200;
 	if (js.rgbButtons[12])
 		xinState.wButtons |= 0x0400;
-#if POSITIONAL
-	if (js.rgbButtons[0])
-		xinState.wButtons |= 0x1000;
-	if (js.rgbButtons[1])
-		xinState.wButtons |= 0x2000;
-	if (js.rgbButtons[2])
-		xinState.wButtons |= 0x4000;
-	if (js.rgbButtons[3])
-		xinState.wButtons |= 0x8000;
-#else
-	if (js.rgbButtons[1])
-		xinState.wButtons |= 0x1000;
-	if (js.rgbButtons[0])
-		xinState.wButtons |= 0x2000;
-	if (js.rgbButtons[3])
-		xinState.wButtons |= 0x4000;
-	if (js.rgbButtons[2])
-		xinState.wButtons |= 0x8000;
-#endif
-
-#if DRIVING
-	HRESULT hr2 = g_p_joystick2->Poll();
-	if (FAILED(hr2)) {
-		hr2 = g_p_joystick2->Acquire();
-		while (hr2 == DIERR_INPUTLOST)
-			hr2 = g_p_joystick2->Acquire();
-		
-		return S_OK;
+	if (layers.active_profile().positional) {
+		if (js.rgbButtons[0])
+			xinState.wButtons |= 0x1000;
+		if (js.rgbButtons[1])
+			xinState.wButtons |= 0x2000;
+		if (js.rgbButtons[2])
+			xinState.wButtons |= 0x4000;
+		if (js.rgbButtons[3])
+			xinState.wButtons |= 0x8000;
+	} else {
+		if (js.rgbButtons[1])
+			xinState.wButtons |= 0x1000;
+		if (js.rgbButtons[0])
+			xinState.wButtons |= 0x2000;
+		if (js.rgbButtons[3])
+			xinState.wButtons |= 0x4000;
+		if (js.rgbButtons[2])
+			xinState.wButtons |= 0x8000;
 	}
-	DIJOYSTATE2 js2;
-
-	hr2 = g_p_joystick2->GetDeviceState(sizeof(DIJOYSTATE2), &js2);
-	double x = js2.lX - 32767, y = js2.lY - 32767;
-	double l_1, l_2, l_3;
 
-	l_1 = (32767 - y) / 32767;
-	l_2 = (y - x) / 16383;
-	l_3 = 1 - l_1 - l_2;
-	
-	if (l_2 > 0.5625)
-		xinState.bLeftTrigger = 255;
-	else if (l_2 < 0)
-		xinState.bLeftTrigger = 0;
-	else
-		xinState.bLeftTrigger = l_2 * 453;
-	if (l_3 > 0.5625)
-		xinState.bRightTrigger = 255;
-	else if (l_3 < 0)
-		xinState.bRightTrigger = 0;
-	else
-		xinState.bRightTrigger = l_3 * 453;
-	
-	static bool zl_pressed {false};
-	
-	if (js.rgbButtons[6])
-		if (!zl_pressed) {
-			INPUT ip[1];
-
-			ip[0].type = INPUT_KEYBOARD;
-			ip[0].ki.wScan = 0;
-			ip[0].ki.time = 0;
-			ip[0].ki.dwExtraInfo = 0;
-			ip[0].ki.wVk = 0x52;
-			ip[0].ki.dwFlags = 0;
-			SendInput(1, ip, sizeof(INPUT));
-			
-			zl_pressed = true;
-		}
-	else
-		if (zl_pressed) {
-			INPUT ip[1];
-			
-			ip[0].ki.dwFlags = KEYEVENTF_KEYUP;
-			SendInput(1, ip, sizeof(INPUT));
-			
-			zl_pressed = false;
-		}
+#if DRIVING
+	// The pedals drive the triggers through the fusion rules
+	xinState.bLeftTrigger = 0;
+	xinState.bRightTrigger = 0;
 #else
-	if (js.rgbButtons[ 6])
-		xinState.bLeftTrigger = 255;
-	else
-		xinState.bLeftTrigger = 0;
-	if (js.rgbButtons[7])
-		xinState.bRightTrigger = 255;
-	else
-		xinState.bRightTrigger = 0;
+	xinState.bLeftTrigger = layers.curves().digital_trigger(0, js.rgbButtons[6] != 0, report_ms);
+	xinState.bRightTrigger = layers.curves().digital_trigger(1, js.rgbButtons[7] != 0, report_ms);
 #endif
-	
-	static short capturing {0};
-	if (js.rgbButtons[13])
-		++capturing;
-	else if (capturing >= 30) {
-		capturing = 0;
-		INPUT ip[2];
-		
-		ip[0].type = INPUT_KEYBOARD;
-		ip[0].ki.wScan = 0;
-		ip[0].ki.time = 0;
-		ip[0].ki.dwExtraInfo = 0;
-		ip[0].ki.wVk = VK_MENU;
-		ip[0].ki.dwFlags = 0;
-		ip[1].type = INPUT_KEYBOARD;
-		ip[1].ki.wScan = 0;
-		ip[1].ki.time = 0;
-		ip[1].ki.dwExtraInfo = 0;
-		ip[1].ki.wVk = VK_F10;
-		ip[1].ki.dwFlags = 0;
-		SendInput(2, ip, sizeof(INPUT));
-		ip[0].ki.dwFlags = KEYEVENTF_KEYUP;
-		ip[1].ki.dwFlags = KEYEVENTF_KEYUP;
-		SendInput(2, ip, sizeof(INPUT));
-	} else if (capturing > 0) {
-		capturing = 0;
-		INPUT ip[2];
-
-		ip[0].type = INPUT_KEYBOARD;
-		ip[0].ki.wScan = 0;
-		ip[0].ki.time = 0;
-		ip[0].ki.dwExtraInfo = 0;
-		ip[0].ki.wVk = VK_MENU;
-		ip[0].ki.dwFlags = 0;
-		ip[1].type = INPUT_KEYBOARD;
-		ip[1].ki.wScan = 0;
-		ip[1].ki.time = 0;
-		ip[1].ki.dwExtraInfo = 0;
-		ip[1].ki.wVk = VK_F1;
-		ip[1].ki.dwFlags = 0;
-		SendInput(2, ip, sizeof(INPUT));
-		ip[0].ki.dwFlags = KEYEVENTF_KEYUP;
-		ip[1].ki.dwFlags = KEYEVENTF_KEYUP;
-		SendInput(2, ip, sizeof(INPUT));
-	}
-	
-	static unsigned min {0}, max {0};
-	
+
+	for (std::size_t i = 0; i < di_buttons.size(); ++i)
+		if (js.rgbButtons[i])
+			pressed |= procon::mask_of(di_buttons[i]);
+
 	xinState.sThumbLX = 0x8000 + static_cast<short>(js.lX);
 	xinState.sThumbLY = 0x7FFF - static_cast<short>(js.lY);
 	xinState.sThumbRX = 0x8000 + static_cast<short>(js.lRx);
 	xinState.sThumbRY = 0x7FFF - static_cast<short>(js.lRy);
+	layers.curves().apply_sticks(xinState);
+	return S_OK;
+}
+
+// Wired: DirectInput sees the vendor-defined USB report only as bits smeared
+// across lX and lY, so the pad comes from the decoded report itself
+void map_wired(const procon::input_report& report, procon::button_mask& pressed,
+			   const std::uint32_t report_ms) {
+	using procon::button;
+	using procon::mask_of;
+
+	procon::map_report(report, layers.active_profile().positional, xinState);
+	layers.curves().apply_sticks(xinState);
+#if DRIVING
+	xinState.bLeftTrigger = 0;
+	xinState.bRightTrigger = 0;
 #else
-	if (js.lY & 0x02)
-		xinState.wButtons |= 0x0001;
-	if (js.lY & 0x01)
-		xinState.wButtons |= 0x0002;
-	if (js.lY & 0x08)
-		xinState.wButtons |= 0x0004;
-	if (js.lY & 0x04)
-		xinState.wButtons |= 0x0008;
-	if ((js.lX - 0x7FFF) & 0x0200)
-		xinState.wButtons |= 0x0010;
-	if ((js.lX - 0x7FFF) & 0x0100)
-		xinState.wButtons |= 0x0020;
-	if ((js.lX - 0x7FFF) & 0x0800)
-		xinState.wButtons |= 0x0040;
-	if ((js.lX - 0x7FFF) & 0x0400)
-		xinState.wButtons |= 0x0080;
-	if (js.lY & 0x40)
-		xinState.wButtons |= 0x0100;
-	if ((js.lX - 0x7FFF) & 0x0040)
-		xinState.wButtons |= 0x0200;
-	if ((js.lX - 0x7FFF) & 0x1000)
-		xinState.wButtons |= 0x0400;
-	if ((js.lX - 0x7FFF) & 0x0008)
-		xinState.wButtons |= 0x1000;
-	if ((js.lX - 0x7FFF) & 0x0004)
-		xinState.wButtons |= 0x2000;
-	if ((js.lX - 0x7FFF) & 0x0002)
-		xinState.wButtons |= 0x4000;
-	if ((js.lX - 0x7FFF) & 0x0001)
-		xinState.wButtons |= 0x8000;
-
-	if (js.lY & 0x80)
-		xinState.bLeftTrigger = 65535;
-	else
-		xinState.bLeftTrigger = 0;
-	if ((js.lX - 0x7FFF) & 0x0080)
-		xinState.bRightTrigger = 65535;
-	else
-		xinState.bRightTrigger = 0;
+	xinState.bLeftTrigger = layers.curves().digital_trigger(0, (report.buttons & mask_of(button::zl)) != 0, report_ms);
+	xinState.bRightTrigger = layers.curves().digital_trigger(1, (report.buttons & mask_of(button::zr)) != 0, report_ms);
 #endif
-	
-	XOutput::XOutputSetState(0, &xinState);
 
-	UCHAR a {0}, b {0}, c {0}, d {0};
-	
-	XOutput::XOutputGetState(0, &a, &b, &c, &d);
+	// The buttons DirectInput would have reported, so gestures and key
+	// bindings behave the same on either link
+	for (const auto b : di_buttons)
+		pressed |= report.buttons & mask_of(b);
+}
 
-	if (controller.max != 255) {
-		b = static_cast<unsigned>(b) * static_cast<unsigned>(controller.max) / 255;
-		c = static_cast<unsigned>(c) * static_cast<unsigned>(controller.max) / 255;
+HRESULT update_input_state(const HWND h_dlg) {
+	procon::input_report report;
+	std::uint64_t arrived_us;
+	const auto fresh = read_reports(report, arrived_us);
+
+	if (fresh) {
+		exported.connected = controller.connected;
+		exported.raw = report;
+		exported.timing.last_report_us = arrived_us;
+		++exported.timing.reports;
+		exported.link = link_monitor.stats();
+		exported.rtt = rtt_probe.stats();
+		state_export.publish(0, exported);
 	}
-	
-	controller.vibrate = a;
-	controller.large_motor = b;
-	controller.small_motor = c;
-	if (controller.led != d + 1) {
-		controller.led = d + 1;
-		controller.led_changed = true;
+
+	const auto report_ms = procon::clock_ms();
+	procon::button_mask pressed {0};
+
+	if (controller.connected && controller.link == procon::link_type::usb) {
+		if (!fresh)
+			return S_OK;
+		map_wired(report, pressed, report_ms);
+	} else {
+		const auto hr = map_direct_input(h_dlg, pressed, report_ms);
+		if (hr != S_OK)
+			return SUCCEEDED(hr) ? S_OK : hr;
 	}
-	handle_rumble();
 
-	auto buf = read_data();
+	layers.input(pressed, report_ms);
+	for (const auto& s : di_sources)
+		poll_di_source(s, report_ms);
+	layers.overlay(xinState, report_ms);
+
+	const auto submit_us = procon::clock_us();
+	
+	bus.submit(0, xinState);
+	procon::trace::emit(procon::trace::event::submitted, xinState.wButtons);
+
+	exported.pad = xinState;
+	exported.timing.submit_us = static_cast<std::uint32_t>(procon::clock_us() - submit_us);
+	exported.timing.map_us = static_cast<std::uint32_t>(submit_us - exported.timing.last_report_us);
+	if (exported.timing.submits == 0)
+		startup.mark("pad 0 first input");
+	++exported.timing.submits;
+	state_export.publish(0, exported);
+
+	update_feedback();
 	
 	return S_OK;
 }
@@ -825,6 +1046,12 @@ VOID free_direct_input() {
 	if (g_p_joystick)
 		g_p_joystick->Unacquire();
 
+	for (auto& s : di_sources) {
+		if (s.device)
+			s.device->Unacquire();
+		SAFE_RELEASE(s.device);
+	}
+
 	// Release any DirectInput objects.
 	SAFE_RELEASE(g_p_joystick);
 	SAFE_RELEASE(g_p_di);
@@ -843,8 +1070,14 @@ INT_PTR CALLBACK main_dlg_proc(const HWND h_dlg, const UINT msg, const WPARAM w_
 
 		// Get the driver attributes (Vendor ID, Product ID, Version Number)
 		SetTimer(h_dlg, 0, 1000 / 120, nullptr);
+		dialog = h_dlg;
+		startup.mark("dialog created");
 		return TRUE;
 	}
+	case wm_feedback:
+		// The bus's listener saw pad 0's feedback change
+		update_feedback();
+		return TRUE;
 	case WM_TIMER:
 		// Update the input device every timer message
 		if (FAILED(update_input_state(h_dlg))) {
@@ -864,6 +1097,7 @@ INT_PTR CALLBACK main_dlg_proc(const HWND h_dlg, const UINT msg, const WPARAM w_
 		}
 	case WM_DESTROY:
 		// Cleanup everything
+		dialog = nullptr;
 		KillTimer(h_dlg, 0);
 		free_direct_input();
 	default:
@@ -883,42 +1117,155 @@ int APIENTRY WinMain(_In_ const HINSTANCE h_inst, _In_opt_ HINSTANCE,
 	atexit([] {
 		// trigger deconstructors for all controllers
 		std::lock_guard<std::mutex> lk(controller_map_mutex);	
+		// Its listener calls into XOutput1_1.dll, which is unloaded next
+		bus.stop_watching();
+
+		// Keep the last few seconds around to diagnose stutters after the fact
+		char dir[MAX_PATH];
+		const auto len = GetTempPathA(MAX_PATH, dir);
+		if (len > 0 && len < MAX_PATH) {
+			const auto path = std::string(dir) + "procon_trace.bin";
+			if (procon::trace::dump(path))
+				std::cerr << "Trace written to " << path << '\n';
+		}
 	});
 
-	try {
-		XOutput::XOutputInitialize();
-	} catch (XOutput::XOutputError &e) {
-		cout << e.what() << '\n';
-		return -1;
-	}
+	// Loading the bus driver overlaps finding and handshaking controllers;
+	// only plugging a pad in waits for it
+	const std::shared_future<void> bus_ready = std::async(std::launch::async, connect_bus).share();
+
+	if (!state_export.open())
+		std::cerr << "Unable to create the shared state region ("
+				  << GetLastError() << "), not exporting state\n";
 	
-	DWORD unused;
-	if (!success(XOutput::XOutputGetRealUserIndex(0, &unused))) {
-		cout << "Unable to connect to ScpVBus.\n";
-		return -1;
+	// Needed before any controller is opened
+	auto use_reactor = false, use_timer = false;
+	for (auto i = 1; i < __argc; ++i)
+		if (strcmp(__argv[i], "--reactor") == 0)
+			use_reactor = true;
+		else if (strcmp(__argv[i], "--timer") == 0)
+			use_timer = true;
+		else if (strcmp(__argv[i], "--simple-reports") == 0)
+			handshake.mode = procon::report_mode::simple;
+		else if (strcmp(__argv[i], "--resample") == 0 && i + 1 < __argc) {
+			++i;
+			if (strcmp(__argv[i], "interpolate") == 0)
+				resampling.mode = procon::resample_mode::interpolate;
+			else if (strcmp(__argv[i], "extrapolate") == 0)
+				resampling.mode = procon::resample_mode::extrapolate;
+			else
+				std::cerr << "Unknown resampling mode " << __argv[i] << ", not resampling\n";
+		} else if (strcmp(__argv[i], "--output-hz") == 0 && i + 1 < __argc)
+			resampling.output_hz = std::max(1, atoi(__argv[++i]));
+
+	// The resampled cadence is kept by the reactor thread; the dialog timer
+	// can't tick faster than the system timer
+	if (resampling.mode != procon::resample_mode::off) {
+		if (use_timer) {
+			std::cerr << "Resampling needs the reactor, not resampling\n";
+			resampling.mode = procon::resample_mode::off;
+		} else {
+			use_reactor = true;
+			timeBeginPeriod(1);
+		}
 	}
-	
-	HidD_GetHidGuid(&hid_guid);
-	get_initial_plugged_devices();
+
+	// A wired controller can report far faster than the dialog timer ticks,
+	// so it gets the reactor unless the timer is asked for
+	const auto found = procon::find_pro_controllers(std::cerr);
+	startup.mark(std::to_string(found.size()) + " controller(s) found");
+	if (!use_timer && std::any_of(found.begin(), found.end(), [](const procon::found_controller& f) {
+			return f.link == procon::link_type::usb;
+		}))
+		use_reactor = true;
+	if (!use_reactor)
+		get_initial_plugged_devices(found);
 	
 	{
 		using std::uint8_t;
 
-		const bytes buf = {0x01, static_cast<uint8_t>(controller.counter++ & 0x0F),
-					 0x00, 0x01, 0x40, 0x40, 0x00,
-					 0x01, 0x40, 0x40, 0x30, 0x01};
+		controller.rumble = {0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40};
+
+		std::array<procon::uchar, 12> buf {{0x01, static_cast<uint8_t>(controller.counter++ & 0x0F)}};
+		std::copy(controller.rumble.begin(), controller.rumble.end(), buf.begin() + 2);
+		buf[10] = 0x30;
+		buf[11] = 0x01;
 		
 		write_data(buf);
 		controller.led = 1;
 		controller.led_changed = false;
 	}
 	
-	if (__argc > 1)
-		controller.max = atoi(__argv[1]);
-	else
-		controller.max = 255;
+	// [--reactor | --timer] [--simple-reports] [--resample interpolate|extrapolate]
+	// [--output-hz N] [--pad-table] [--rtt-probe] [--record <capture>] [max rumble strength]
+	controller.max = 255;
+	for (auto i = 1; i < __argc; ++i) {
+		if (strcmp(__argv[i], "--reactor") == 0 || strcmp(__argv[i], "--timer") == 0
+		 || strcmp(__argv[i], "--simple-reports") == 0)
+			continue;
+		else if ((strcmp(__argv[i], "--resample") == 0 || strcmp(__argv[i], "--output-hz") == 0)
+				 && i + 1 < __argc)
+			++i;
+		else if (strcmp(__argv[i], "--rtt-probe") == 0)
+			probe_rtt = true;
+		else if (strcmp(__argv[i], "--pad-table") == 0)
+			use_pad_table = true;
+		else if (strcmp(__argv[i], "--record") == 0 && i + 1 < __argc) {
+			if (!recorder.open(__argv[++i]))
+				std::cerr << "Unable to record to " << __argv[i] << '\n';
+		} else
+			controller.max = atoi(__argv[i]);
+	}
+
+	register_fusion_sources();
+
+	auto profiles = procon::default_profiles();
+#if DRIVING
+	// ZL doubles as the 'R' key while the pedals drive the triggers
+	for (auto& p : profiles)
+		p.keys[procon::button_index(procon::button::zl)] = 'R';
+#endif
+	layers.set_profiles(std::move(profiles), POSITIONAL ? 1 : 0);
+
+	if (use_reactor) {
+		try {
+			cout << "Bringing up " << start_reactor(found, controller.max, bus_ready)
+				 << " controller(s) on the reactor thread\n";
+		} catch (const std::runtime_error& e) {
+			cout << e.what() << '\n';
+			return -1;
+		}
+	}
+
+	try {
+		bus_ready.get();
+	} catch (const XOutput::XOutputError& e) {
+		cout << e.what() << '\n';
+		stop_reactor();
+		return -1;
+	}
+	if (!use_reactor && controller.connected)
+		bus.plug(0);
+
+	// Feedback arrives from the bus's listener thread from here on, instead
+	// of being asked for after every submit
+	auto* const waker = io_reactor.get();
+	if (!bus.watch_feedback([waker](const unsigned index) {
+			feedback_changed.fetch_or(1u << index);
+			if (waker != nullptr)
+				waker->wake();
+			else if (index == 0 && dialog.load() != nullptr)
+				PostMessage(dialog, wm_feedback, 0, 0);
+		}))
+		std::cerr << "Unable to watch the bus for feedback, polling it\n";
 	
 	DialogBox(h_inst, MAKEINTRESOURCE(IDD_JOYST_IMM), nullptr, main_dlg_proc);
 
+	// The reactor's pads submit until it stops; the dialog's ended already
+	stop_reactor();
+	bus.stop_watching();
+	if (resampling.mode != procon::resample_mode::off)
+		timeEndPeriod(1);
+
 	return 0;
 }